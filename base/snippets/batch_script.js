@@ -0,0 +1,34 @@
+// Example of the batch script contracts, see the script rules in pref.example.ini and pref.example.yml.
+// Every function is called once with all matching nodes of the whole list and returns an array of the same length.
+
+// drop nodes which remarks contain "Expired" and nodes not using port 443
+function filterAll(nodes) {
+    return nodes.map(function(node) {
+        var info = JSON.parse(node.ProxyInfo);
+        return node.Remark.indexOf('Expired') < 0 && info.Port == 443;
+    });
+}
+
+// number the nodes of each region in list order: "HK a", "HK b" -> "HK 01", "HK 02"
+// the numbers only run on across the whole list because renameAll receives all nodes in one call
+function renameAll(nodes) {
+    var counts = {};
+    return nodes.map(function(node) {
+        var region = node.Remark.split(' ')[0];
+        counts[region] = (counts[region] || 0) + 1;
+        return region + ' ' + (counts[region] < 10 ? '0' : '') + counts[region];
+    });
+}
+
+// mark the nodes of regions with more than one node, an empty string leaves the node to the next emoji rules
+// strings leave Duktape as CESU-8, so characters outside the BMP such as flags are better added by plain emoji rules
+function getEmojiAll(nodes) {
+    var counts = {};
+    nodes.forEach(function(node) {
+        var region = node.Remark.split(' ')[0];
+        counts[region] = (counts[region] || 0) + 1;
+    });
+    return nodes.map(function(node) {
+        return counts[node.Remark.split(' ')[0]] > 1 ? '★' : '';
+    });
+}
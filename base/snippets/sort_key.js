@@ -0,0 +1,11 @@
+// Example of the sortKey contract, set sort_script=path:snippets/sort_key.js in [node_pref] and request with &sort=true.
+// sortKey is called once per node, numbers sort before strings and equal keys keep the original order.
+
+// nodes on port 443 first, then by remark; "HK 02" and "HK 10" sort as 2 and 10 since the number is padded
+function sortKey(node) {
+    var info = JSON.parse(node.ProxyInfo);
+    var remark = node.Remark.replace(/\d+/g, function(number) {
+        return ('0000000000' + number).slice(-10);
+    });
+    return (info.Port == 443 ? '0 ' : '1 ') + remark;
+}
@@ -9,6 +9,7 @@ c++ -std=c++17 -Wall -fexceptions -c src/main.cpp -o obj/main.o
 c++ -std=c++17 -Wall -fexceptions -c src/misc.cpp -o obj/misc.o
 c++ -std=c++17 -Wall -fexceptions -c src/multithread.cpp -o obj/multithread.o
 c++ -std=c++17 -Wall -fexceptions -c src/nodemanip.cpp -o obj/nodemanip.o
+c++ -std=c++17 -Wall -fexceptions -c src/regex_prefilter.cpp -o obj/regex_prefilter.o
 c++ -std=c++17 -Wall -fexceptions -c src/speedtestutil.cpp -o obj/speedtestutil.o
 c++ -std=c++17 -Wall -fexceptions -c src/subexport.cpp -o obj/subexport.o
 c++ -std=c++17 -Wall -fexceptions -c src/upload.cpp -o obj/upload.o
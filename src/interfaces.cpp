@@ -2,6 +2,8 @@
 #include <string>
 #include <mutex>
 #include <numeric>
+#include <list>
+#include <unordered_map>
 
 #include <inja.hpp>
 #include <yaml-cpp/yaml.h>
@@ -21,29 +23,20 @@
 #include "templates.h"
 #include "upload.h"
 #include "script_duktape.h"
+#include "interfaces.h"
 
 //common settings
-std::string gPrefPath = "pref.ini", gDefaultExtConfig;
-string_array gExcludeRemarks, gIncludeRemarks, gCustomRulesets, gStreamNodeRules, gTimeNodeRules;
-std::vector<ruleset_content> gRulesetContent;
-std::string gListenAddress = "127.0.0.1", gDefaultUrls, gInsertUrls, gManagedConfigPrefix;
+std::string gPrefPath = "pref.ini";
 int gListenPort = 25500, gMaxPendingConns = 10, gMaxConcurThreads = 4;
 bool gPrependInsert = true, gSkipFailedLinks = false;
 bool gAPIMode = true, gWriteManagedConfig = false, gEnableRuleGen = true, gUpdateRulesetOnRequest = false, gOverwriteOriginalRules = true;
 bool gPrintDbgInfo = false, gCFWChildProcess = false, gAppendUserinfo = true, gAsyncFetchRuleset = false, gSurgeResolveHostname = true;
-std::string gAccessToken, gBasePath = "base";
 extern std::string custom_group;
 extern int gLogLevel;
 extern long gMaxAllowedDownloadSize;
+extern size_t gCacheMemorySize;
 string_map gAliases;
 
-extern bool gServeFile;
-extern std::string gServeFileRoot;
-
-//global variables for template
-std::string gTemplatePath = "templates";
-string_map gTemplateVars;
-
 //generator settings
 bool gGeneratorMode = false;
 std::string gGenerateProfiles;
@@ -52,32 +45,20 @@ std::string gGenerateProfiles;
 std::mutex gMutexConfigure;
 
 //preferences
-string_array gRenames, gEmojis;
 bool gAddEmoji = false, gRemoveEmoji = false, gAppendType = false, gFilterDeprecated = true;
-tribool gUDP, gTFO, gSkipCertVerify, gTLS13, gEnableInsert;
 bool gEnableSort = false, gUpdateStrict = false;
 bool gClashUseNewField = false;
-std::string gClashProxiesStyle = "flow";
-std::string gProxyConfig, gProxyRuleset, gProxySubscription;
 int gUpdateInterval = 0;
-std::string gSortScript, gFilterScript;
-
-std::string gClashBase;
-string_array gCustomProxyGroups;
-std::string gSurgeBase, gSurfboardBase, gMellowBase, gQuanBase, gQuanXBase, gLoonBase, gSSSubBase;
-std::string gSurgeSSRPath, gQuanXDevID;
 
 //cache system
 bool gServeCacheOnFetchFail = false;
-int gCacheSubscription = 60, gCacheConfig = 300, gCacheRuleset = 21600;
+int gCacheSubscription = 60, gCacheConfig = 300, gCacheRuleset = 21600, gCacheStaleWhileRevalidate = 0;
 
 //limits
 size_t gMaxAllowedRulesets = 64, gMaxAllowedRules = 32768;
 
 string_array gRegexBlacklist = {"(.*)*"};
 
-void refreshRulesets(string_array &ruleset_list, std::vector<ruleset_content> &ruleset_content_array);
-
 std::string parseProxy(const std::string &source)
 {
     std::string proxy = source;
@@ -257,7 +238,7 @@ std::string convertRuleset(const std::string &content, int type)
 std::string getConvertedRuleset(RESPONSE_CALLBACK_ARGS)
 {
     std::string url = UrlDecode(getUrlArg(request.argument, "url")), type = getUrlArg(request.argument, "type");
-    return convertRuleset(fetchFile(url, parseProxy(gProxyRuleset), gCacheRuleset), to_int(type));
+    return convertRuleset(fetchFile(url, parseProxy(getPrefConfig()->proxy_ruleset), gCacheRuleset), to_int(type));
 }
 
 std::string getRuleset(RESPONSE_CALLBACK_ARGS)
@@ -275,12 +256,12 @@ std::string getRuleset(RESPONSE_CALLBACK_ARGS)
         return "Invalid request!";
     }
 
-    std::string proxy = parseProxy(gProxyRuleset);
+    std::string proxy = parseProxy(getPrefConfig()->proxy_ruleset);
     string_array vArray = split(url, "|");
     for(std::string &x : vArray)
         x.insert(0, "ruleset,");
     std::vector<ruleset_content> rca;
-    refreshRulesets(vArray, rca);
+    refreshRulesets(vArray, rca, proxy);
     for(ruleset_content &x : rca)
     {
         std::string content = x.rule_content.get();
@@ -411,7 +392,7 @@ std::string getRuleset(RESPONSE_CALLBACK_ARGS)
     return output_content;
 }
 
-int importItems(string_array &target, bool scope_limit = true)
+int importItems(string_array &target, const std::string &proxy, bool scope_limit = true)
 {
     string_array result;
     std::stringstream ss;
@@ -427,8 +408,6 @@ int importItems(string_array &target, bool scope_limit = true)
         path = x.substr(x.find(":") + 1);
         writeLog(0, "Trying to import items from " + path);
 
-        std::string proxy = parseProxy(gProxyConfig);
-
         if(fileExist(path))
             content = fileGet(path, scope_limit);
         else if(isLink(path))
@@ -458,7 +437,7 @@ int importItems(string_array &target, bool scope_limit = true)
     return 0;
 }
 
-void readRegexMatch(YAML::Node node, const std::string &delimiter, string_array &dest, bool scope_limit = true)
+void readRegexMatch(YAML::Node node, const std::string &delimiter, string_array &dest, const std::string &proxy, bool scope_limit = true)
 {
     YAML::Node object;
     std::string script, url, match, rep, strLine;
@@ -486,10 +465,10 @@ void readRegexMatch(YAML::Node node, const std::string &delimiter, string_array
             continue;
         dest.emplace_back(std::move(strLine));
     }
-    importItems(dest, scope_limit);
+    importItems(dest, proxy, scope_limit);
 }
 
-void readEmoji(YAML::Node node, string_array &dest, bool scope_limit = true)
+void readEmoji(YAML::Node node, string_array &dest, const std::string &proxy, bool scope_limit = true)
 {
     YAML::Node object;
     std::string script, url, match, rep, strLine;
@@ -518,10 +497,10 @@ void readEmoji(YAML::Node node, string_array &dest, bool scope_limit = true)
             continue;
         dest.emplace_back(std::move(strLine));
     }
-    importItems(dest, scope_limit);
+    importItems(dest, proxy, scope_limit);
 }
 
-void readGroup(YAML::Node node, string_array &dest, bool scope_limit = true)
+void readGroup(YAML::Node node, string_array &dest, const std::string &proxy, bool scope_limit = true)
 {
     std::string strLine, name, type;
     string_array tempArray;
@@ -572,10 +551,10 @@ void readGroup(YAML::Node node, string_array &dest, bool scope_limit = true)
         });
         dest.emplace_back(std::move(strLine));
     }
-    importItems(dest, scope_limit);
+    importItems(dest, proxy, scope_limit);
 }
 
-void readRuleset(YAML::Node node, string_array &dest, bool scope_limit = true)
+void readRuleset(YAML::Node node, string_array &dest, const std::string &proxy, bool scope_limit = true)
 {
     std::string strLine, name, url, group, interval;
     YAML::Node object;
@@ -605,18 +584,16 @@ void readRuleset(YAML::Node node, string_array &dest, bool scope_limit = true)
             continue;
         dest.emplace_back(std::move(strLine));
     }
-    importItems(dest, scope_limit);
+    importItems(dest, proxy, scope_limit);
 }
 
-void refreshRulesets(string_array &ruleset_list, std::vector<ruleset_content> &ruleset_content_array)
+void refreshRulesets(const string_array &ruleset_list, std::vector<ruleset_content> &ruleset_content_array, const std::string &proxy)
 {
     eraseElements(ruleset_content_array);
     std::string rule_group, rule_url, rule_url_typed, interval;
     ruleset_content rc;
 
-    std::string proxy = parseProxy(gProxyRuleset);
-
-    for(std::string &x : ruleset_list)
+    for(const std::string &x : ruleset_list)
     {
         string_size pos = x.find(",");
         if(pos == x.npos || pos == x.size() - 1)
@@ -626,7 +603,7 @@ void refreshRulesets(string_array &ruleset_list, std::vector<ruleset_content> &r
         {
             rule_url = trim(x.substr(pos + 1));
             writeLog(0, "Adding rule '" + rule_url.substr(2) + "," + rule_group + "'.", LOG_LEVEL_INFO);
-            rc = {rule_group, "", "", RULESET_SURGE, std::async(std::launch::async, [rule_url](){return rule_url;}), 0};
+            rc = {rule_group, "", "", RULESET_SURGE, std::async(std::launch::async, [rule_url](){return rule_url;}), 0, {}};
         }
         else
         {
@@ -645,21 +622,30 @@ void refreshRulesets(string_array &ruleset_list, std::vector<ruleset_content> &r
                 type = iter->second;
             }
             writeLog(0, "Updating ruleset url '" + rule_url + "' with group '" + rule_group + "'.", LOG_LEVEL_INFO);
-            rc = {rule_group, rule_url, rule_url_typed, type, fetchFileAsync(rule_url, proxy, gCacheRuleset, gAsyncFetchRuleset), to_int(interval, 0)};
+            std::shared_future<std::string> content = fetchFileAsync(rule_url, proxy, gCacheRuleset, gAsyncFetchRuleset);
+            std::shared_future<parsed_ruleset_ptr> parsed = std::async(gAsyncFetchRuleset ? std::launch::async : std::launch::deferred, [content, type, rule_group](){ return parseRuleset(content.get(), type, rule_group); });
+            rc = {rule_group, rule_url, rule_url_typed, type, content, to_int(interval, 0), parsed};
+            if(!gAsyncFetchRuleset)
+                rc.rule_parsed.wait(); /// parse now so requests only emit the rendered rules
         }
         ruleset_content_array.emplace_back(std::move(rc));
     }
     ruleset_content_array.shrink_to_fit();
 }
 
-void readYAMLConf(YAML::Node &node)
+static void readYAMLConf(YAML::Node &node, pref_config &conf)
 {
     YAML::Node section = node["common"];
     std::string strLine;
     string_array tempArray;
 
     section["api_mode"] >> gAPIMode;
-    section["api_access_token"] >> gAccessToken;
+    section["api_access_token"] >> conf.access_token;
+    section["proxy_config"] >> conf.proxy_config;
+    section["proxy_ruleset"] >> conf.proxy_ruleset;
+    section["proxy_subscription"] >> conf.proxy_subscription;
+    //imports are fetched through the proxy of this preference, not the one currently published
+    std::string proxy = parseProxy(conf.proxy_config);
     if(section["default_url"].IsSequence())
     {
         section["default_url"] >> tempArray;
@@ -669,11 +655,11 @@ void readYAMLConf(YAML::Node &node)
             {
                 return std::move(a) + "|" + std::move(b);
             });
-            gDefaultUrls = strLine;
+            conf.default_urls = strLine;
             eraseElements(tempArray);
         }
     }
-    gEnableInsert = safe_as<std::string>(section["enable_insert"]);
+    conf.enable_insert = safe_as<std::string>(section["enable_insert"]);
     if(section["insert_url"].IsSequence())
     {
         section["insert_url"] >> tempArray;
@@ -683,47 +669,44 @@ void readYAMLConf(YAML::Node &node)
             {
                 return std::move(a) + "|" + std::move(b);
             });
-            gInsertUrls = strLine;
+            conf.insert_urls = strLine;
             eraseElements(tempArray);
         }
     }
     section["prepend_insert_url"] >> gPrependInsert;
     if(section["exclude_remarks"].IsSequence())
-        section["exclude_remarks"] >> gExcludeRemarks;
+        section["exclude_remarks"] >> conf.exclude_remarks;
     if(section["include_remarks"].IsSequence())
-        section["include_remarks"] >> gIncludeRemarks;
-    gFilterScript = safe_as<bool>(section["enable_filter"]) ? safe_as<std::string>(section["filter_script"]) : "";
-    if(startsWith(gFilterScript, "path:"))
-        gFilterScript = fileGet(gFilterScript.substr(5), false);
-    section["base_path"] >> gBasePath;
-    section["clash_rule_base"] >> gClashBase;
-    section["surge_rule_base"] >> gSurgeBase;
-    section["surfboard_rule_base"] >> gSurfboardBase;
-    section["mellow_rule_base"] >> gMellowBase;
-    section["quan_rule_base"] >> gQuanBase;
-    section["quanx_rule_base"] >> gQuanXBase;
-    section["loon_rule_base"] >> gLoonBase;
-    section["sssub_rule_base"] >> gSSSubBase;
-
-    section["default_external_config"] >> gDefaultExtConfig;
+        section["include_remarks"] >> conf.include_remarks;
+    conf.filter_script = safe_as<bool>(section["enable_filter"]) ? safe_as<std::string>(section["filter_script"]) : "";
+    if(startsWith(conf.filter_script, "path:"))
+        conf.filter_script = fileGet(conf.filter_script.substr(5), false);
+    section["base_path"] >> conf.base_path;
+    section["clash_rule_base"] >> conf.clash_base;
+    section["surge_rule_base"] >> conf.surge_base;
+    section["surfboard_rule_base"] >> conf.surfboard_base;
+    section["mellow_rule_base"] >> conf.mellow_base;
+    section["quan_rule_base"] >> conf.quan_base;
+    section["quanx_rule_base"] >> conf.quanx_base;
+    section["loon_rule_base"] >> conf.loon_base;
+    section["sssub_rule_base"] >> conf.sssub_base;
+
+    section["default_external_config"] >> conf.default_ext_config;
     section["append_proxy_type"] >> gAppendType;
-    section["proxy_config"] >> gProxyConfig;
-    section["proxy_ruleset"] >> gProxyRuleset;
-    section["proxy_subscription"] >> gProxySubscription;
 
     if(node["userinfo"].IsDefined())
     {
         section = node["userinfo"];
         if(section["stream_rule"].IsSequence())
         {
-            readRegexMatch(section["stream_rule"], "|", tempArray, false);
-            safe_set_streams(tempArray);
+            readRegexMatch(section["stream_rule"], "|", tempArray, proxy, false);
+            conf.stream_rules.swap(tempArray);
             eraseElements(tempArray);
         }
         if(section["time_rule"].IsSequence())
         {
-            readRegexMatch(section["time_rule"], "|", tempArray, false);
-            safe_set_times(tempArray);
+            readRegexMatch(section["time_rule"], "|", tempArray, proxy, false);
+            conf.time_rules.swap(tempArray);
             eraseElements(tempArray);
         }
     }
@@ -736,22 +719,22 @@ void readYAMLConf(YAML::Node &node)
         section["tcp_fast_open_flag"] >> tfo_flag;
         section["skip_cert_verify_flag"] >> scv_flag;
         */
-        gUDP.set(safe_as<std::string>(section["udp_flag"]));
-        gTFO.set(safe_as<std::string>(section["tcp_fast_open_flag"]));
-        gSkipCertVerify.set(safe_as<std::string>(section["skip_cert_verify_flag"]));
-        gTLS13.set(safe_as<std::string>(section["tls13_flag"]));
+        conf.udp.set(safe_as<std::string>(section["udp_flag"]));
+        conf.tfo.set(safe_as<std::string>(section["tcp_fast_open_flag"]));
+        conf.skip_cert_verify.set(safe_as<std::string>(section["skip_cert_verify_flag"]));
+        conf.tls13.set(safe_as<std::string>(section["tls13_flag"]));
         section["sort_flag"] >> gEnableSort;
-        section["sort_script"] >> gSortScript;
+        section["sort_script"] >> conf.sort_script;
         section["filter_deprecated_nodes"] >> gFilterDeprecated;
         section["append_sub_userinfo"] >> gAppendUserinfo;
         section["clash_use_new_field_name"] >> gClashUseNewField;
-        section["clash_proxies_style"] >> gClashProxiesStyle;
+        section["clash_proxies_style"] >> conf.clash_proxies_style;
     }
 
     if(section["rename_node"].IsSequence())
     {
-        readRegexMatch(section["rename_node"], "@", tempArray, false);
-        safe_set_renames(tempArray);
+        readRegexMatch(section["rename_node"], "@", tempArray, proxy, false);
+        conf.renames.swap(tempArray);
         eraseElements(tempArray);
     }
 
@@ -759,15 +742,15 @@ void readYAMLConf(YAML::Node &node)
     {
         section = node["managed_config"];
         section["write_managed_config"] >> gWriteManagedConfig;
-        section["managed_config_prefix"] >> gManagedConfigPrefix;
+        section["managed_config_prefix"] >> conf.managed_config_prefix;
         section["config_update_interval"] >> gUpdateInterval;
         section["config_update_strict"] >> gUpdateStrict;
-        section["quanx_device_id"] >> gQuanXDevID;
+        section["quanx_device_id"] >> conf.quanx_dev_id;
     }
 
     if(node["surge_external_proxy"].IsDefined())
     {
-        node["surge_external_proxy"]["surge_ssr_path"] >> gSurgeSSRPath;
+        node["surge_external_proxy"]["surge_ssr_path"] >> conf.surge_ssr_path;
         node["surge_external_proxy"]["resolve_hostname"] >> gSurgeResolveHostname;
     }
 
@@ -778,8 +761,8 @@ void readYAMLConf(YAML::Node &node)
         section["remove_old_emoji"] >> gRemoveEmoji;
         if(section["rules"].IsSequence())
         {
-            readEmoji(section["rules"], tempArray, false);
-            safe_set_emojis(tempArray);
+            readEmoji(section["rules"], tempArray, proxy, false);
+            conf.emojis.swap(tempArray);
             eraseElements(tempArray);
         }
     }
@@ -801,47 +784,45 @@ void readYAMLConf(YAML::Node &node)
         }
         const char *ruleset_title = section["rulesets"].IsDefined() ? "rulesets" : "surge_ruleset";
         if(section[ruleset_title].IsSequence())
-            readRuleset(section[ruleset_title], gCustomRulesets, false);
+            readRuleset(section[ruleset_title], conf.custom_rulesets, proxy, false);
     }
 
     const char *groups_title = node["proxy_groups"].IsDefined() ? "proxy_groups" : "proxy_group";
     if(node[groups_title].IsDefined() && node[groups_title]["custom_proxy_group"].IsDefined())
-        readGroup(node[groups_title]["custom_proxy_group"], gCustomProxyGroups, false);
+        readGroup(node[groups_title]["custom_proxy_group"], conf.custom_proxy_groups, proxy, false);
 
     if(node["template"].IsDefined())
     {
-        node["template"]["template_path"] >> gTemplatePath;
+        node["template"]["template_path"] >> conf.template_path;
         if(node["template"]["globals"].IsSequence())
         {
-            eraseElements(gTemplateVars);
+            eraseElements(conf.template_vars);
             for(size_t i = 0; i < node["template"]["globals"].size(); i++)
             {
                 std::string key, value;
                 node["template"]["globals"][i]["key"] >> key;
                 node["template"]["globals"][i]["value"] >> value;
-                gTemplateVars[key] = value;
+                conf.template_vars[key] = value;
             }
         }
     }
 
     if(node["aliases"].IsSequence())
     {
-        reset_redirect();
         for(size_t i = 0; i < node["aliases"].size(); i++)
         {
             std::string uri, target;
             node["aliases"][i]["uri"] >> uri;
             node["aliases"][i]["target"] >> target;
-            append_redirect(uri, target);
+            conf.aliases[uri] = target;
         }
     }
 
     if(node["server"].IsDefined())
     {
-        node["server"]["listen"] >> gListenAddress;
+        node["server"]["listen"] >> conf.listen_address;
         node["server"]["port"] >> gListenPort;
-        node["server"]["serve_file_root"] >>= gServeFileRoot;
-        gServeFile = !gServeFileRoot.empty();
+        node["server"]["serve_file_root"] >>= conf.serve_file_root;
     }
 
     if(node["advanced"].IsDefined())
@@ -886,6 +867,8 @@ void readYAMLConf(YAML::Node &node)
                 node["advanced"]["cache_subscription"] >> gCacheSubscription;
                 node["advanced"]["cache_config"] >> gCacheConfig;
                 node["advanced"]["cache_ruleset"] >> gCacheRuleset;
+                node["advanced"]["cache_memory_size"] >> gCacheMemorySize;
+                node["advanced"]["cache_stale_while_revalidate"] >> gCacheStaleWhileRevalidate;
                 node["advanced"]["serve_cache_on_fetch_fail"] >> gServeCacheOnFetchFail;
             }
             else
@@ -896,17 +879,8 @@ void readYAMLConf(YAML::Node &node)
     }
 }
 
-void readConf()
+static int readPrefFile(pref_config &conf)
 {
-    guarded_mutex guard(gMutexConfigure);
-    //std::cerr<<"Reading preference settings..."<<std::endl;
-    writeLog(0, "Reading preference settings...", LOG_LEVEL_INFO);
-
-    eraseElements(gExcludeRemarks);
-    eraseElements(gIncludeRemarks);
-    eraseElements(gCustomProxyGroups);
-    eraseElements(gCustomRulesets);
-
     try
     {
         std::string prefdata = fileGet(gPrefPath, false);
@@ -914,7 +888,10 @@ void readConf()
         {
             YAML::Node yaml = YAML::Load(prefdata);
             if(yaml.size() && yaml["common"])
-                return readYAMLConf(yaml);
+            {
+                readYAMLConf(yaml, conf);
+                return 0;
+            }
         }
     }
     catch (YAML::Exception &e)
@@ -930,41 +907,43 @@ void readConf()
     {
         //std::cerr<<"Unable to load preference settings. Reason: "<<ini.GetLastError()<<"\n";
         writeLog(0, "Unable to load preference settings. Reason: " + ini.GetLastError(), LOG_LEVEL_FATAL);
-        return;
+        return -1;
     }
 
     string_array tempArray;
 
     ini.EnterSection("common");
     ini.GetBoolIfExist("api_mode", gAPIMode);
-    ini.GetIfExist("api_access_token", gAccessToken);
-    ini.GetIfExist("default_url", gDefaultUrls);
-    gEnableInsert = ini.Get("enable_insert");
-    ini.GetIfExist("insert_url", gInsertUrls);
+    ini.GetIfExist("api_access_token", conf.access_token);
+    ini.GetIfExist("proxy_config", conf.proxy_config);
+    ini.GetIfExist("proxy_ruleset", conf.proxy_ruleset);
+    ini.GetIfExist("proxy_subscription", conf.proxy_subscription);
+    //imports are fetched through the proxy of this preference, not the one currently published
+    std::string proxy = parseProxy(conf.proxy_config);
+    ini.GetIfExist("default_url", conf.default_urls);
+    conf.enable_insert = ini.Get("enable_insert");
+    ini.GetIfExist("insert_url", conf.insert_urls);
     ini.GetBoolIfExist("prepend_insert_url", gPrependInsert);
     if(ini.ItemPrefixExist("exclude_remarks"))
-        ini.GetAll("exclude_remarks", gExcludeRemarks);
+        ini.GetAll("exclude_remarks", conf.exclude_remarks);
     if(ini.ItemPrefixExist("include_remarks"))
-        ini.GetAll("include_remarks", gIncludeRemarks);
-    gFilterScript = ini.GetBool("enable_filter") ? ini.Get("filter_script"): "";
-    ini.GetIfExist("base_path", gBasePath);
-    ini.GetIfExist("clash_rule_base", gClashBase);
-    ini.GetIfExist("surge_rule_base", gSurgeBase);
-    ini.GetIfExist("surfboard_rule_base", gSurfboardBase);
-    ini.GetIfExist("mellow_rule_base", gMellowBase);
-    ini.GetIfExist("quan_rule_base", gQuanBase);
-    ini.GetIfExist("quanx_rule_base", gQuanXBase);
-    ini.GetIfExist("loon_rule_base", gLoonBase);
-    ini.GetIfExist("default_external_config", gDefaultExtConfig);
+        ini.GetAll("include_remarks", conf.include_remarks);
+    conf.filter_script = ini.GetBool("enable_filter") ? ini.Get("filter_script"): "";
+    ini.GetIfExist("base_path", conf.base_path);
+    ini.GetIfExist("clash_rule_base", conf.clash_base);
+    ini.GetIfExist("surge_rule_base", conf.surge_base);
+    ini.GetIfExist("surfboard_rule_base", conf.surfboard_base);
+    ini.GetIfExist("mellow_rule_base", conf.mellow_base);
+    ini.GetIfExist("quan_rule_base", conf.quan_base);
+    ini.GetIfExist("quanx_rule_base", conf.quanx_base);
+    ini.GetIfExist("loon_rule_base", conf.loon_base);
+    ini.GetIfExist("default_external_config", conf.default_ext_config);
     ini.GetBoolIfExist("append_proxy_type", gAppendType);
-    ini.GetIfExist("proxy_config", gProxyConfig);
-    ini.GetIfExist("proxy_ruleset", gProxyRuleset);
-    ini.GetIfExist("proxy_subscription", gProxySubscription);
 
     if(ini.SectionExist("surge_external_proxy"))
     {
         ini.EnterSection("surge_external_proxy");
-        ini.GetIfExist("surge_ssr_path", gSurgeSSRPath);
+        ini.GetIfExist("surge_ssr_path", conf.surge_ssr_path);
         ini.GetBoolIfExist("resolve_hostname", gSurgeResolveHostname);
     }
 
@@ -976,21 +955,21 @@ void readConf()
         ini.GetBoolIfExist("tcp_fast_open_flag", tfo_flag);
         ini.GetBoolIfExist("skip_cert_verify_flag", scv_flag);
         */
-        gUDP.set(ini.Get("udp_flag"));
-        gTFO.set(ini.Get("tcp_fast_open_flag"));
-        gSkipCertVerify.set(ini.Get("skip_cert_verify_flag"));
-        gTLS13.set(ini.Get("tls13_flag"));
+        conf.udp.set(ini.Get("udp_flag"));
+        conf.tfo.set(ini.Get("tcp_fast_open_flag"));
+        conf.skip_cert_verify.set(ini.Get("skip_cert_verify_flag"));
+        conf.tls13.set(ini.Get("tls13_flag"));
         ini.GetBoolIfExist("sort_flag", gEnableSort);
-        gSortScript = ini.Get("sort_script");
+        conf.sort_script = ini.Get("sort_script");
         ini.GetBoolIfExist("filter_deprecated_nodes", gFilterDeprecated);
         ini.GetBoolIfExist("append_sub_userinfo", gAppendUserinfo);
         ini.GetBoolIfExist("clash_use_new_field_name", gClashUseNewField);
-        ini.GetIfExist("clash_proxies_style", gClashProxiesStyle);
+        ini.GetIfExist("clash_proxies_style", conf.clash_proxies_style);
         if(ini.ItemPrefixExist("rename_node"))
         {
             ini.GetAll("rename_node", tempArray);
-            importItems(tempArray, false);
-            safe_set_renames(tempArray);
+            importItems(tempArray, proxy, false);
+            conf.renames.swap(tempArray);
             eraseElements(tempArray);
         }
     }
@@ -1001,25 +980,25 @@ void readConf()
         if(ini.ItemPrefixExist("stream_rule"))
         {
             ini.GetAll("stream_rule", tempArray);
-            importItems(tempArray, false);
-            safe_set_streams(tempArray);
+            importItems(tempArray, proxy, false);
+            conf.stream_rules.swap(tempArray);
             eraseElements(tempArray);
         }
         if(ini.ItemPrefixExist("time_rule"))
         {
             ini.GetAll("time_rule", tempArray);
-            importItems(tempArray, false);
-            safe_set_times(tempArray);
+            importItems(tempArray, proxy, false);
+            conf.time_rules.swap(tempArray);
             eraseElements(tempArray);
         }
     }
 
     ini.EnterSection("managed_config");
     ini.GetBoolIfExist("write_managed_config", gWriteManagedConfig);
-    ini.GetIfExist("managed_config_prefix", gManagedConfigPrefix);
+    ini.GetIfExist("managed_config_prefix", conf.managed_config_prefix);
     ini.GetIntIfExist("config_update_interval", gUpdateInterval);
     ini.GetBoolIfExist("config_update_strict", gUpdateStrict);
-    ini.GetIfExist("quanx_device_id", gQuanXDevID);
+    ini.GetIfExist("quanx_device_id", conf.quanx_dev_id);
 
     ini.EnterSection("emojis");
     ini.GetBoolIfExist("add_emoji", gAddEmoji);
@@ -1027,8 +1006,8 @@ void readConf()
     if(ini.ItemPrefixExist("rule"))
     {
         ini.GetAll("rule", tempArray);
-        importItems(tempArray, false);
-        safe_set_emojis(tempArray);
+        importItems(tempArray, proxy, false);
+        conf.emojis.swap(tempArray);
         eraseElements(tempArray);
     }
 
@@ -1043,13 +1022,13 @@ void readConf()
         ini.GetBoolIfExist("update_ruleset_on_request", gUpdateRulesetOnRequest);
         if(ini.ItemPrefixExist("ruleset"))
         {
-            ini.GetAll("ruleset", gCustomRulesets);
-            importItems(gCustomRulesets, true);
+            ini.GetAll("ruleset", conf.custom_rulesets);
+            importItems(conf.custom_rulesets, proxy, true);
         }
         else if(ini.ItemPrefixExist("surge_ruleset"))
         {
-            ini.GetAll("surge_ruleset", gCustomRulesets);
-            importItems(gCustomRulesets, false);
+            ini.GetAll("surge_ruleset", conf.custom_rulesets);
+            importItems(conf.custom_rulesets, proxy, false);
         }
     }
     else
@@ -1064,37 +1043,35 @@ void readConf()
         ini.EnterSection("clash_proxy_group");
     if(ini.ItemPrefixExist("custom_proxy_group"))
     {
-        ini.GetAll("custom_proxy_group", gCustomProxyGroups);
-        importItems(gCustomProxyGroups, false);
+        ini.GetAll("custom_proxy_group", conf.custom_proxy_groups);
+        importItems(conf.custom_proxy_groups, proxy, false);
     }
 
     ini.EnterSection("template");
-    ini.GetIfExist("template_path", gTemplatePath);
+    ini.GetIfExist("template_path", conf.template_path);
     string_multimap tempmap;
     ini.GetItems(tempmap);
-    eraseElements(gTemplateVars);
+    eraseElements(conf.template_vars);
     for(auto &x : tempmap)
     {
         if(x.first == "template_path")
             continue;
-        gTemplateVars[x.first] = x.second;
+        conf.template_vars[x.first] = x.second;
     }
-    gTemplateVars["managed_config_prefix"] = gManagedConfigPrefix;
+    conf.template_vars["managed_config_prefix"] = conf.managed_config_prefix;
 
     if(ini.SectionExist("aliases"))
     {
         ini.EnterSection("aliases");
         ini.GetItems(tempmap);
-        reset_redirect();
         for(auto &x : tempmap)
-            append_redirect(x.first, x.second);
+            conf.aliases[x.first] = x.second;
     }
 
     ini.EnterSection("server");
-    ini.GetIfExist("listen", gListenAddress);
+    ini.GetIfExist("listen", conf.listen_address);
     ini.GetIntIfExist("port", gListenPort);
-    gServeFileRoot = ini.Get("serve_file_root");
-    gServeFile = !gServeFileRoot.empty();
+    conf.serve_file_root = ini.Get("serve_file_root");
 
     ini.EnterSection("advanced");
     std::string log_level;
@@ -1137,12 +1114,15 @@ void readConf()
             ini.GetIntIfExist("cache_subscription", gCacheSubscription);
             ini.GetIntIfExist("cache_config", gCacheConfig);
             ini.GetIntIfExist("cache_ruleset", gCacheRuleset);
+            ini.GetNumberIfExist("cache_memory_size", gCacheMemorySize);
+            ini.GetIntIfExist("cache_stale_while_revalidate", gCacheStaleWhileRevalidate);
             ini.GetBoolIfExist("serve_cache_on_fetch_fail", gServeCacheOnFetchFail);
         }
         else
         {
             gCacheSubscription = gCacheConfig = gCacheRuleset = 0; //disable cache
             gServeCacheOnFetchFail = false;
+            gCacheStaleWhileRevalidate = 0;
         }
     }
     ini.GetBoolIfExist("async_fetch_ruleset", gAsyncFetchRuleset);
@@ -1150,6 +1130,100 @@ void readConf()
 
     //std::cerr<<"Read preference settings completed."<<std::endl;
     writeLog(0, "Read preference settings completed.", LOG_LEVEL_INFO);
+    return 0;
+}
+
+static pref_config_ptr gPrefConfig = std::make_shared<const pref_config>();
+
+pref_config_ptr getPrefConfig()
+{
+    return std::atomic_load(&gPrefConfig);
+}
+
+/// the rules are compiled before publishing, so that requests only read the snapshot
+static void publishPrefConfig(const std::shared_ptr<pref_config> &conf)
+{
+    conf->transform = compileNodeTransform(conf->renames, conf->emojis);
+    conf->compiled_stream_rules = compileReplaceRules(conf->stream_rules);
+    conf->compiled_time_rules = compileReplaceRules(conf->time_rules);
+    set_redirect(conf->aliases);
+    set_serve_file_root(conf->serve_file_root);
+    std::atomic_store(&gPrefConfig, pref_config_ptr(conf));
+}
+
+/// all below are guarded by gMutexConfigure: every load gets a number, a load never replaces the snapshot of a later one
+static unsigned int gPrefLoads = 0, gPrefPublished = 0, gPrefFetching = 0;
+
+/// caller holds lock on gMutexConfigure, it is released while changed rulesets are fetched
+/// returns true if the rulesets were fetched along with the preference
+static bool loadPrefConfig(std::unique_lock<std::mutex> &lock)
+{
+    //std::cerr<<"Reading preference settings..."<<std::endl;
+    writeLog(0, "Reading preference settings...", LOG_LEVEL_INFO);
+
+    std::shared_ptr<pref_config> conf = std::make_shared<pref_config>();
+    if(readPrefFile(*conf) != 0)
+        return false;
+    //environment variables take precedence over the preference on every reload
+    std::string env_managed_prefix = GetEnv("MANAGED_PREFIX"), env_token = GetEnv("API_TOKEN");
+    if(env_managed_prefix.size())
+        conf->managed_config_prefix = env_managed_prefix;
+    if(env_token.size())
+        conf->access_token = env_token;
+    unsigned int load = ++gPrefLoads;
+    pref_config_ptr current = getPrefConfig();
+    bool fetch = conf->custom_rulesets != current->custom_rulesets && !gUpdateRulesetOnRequest;
+    if(!fetch)
+    {
+        //same rulesets, keep the ones fetched before, refreshPrefRulesets() fetches them again
+        if(conf->custom_rulesets == current->custom_rulesets)
+            conf->ruleset_contents = current->ruleset_contents;
+    }
+    else
+    {
+        //requests keep the old snapshot until the new rulesets are fetched
+        gPrefFetching++;
+        lock.unlock();
+        refreshRulesets(conf->custom_rulesets, conf->ruleset_contents, parseProxy(conf->proxy_ruleset));
+        lock.lock();
+        gPrefFetching--;
+        if(load < gPrefPublished)
+            return true;
+    }
+    gPrefPublished = load;
+    publishPrefConfig(conf);
+    return fetch;
+}
+
+bool readConf()
+{
+    //only writers take the lock, requests keep reading the old snapshot until the new one is published
+    std::unique_lock<std::mutex> lock(gMutexConfigure);
+    return loadPrefConfig(lock);
+}
+
+/// requests do not wait for each other: if a reload is already running, the current snapshot is used
+static void readConfOnRequest()
+{
+    std::unique_lock<std::mutex> lock(gMutexConfigure, std::try_to_lock);
+    if(lock.owns_lock() && !gPrefFetching)
+        loadPrefConfig(lock);
+}
+
+void refreshPrefRulesets()
+{
+    //fetch without the lock, so that reloads and other refreshes are not blocked by the network
+    pref_config_ptr current = getPrefConfig();
+    std::vector<ruleset_content> contents;
+    refreshRulesets(current->custom_rulesets, contents, parseProxy(current->proxy_ruleset));
+
+    guarded_mutex guard(gMutexConfigure);
+    pref_config_ptr latest = getPrefConfig();
+    if(latest->custom_rulesets != current->custom_rulesets) //a reload has published other rulesets meanwhile
+        return;
+    std::shared_ptr<pref_config> conf = std::make_shared<pref_config>(*latest);
+    conf->ruleset_contents = std::move(contents);
+    std::atomic_store(&gPrefConfig, pref_config_ptr(conf));
 }
 
 struct ExternalConfig
@@ -1175,7 +1249,7 @@ struct ExternalConfig
     tribool remove_old_emoji;
 };
 
-int loadExternalYAML(YAML::Node &node, ExternalConfig &ext)
+int loadExternalYAML(YAML::Node &node, ExternalConfig &ext, const std::string &proxy)
 {
     YAML::Node section = node["custom"], object;
     std::string name, type, url, interval;
@@ -1195,12 +1269,12 @@ int loadExternalYAML(YAML::Node &node, ExternalConfig &ext)
 
     const char *group_name = section["proxy_groups"].IsDefined() ? "proxy_groups" : "custom_proxy_group";
     if(section[group_name].size())
-        readGroup(section[group_name], ext.custom_proxy_group, gAPIMode);
+        readGroup(section[group_name], ext.custom_proxy_group, proxy, gAPIMode);
 
     const char *ruleset_name = section["rulesets"].IsDefined() ? "rulesets" : "surge_ruleset";
     if(section[ruleset_name].size())
     {
-        readRuleset(section[ruleset_name], ext.surge_ruleset, gAPIMode);
+        readRuleset(section[ruleset_name], ext.surge_ruleset, proxy, gAPIMode);
         if(gMaxAllowedRulesets && ext.surge_ruleset.size() > gMaxAllowedRulesets)
         {
             writeLog(0, "Ruleset count in external config has exceeded limit.", LOG_LEVEL_WARNING);
@@ -1210,13 +1284,13 @@ int loadExternalYAML(YAML::Node &node, ExternalConfig &ext)
     }
 
     if(section["rename_node"].size())
-        readRegexMatch(section["rename_node"], "@", ext.rename, gAPIMode);
+        readRegexMatch(section["rename_node"], "@", ext.rename, proxy, gAPIMode);
 
     ext.add_emoji = safe_as<std::string>(section["add_emoji"]);
     ext.remove_old_emoji = safe_as<std::string>(section["remove_old_emoji"]);
     const char *emoji_name = section["emojis"].IsDefined() ? "emojis" : "emoji";
     if(section[emoji_name].size())
-        readEmoji(section[emoji_name], ext.emoji, gAPIMode);
+        readEmoji(section[emoji_name], ext.emoji, proxy, gAPIMode);
 
     section["include_remarks"] >> ext.include;
     section["exclude_remarks"] >> ext.exclude;
@@ -1235,17 +1309,13 @@ int loadExternalYAML(YAML::Node &node, ExternalConfig &ext)
     return 0;
 }
 
-int loadExternalConfig(std::string &path, ExternalConfig &ext)
+int parseExternalConfig(const std::string &base_content, ExternalConfig &ext, const std::string &proxy)
 {
-    std::string base_content, proxy = parseProxy(gProxyConfig), config = fetchFile(path, proxy, gCacheConfig);
-    if(render_template(config, *ext.tpl_args, base_content, gTemplatePath) != 0)
-        base_content = config;
-
     try
     {
         YAML::Node yaml = YAML::Load(base_content);
         if(yaml.size() && yaml["custom"].IsDefined())
-            return loadExternalYAML(yaml, ext);
+            return loadExternalYAML(yaml, ext, proxy);
     }
     catch (YAML::Exception &e)
     {
@@ -1266,13 +1336,13 @@ int loadExternalConfig(std::string &path, ExternalConfig &ext)
     if(ini.ItemPrefixExist("custom_proxy_group"))
     {
         ini.GetAll("custom_proxy_group", ext.custom_proxy_group);
-        importItems(ext.custom_proxy_group, gAPIMode);
+        importItems(ext.custom_proxy_group, proxy, gAPIMode);
     }
     std::string ruleset_name = ini.ItemPrefixExist("ruleset") ? "ruleset" : "surge_ruleset";
     if(ini.ItemPrefixExist(ruleset_name))
     {
         ini.GetAll(ruleset_name, ext.surge_ruleset);
-        importItems(ext.surge_ruleset, gAPIMode);
+        importItems(ext.surge_ruleset, proxy, gAPIMode);
         if(gMaxAllowedRulesets && ext.surge_ruleset.size() > gMaxAllowedRulesets)
         {
             writeLog(0, "Ruleset count in external config has exceeded limit. ", LOG_LEVEL_WARNING);
@@ -1296,14 +1366,14 @@ int loadExternalConfig(std::string &path, ExternalConfig &ext)
     if(ini.ItemPrefixExist("rename"))
     {
         ini.GetAll("rename", ext.rename);
-        importItems(ext.rename, gAPIMode);
+        importItems(ext.rename, proxy, gAPIMode);
     }
     ext.add_emoji = ini.Get("add_emoji");
     ext.remove_old_emoji = ini.Get("remove_old_emoji");
     if(ini.ItemPrefixExist("emoji"))
     {
         ini.GetAll("emoji", ext.emoji);
-        importItems(ext.emoji, gAPIMode);
+        importItems(ext.emoji, proxy, gAPIMode);
     }
     if(ini.ItemPrefixExist("include_remarks"))
         ini.GetAll("include_remarks", ext.include);
@@ -1322,9 +1392,112 @@ int loadExternalConfig(std::string &path, ExternalConfig &ext)
     return 0;
 }
 
-void checkExternalBase(const std::string &path, std::string &dest)
+#define EXTERNAL_CONFIG_CACHE_SIZE 32
+
+/// a fully processed external config, shared by all requests whose config renders to the same content
+struct cached_external_config
+{
+    std::string content;
+    ExternalConfig config;
+    string_map template_vars;
+    time_t expire = 0;
+    /// rulesets of config.surge_ruleset, fetched by the first request that needs them
+    std::string ruleset_proxy;
+    mutable std::once_flag rulesets_once;
+    mutable std::vector<ruleset_content> rulesets;
+
+    const std::vector<ruleset_content> &getRulesets() const
+    {
+        std::call_once(rulesets_once, [this](){ refreshRulesets(config.surge_ruleset, rulesets, ruleset_proxy); });
+        return rulesets;
+    }
+};
+
+typedef std::shared_ptr<const cached_external_config> external_config_ptr;
+typedef std::list<std::string> external_config_lru_list;
+
+static std::mutex external_config_cache_lock;
+static external_config_lru_list external_config_cache_order;
+static std::unordered_map<std::string, std::pair<external_config_ptr, external_config_lru_list::iterator>> external_config_cache;
+
+void flushExternalConfigCache()
+{
+    guarded_mutex guard(external_config_cache_lock);
+    external_config_cache.clear();
+    external_config_cache_order.clear();
+}
+
+/// The config is fetched and rendered on every call, so a changed fetch cache entry or different template args
+/// give a different key. Parsing, imports and ruleset fetching are only done once per rendered content.
+/// Imported files and rulesets are neither part of the key nor validated on a hit: changes to them, local files
+/// included, only show up once the entry expires after min(cache_config, cache_ruleset) or /flushcache is called.
+external_config_ptr loadExternalConfig(const std::string &path, template_args &tpl_args, const pref_config &conf)
 {
-    if(isLink(path) || (startsWith(path, gBasePath) && fileExist(path)))
+    std::string base_content, proxy = parseProxy(conf.proxy_config), config = fetchFile(path, proxy, gCacheConfig);
+    if(render_template(config, tpl_args, base_content, conf.template_path) != 0)
+        base_content = config;
+
+    std::string key = path + "\n" + std::to_string(hash_(base_content)) + (gAPIMode ? "\n1" : "\n0");
+    external_config_ptr result;
+    {
+        guarded_mutex guard(external_config_cache_lock);
+        auto iter = external_config_cache.find(key);
+        if(iter != external_config_cache.end())
+        {
+            if(iter->second.first->expire > time(NULL) && iter->second.first->content == base_content)
+            {
+                external_config_cache_order.splice(external_config_cache_order.begin(), external_config_cache_order, iter->second.second);
+                result = iter->second.first;
+            }
+            else
+            {
+                external_config_cache_order.erase(iter->second.second);
+                external_config_cache.erase(iter);
+            }
+        }
+    }
+
+    if(!result)
+    {
+        std::shared_ptr<cached_external_config> entry = std::make_shared<cached_external_config>();
+        template_args declared;
+        entry->config.tpl_args = &declared;
+        if(parseExternalConfig(base_content, entry->config, proxy) != 0)
+            return NULL;
+        entry->ruleset_proxy = parseProxy(conf.proxy_ruleset);
+        entry->config.tpl_args = NULL;
+        entry->template_vars.swap(declared.local_vars);
+        entry->content.swap(base_content);
+        //imported files and rulesets are not part of the key, so entries live no longer than their fetch cache
+        //remote ones may thus be served up to twice that long after they changed upstream, as the fetch cache entry
+        //the config was built from can already be close to its own expiry
+        int ttl = std::min(gCacheConfig, gCacheRuleset);
+        entry->expire = time(NULL) + ttl;
+        result = entry;
+        if(ttl > 0)
+        {
+            guarded_mutex guard(external_config_cache_lock);
+            if(external_config_cache.find(key) == external_config_cache.end())
+            {
+                if(external_config_cache.size() >= EXTERNAL_CONFIG_CACHE_SIZE)
+                {
+                    external_config_cache.erase(external_config_cache_order.back());
+                    external_config_cache_order.pop_back();
+                }
+                external_config_cache_order.push_front(key);
+                external_config_cache.emplace(std::move(key), std::make_pair(result, external_config_cache_order.begin()));
+            }
+        }
+    }
+
+    for(auto &x : result->template_vars)
+        tpl_args.local_vars[x.first] = x.second;
+    return result;
+}
+
+void checkExternalBase(const std::string &path, std::string &dest, const std::string &base_path)
+{
+    if(isLink(path) || (startsWith(path, base_path) && fileExist(path)))
         dest = path;
 }
 
@@ -1354,7 +1527,8 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
     }
     //check if we need to read configuration
     if((!gAPIMode || gCFWChildProcess) && !gGeneratorMode)
-        readConf();
+        readConfOnRequest();
+    pref_config_ptr conf = getPrefConfig();
 
     /// string values
     std::string argUrl = UrlDecode(getUrlArg(argument, "url"));
@@ -1373,25 +1547,28 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
     tribool argPrependInsert = getUrlArg(argument, "prepend"), argGenClassicalRuleProvider = getUrlArg(argument, "classic"), argTLS13 = getUrlArg(argument, "tls13");
 
     std::string base_content, output_content;
-    string_array lCustomProxyGroups = gCustomProxyGroups, lCustomRulesets = gCustomRulesets, lIncludeRemarks = gIncludeRemarks, lExcludeRemarks = gExcludeRemarks;
+    /// only filled when overridden by the request or the external config, the preference snapshot is used otherwise
+    string_array lCustomProxyGroups, lCustomRulesets, lIncludeRemarks, lExcludeRemarks;
     std::vector<ruleset_content> lRulesetContent;
+    const std::vector<ruleset_content> *cachedRulesets = NULL;
+    external_config_ptr lExternalConfig;
     extra_settings ext;
     std::string subInfo, dummy;
     int interval = argUpdateInterval.size() ? to_int(argUpdateInterval, gUpdateInterval) : gUpdateInterval;
-    bool authorized = !gAPIMode || getUrlArg(argument, "token") == gAccessToken, strict = argUpdateStrict.size() ? argUpdateStrict == "true" : gUpdateStrict;
+    bool authorized = !gAPIMode || getUrlArg(argument, "token") == conf->access_token, strict = argUpdateStrict.size() ? argUpdateStrict == "true" : gUpdateStrict;
 
     if(std::find(gRegexBlacklist.cbegin(), gRegexBlacklist.cend(), argIncludeRemark) != gRegexBlacklist.cend() || std::find(gRegexBlacklist.cbegin(), gRegexBlacklist.cend(), argExcludeRemark) != gRegexBlacklist.cend())
         return "Invalid request!";
 
     /// for external configuration
-    std::string lClashBase = gClashBase, lSurgeBase = gSurgeBase, lMellowBase = gMellowBase, lSurfboardBase = gSurfboardBase;
-    std::string lQuanBase = gQuanBase, lQuanXBase = gQuanXBase, lLoonBase = gLoonBase, lSSSubBase = gSSSubBase;
+    std::string lClashBase = conf->clash_base, lSurgeBase = conf->surge_base, lMellowBase = conf->mellow_base, lSurfboardBase = conf->surfboard_base;
+    std::string lQuanBase = conf->quan_base, lQuanXBase = conf->quanx_base, lLoonBase = conf->loon_base, lSSSubBase = conf->sssub_base;
 
     /// validate urls
-    argEnableInsert.define(gEnableInsert);
+    argEnableInsert.define(conf->enable_insert);
     if(!argUrl.size() && (!gAPIMode || authorized))
-        argUrl = gDefaultUrls;
-    if((!argUrl.size() && !(gInsertUrls.size() && argEnableInsert)) || !argTarget.size())
+        argUrl = conf->default_urls;
+    if((!argUrl.size() && !(conf->insert_urls.size() && argEnableInsert)) || !argTarget.size())
     {
         *status_code = 400;
         return "Invalid request!";
@@ -1415,29 +1592,33 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
 
     /// save template variables
     template_args tpl_args;
-    tpl_args.global_vars = gTemplateVars;
+    tpl_args.global_vars = conf->template_vars;
     tpl_args.request_params = req_arg_map;
 
     /// check for proxy settings
-    std::string proxy = parseProxy(gProxySubscription);
+    std::string proxy = parseProxy(conf->proxy_subscription);
 
     /// check other flags
     ext.append_proxy_type = argAppendType.get(gAppendType);
     if((argTarget == "clash" || argTarget == "clashr") && argGenClashScript.is_undef())
         argExpandRulesets.define(true);
 
-    ext.clash_proxies_style = gClashProxiesStyle;
+    ext.clash_proxies_style = conf->clash_proxies_style;
 
     /// read preference from argument, assign global var if not in argument
-    ext.tfo.parse(argTFO).parse(gTFO);
-    ext.udp.parse(argUDP).parse(gUDP);
-    ext.skip_cert_verify.parse(argSkipCertVerify).parse(gSkipCertVerify);
-    ext.tls13.parse(argTLS13).parse(gTLS13);
+    ext.tfo.parse(argTFO).parse(conf->tfo);
+    ext.udp.parse(argUDP).parse(conf->udp);
+    ext.skip_cert_verify.parse(argSkipCertVerify).parse(conf->skip_cert_verify);
+    ext.tls13.parse(argTLS13).parse(conf->tls13);
 
     ext.sort_flag = argSort.get(gEnableSort);
-    argUseSortScript.define(gSortScript.size() != 0);
+    argUseSortScript.define(conf->sort_script.size() != 0);
     if(ext.sort_flag && argUseSortScript)
-        ext.sort_script = gSortScript;
+    {
+        ext.sort_script = conf->sort_script;
+        if(startsWith(ext.sort_script, "path:"))
+            ext.sort_script = fileGet(ext.sort_script.substr(5), false);
+    }
     ext.filter_deprecated = argFilterDeprecated.get(gFilterDeprecated);
     ext.clash_new_field_name = argClashNewField.get(gClashUseNewField);
     ext.clash_script = argGenClashScript.get();
@@ -1448,36 +1629,36 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         ext.clash_script = false;
 
     ext.nodelist = argGenNodeList;
-    ext.surge_ssr_path = gSurgeSSRPath;
-    ext.quanx_dev_id = argDeviceID.size() ? argDeviceID : gQuanXDevID;
+    ext.surge_ssr_path = conf->surge_ssr_path;
+    ext.quanx_dev_id = argDeviceID.size() ? argDeviceID : conf->quanx_dev_id;
     ext.enable_rule_generator = gEnableRuleGen;
     ext.overwrite_original_rules = gOverwriteOriginalRules;
     if(!argExpandRulesets)
-        ext.managed_config_prefix = gManagedConfigPrefix;
+        ext.managed_config_prefix = conf->managed_config_prefix;
 
     //load external configuration
     if(argExternalConfig.empty())
-        argExternalConfig = gDefaultExtConfig;
+        argExternalConfig = conf->default_ext_config;
     if(argExternalConfig.size())
     {
         //std::cerr<<"External configuration file provided. Loading...\n";
         writeLog(0, "External configuration file provided. Loading...", LOG_LEVEL_INFO);
-        ExternalConfig extconf;
-        extconf.tpl_args = &tpl_args;
-        if(loadExternalConfig(argExternalConfig, extconf) == 0)
+        lExternalConfig = loadExternalConfig(argExternalConfig, tpl_args, *conf);
+        if(lExternalConfig)
         {
+            const ExternalConfig &extconf = lExternalConfig->config;
             if(!ext.nodelist)
             {
-                checkExternalBase(extconf.sssub_rule_base, lSSSubBase);
+                checkExternalBase(extconf.sssub_rule_base, lSSSubBase, conf->base_path);
                 if(!lSimpleSubscription)
                 {
-                    checkExternalBase(extconf.clash_rule_base, lClashBase);
-                    checkExternalBase(extconf.surge_rule_base, lSurgeBase);
-                    checkExternalBase(extconf.surfboard_rule_base, lSurfboardBase);
-                    checkExternalBase(extconf.mellow_rule_base, lMellowBase);
-                    checkExternalBase(extconf.quan_rule_base, lQuanBase);
-                    checkExternalBase(extconf.quanx_rule_base, lQuanXBase);
-                    checkExternalBase(extconf.loon_rule_base, lLoonBase);
+                    checkExternalBase(extconf.clash_rule_base, lClashBase, conf->base_path);
+                    checkExternalBase(extconf.surge_rule_base, lSurgeBase, conf->base_path);
+                    checkExternalBase(extconf.surfboard_rule_base, lSurfboardBase, conf->base_path);
+                    checkExternalBase(extconf.mellow_rule_base, lMellowBase, conf->base_path);
+                    checkExternalBase(extconf.quan_rule_base, lQuanBase, conf->base_path);
+                    checkExternalBase(extconf.quanx_rule_base, lQuanXBase, conf->base_path);
+                    checkExternalBase(extconf.loon_rule_base, lLoonBase, conf->base_path);
 
                     if(extconf.surge_ruleset.size())
                         lCustomRulesets = extconf.surge_ruleset;
@@ -1515,14 +1696,14 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
     }
     if(ext.enable_rule_generator && !ext.nodelist && !lSimpleSubscription)
     {
-        if(lCustomRulesets != gCustomRulesets)
-            refreshRulesets(lCustomRulesets, lRulesetContent);
+        if(gUpdateRulesetOnRequest)
+            refreshRulesets(lCustomRulesets.size() ? lCustomRulesets : conf->custom_rulesets, lRulesetContent, parseProxy(conf->proxy_ruleset));
+        else if(lCustomRulesets.empty() || lCustomRulesets == conf->custom_rulesets)
+            cachedRulesets = &conf->ruleset_contents;
+        else if(lExternalConfig) /// rulesets from the external config
+            cachedRulesets = &lExternalConfig->getRulesets();
         else
-        {
-            if(gUpdateRulesetOnRequest)
-                refreshRulesets(gCustomRulesets, gRulesetContent);
-            lRulesetContent = gRulesetContent;
-        }
+            refreshRulesets(lCustomRulesets, lRulesetContent, parseProxy(conf->proxy_ruleset));
     }
 
     if(!argEmoji.is_undef())
@@ -1532,12 +1713,18 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
     }
     ext.add_emoji = argAddEmoji.get(gAddEmoji);
     ext.remove_emoji = argRemoveEmoji.get(gRemoveEmoji);
-    if(ext.add_emoji && ext.emoji_array.empty())
-        ext.emoji_array = safe_get_emojis();
     if(argRenames.size())
         ext.rename_array = split(argRenames, "`");
-    else if(ext.rename_array.empty())
-        ext.rename_array = safe_get_renames();
+    if(ext.rename_array.empty() && (!ext.add_emoji || ext.emoji_array.empty()))
+        ext.transform = conf->transform; /// rules from the preference, already compiled
+    else
+    {
+        if(ext.add_emoji && ext.emoji_array.empty())
+            ext.emoji_array = conf->emojis;
+        if(ext.rename_array.empty())
+            ext.rename_array = conf->renames;
+        ext.transform = compileNodeTransform(ext.rename_array, ext.emoji_array);
+    }
 
     //check custom include/exclude settings
     if(argIncludeRemark.size() && regValid(argIncludeRemark))
@@ -1546,43 +1733,55 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         lExcludeRemarks = string_array{argExcludeRemark};
 
     //start parsing urls
-    string_array stream_temp = safe_get_streams(), time_temp = safe_get_times();
+    const replace_rules &stream_rules = conf->compiled_stream_rules, &time_rules = conf->compiled_time_rules;
+    NodeFilter filter(lExcludeRemarks.size() ? lExcludeRemarks : conf->exclude_remarks, lIncludeRemarks.size() ? lIncludeRemarks : conf->include_remarks);
 
     //loading urls
-    string_array urls;
+    string_array urls, insert_urls, all_urls;
     std::vector<nodeInfo> nodes, insert_nodes;
+    subscription_map prefetched;
     int groupID = 0;
-    if(gInsertUrls.size() && argEnableInsert)
+    if(conf->insert_urls.size() && argEnableInsert)
     {
-        groupID = -1;
-        urls = split(gInsertUrls, "|");
-        importItems(urls, true);
-        for(std::string &x : urls)
-        {
+        insert_urls = split(conf->insert_urls, "|");
+        importItems(insert_urls, parseProxy(conf->proxy_config), true);
+        for(std::string &x : insert_urls)
             x = regTrim(x);
-            writeLog(0, "Fetching node data from url '" + x + "'.", LOG_LEVEL_INFO);
-            if(addNodes(x, insert_nodes, groupID, proxy, lExcludeRemarks, lIncludeRemarks, stream_temp, time_temp, subInfo, authorized, request.headers) == -1)
+    }
+    urls = split(argUrl, "|");
+    importItems(urls, parseProxy(conf->proxy_config), true);
+    for(std::string &x : urls)
+        x = regTrim(x);
+
+    //download all subscriptions at once, nodes are still added in the original order below
+    all_urls = insert_urls;
+    std::copy(urls.begin(), urls.end(), std::back_inserter(all_urls));
+    prefetchSubscriptions(all_urls, proxy, authorized, request.headers, prefetched);
+    std::copy(all_urls.begin(), all_urls.begin() + insert_urls.size(), insert_urls.begin());
+    std::copy(all_urls.begin() + insert_urls.size(), all_urls.end(), urls.begin());
+
+    groupID = -1;
+    for(std::string &x : insert_urls)
+    {
+        writeLog(0, "Fetching node data from url '" + x + "'.", LOG_LEVEL_INFO);
+        if(addNodes(x, insert_nodes, groupID, proxy, filter, stream_rules, time_rules, subInfo, authorized, request.headers, &prefetched) == -1)
+        {
+            if(gSkipFailedLinks)
+                writeLog(0, "The following link doesn't contain any valid node info: " + x, LOG_LEVEL_WARNING);
+            else
             {
-                if(gSkipFailedLinks)
-                    writeLog(0, "The following link doesn't contain any valid node info: " + x, LOG_LEVEL_WARNING);
-                else
-                {
-                    *status_code = 400;
-                    return "The following link doesn't contain any valid node info: " + x;
-                }
+                *status_code = 400;
+                return "The following link doesn't contain any valid node info: " + x;
             }
-            groupID--;
         }
+        groupID--;
     }
-    urls = split(argUrl, "|");
-    importItems(urls, true);
     groupID = 0;
     for(std::string &x : urls)
     {
-        x = regTrim(x);
         //std::cerr<<"Fetching node data from url '"<<x<<"'."<<std::endl;
         writeLog(0, "Fetching node data from url '" + x + "'.", LOG_LEVEL_INFO);
-        if(addNodes(x, nodes, groupID, proxy, lExcludeRemarks, lIncludeRemarks, stream_temp, time_temp, subInfo, authorized, request.headers) == -1)
+        if(addNodes(x, nodes, groupID, proxy, filter, stream_rules, time_rules, subInfo, authorized, request.headers, &prefetched) == -1)
         {
             if(gSkipFailedLinks)
                 writeLog(0, "The following link doesn't contain any valid node info: " + x, LOG_LEVEL_WARNING);
@@ -1610,28 +1809,55 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
     {
         std::move(insert_nodes.begin(), insert_nodes.end(), std::back_inserter(nodes));
     }
-    //run filter script
-    std::string filterScript = gFilterScript;
+    //run filter script, the node objects built for filterAll are reused by renameAll and getEmojiAll
+    DuktapeNodeList node_objects;
+    std::string filterScript = conf->filter_script;
     if(authorized && !argFilterScript.empty())
         filterScript = argFilterScript;
     if(filterScript.size())
     {
         if(startsWith(filterScript, "path:"))
             filterScript = fileGet(filterScript.substr(5), false);
-        duk_context *ctx = duktape_init();
+        duk_context *ctx = duktape_acquire();
         if(ctx)
         {
-            defer(duk_destroy_heap(ctx);)
+            defer(duktape_release(ctx);)
             if(duktape_peval(ctx, filterScript) == 0)
             {
-                auto filter = [&](const nodeInfo &x)
+                duk_pop(ctx); /// pop eval result
+                if(duktape_has_function(ctx, "filterAll"))
+                {
+                    //batch contract: one call with all nodes, the returned array tells which ones to keep
+                    std::vector<char> keep(nodes.size(), 1);
+                    duk_get_global_string(ctx, "filterAll");
+                    node_objects.push(ctx, nodes);
+                    int ret = duk_pcall(ctx, 1);
+                    duktape_unbind_nodes();
+                    if(ret == 0)
+                        duktape_get_res_bool_list(ctx, keep);
+                    else
+                    {
+                        writeLog(0, "Error when trying to evaluate script:\n" + duktape_get_err_stack(ctx), LOG_LEVEL_ERROR);
+                        duk_pop(ctx); /// pop err
+                    }
+                    node_objects.remove(keep);
+                    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [&](const nodeInfo &x)
+                    {
+                        return !keep[&x - nodes.data()];
+                    }), nodes.end());
+                }
+                else
                 {
-                    duk_get_global_string(ctx, "filter");
-                    duktape_push_nodeinfo(ctx, x);
-                    duk_pcall(ctx, 1);
-                    return !duktape_get_res_bool(ctx);
-                };
-                nodes.erase(std::remove_if(nodes.begin(), nodes.end(), filter), nodes.end());
+                    auto filter = [&](const nodeInfo &x)
+                    {
+                        duk_get_global_string(ctx, "filter");
+                        duktape_push_nodeinfo(ctx, x);
+                        duk_pcall(ctx, 1);
+                        duktape_unbind_nodes();
+                        return !duktape_get_res_bool(ctx);
+                    };
+                    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), filter), nodes.end());
+                }
             }
             else
             {
@@ -1650,16 +1876,18 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         response.headers.emplace("Subscription-UserInfo", subInfo);
 
     //do pre-process now
-    preprocessNodes(nodes, ext);
+    preprocessNodes(nodes, ext, &node_objects);
 
     string_array dummy_group;
     std::vector<ruleset_content> dummy_ruleset;
+    const std::vector<ruleset_content> &rulesetContent = cachedRulesets ? *cachedRulesets : lRulesetContent;
+    const string_array &customProxyGroups = lCustomProxyGroups.size() ? lCustomProxyGroups : conf->custom_proxy_groups;
     std::string managed_url = base64_decode(UrlDecode(getUrlArg(argument, "profile_data")));
     if(managed_url.empty())
-        managed_url = gManagedConfigPrefix + "/sub?" + argument;
+        managed_url = conf->managed_config_prefix + "/sub?" + argument;
 
     //std::cerr<<"Generate target: ";
-    proxy = parseProxy(gProxyConfig);
+    proxy = parseProxy(conf->proxy_config);
     switch(hash_(argTarget))
     {
     case "clash"_hash: case "clashr"_hash:
@@ -1674,12 +1902,12 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         }
         else
         {
-            if(render_template(fetchFile(lClashBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+            if(render_template(fetchFile(lClashBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
             {
                 *status_code = 400;
                 return base_content;
             }
-            output_content = netchToClash(nodes, base_content, lRulesetContent, lCustomProxyGroups, argTarget == "clashr", ext);
+            output_content = netchToClash(nodes, base_content, rulesetContent, customProxyGroups, argTarget == "clashr", ext);
         }
 
         if(argUpload)
@@ -1698,17 +1926,17 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         }
         else
         {
-            if(render_template(fetchFile(lSurgeBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+            if(render_template(fetchFile(lSurgeBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
             {
                 *status_code = 400;
                 return base_content;
             }
-            output_content = netchToSurge(nodes, base_content, lRulesetContent, lCustomProxyGroups, intSurgeVer, ext);
+            output_content = netchToSurge(nodes, base_content, rulesetContent, customProxyGroups, intSurgeVer, ext);
 
             if(argUpload)
                 uploadGist("surge" + argSurgeVer, argUploadPath, output_content, true);
 
-            if(gWriteManagedConfig && gManagedConfigPrefix.size())
+            if(gWriteManagedConfig && conf->managed_config_prefix.size())
                 output_content = "#!MANAGED-CONFIG " + managed_url + (interval ? " interval=" + std::to_string(interval) : "") \
                  + " strict=" + std::string(strict ? "true" : "false") + "\n\n" + output_content;
         }
@@ -1716,28 +1944,28 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
     case "surfboard"_hash:
         writeLog(0, "Generate target: Surfboard", LOG_LEVEL_INFO);
 
-        if(render_template(fetchFile(lSurfboardBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+        if(render_template(fetchFile(lSurfboardBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
         {
             *status_code = 400;
             return base_content;
         }
-        output_content = netchToSurge(nodes, base_content, lRulesetContent, lCustomProxyGroups, -3, ext);
+        output_content = netchToSurge(nodes, base_content, rulesetContent, customProxyGroups, -3, ext);
         if(argUpload)
             uploadGist("surfboard", argUploadPath, output_content, true);
 
-        if(gWriteManagedConfig && gManagedConfigPrefix.size())
+        if(gWriteManagedConfig && conf->managed_config_prefix.size())
             output_content = "#!MANAGED-CONFIG " + managed_url + (interval ? " interval=" + std::to_string(interval) : "") \
                  + " strict=" + std::string(strict ? "true" : "false") + "\n\n" + output_content;
         break;
     case "mellow"_hash:
         writeLog(0, "Generate target: Mellow", LOG_LEVEL_INFO);
 
-        if(render_template(fetchFile(lMellowBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+        if(render_template(fetchFile(lMellowBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
         {
             *status_code = 400;
             return base_content;
         }
-        output_content = netchToMellow(nodes, base_content, lRulesetContent, lCustomProxyGroups, ext);
+        output_content = netchToMellow(nodes, base_content, rulesetContent, customProxyGroups, ext);
 
         if(argUpload)
             uploadGist("mellow", argUploadPath, output_content, true);
@@ -1745,7 +1973,7 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
     case "sssub"_hash:
         writeLog(0, "Generate target: SS Subscription", LOG_LEVEL_INFO);
 
-        if(render_template(fetchFile(lSSSubBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+        if(render_template(fetchFile(lSSSubBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
         {
             *status_code = 400;
             return base_content;
@@ -1788,14 +2016,14 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         writeLog(0, "Generate target: Quantumult", LOG_LEVEL_INFO);
         if(!ext.nodelist)
         {
-            if(render_template(fetchFile(lQuanBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+            if(render_template(fetchFile(lQuanBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
             {
                 *status_code = 400;
                 return base_content;
             }
         }
 
-        output_content = netchToQuan(nodes, base_content, lRulesetContent, lCustomProxyGroups, ext);
+        output_content = netchToQuan(nodes, base_content, rulesetContent, customProxyGroups, ext);
 
         if(argUpload)
             uploadGist("quan", argUploadPath, output_content, false);
@@ -1804,14 +2032,14 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         writeLog(0, "Generate target: Quantumult X", LOG_LEVEL_INFO);
         if(!ext.nodelist)
         {
-            if(render_template(fetchFile(lQuanXBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+            if(render_template(fetchFile(lQuanXBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
             {
                 *status_code = 400;
                 return base_content;
             }
         }
 
-        output_content = netchToQuanX(nodes, base_content, lRulesetContent, lCustomProxyGroups, ext);
+        output_content = netchToQuanX(nodes, base_content, rulesetContent, customProxyGroups, ext);
 
         if(argUpload)
             uploadGist("quanx", argUploadPath, output_content, false);
@@ -1820,14 +2048,14 @@ std::string subconverter(RESPONSE_CALLBACK_ARGS)
         writeLog(0, "Generate target: Loon", LOG_LEVEL_INFO);
         if(!ext.nodelist)
         {
-            if(render_template(fetchFile(lLoonBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+            if(render_template(fetchFile(lLoonBase, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
             {
                 *status_code = 400;
                 return base_content;
             }
         }
 
-        output_content = netchToLoon(nodes, base_content, lRulesetContent, lCustomProxyGroups, ext);
+        output_content = netchToLoon(nodes, base_content, rulesetContent, customProxyGroups, ext);
 
         if(argUpload)
             uploadGist("loon", argUploadPath, output_content, false);
@@ -1874,6 +2102,7 @@ std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS)
     std::string &argument = request.argument;
     int *status_code = &response.status_code;
 
+    pref_config_ptr conf = getPrefConfig();
     INIReader ini;
     string_array dummy_str_array;
     std::vector<nodeInfo> nodes;
@@ -1883,7 +2112,7 @@ std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS)
     ini.store_any_line = true;
 
     if(!url.size())
-        url = gDefaultUrls;
+        url = conf->default_urls;
     if(!url.size() || argument.substr(0, 5) != "link=")
     {
         *status_code = 400;
@@ -1896,15 +2125,15 @@ std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS)
     }
     writeLog(0, "SurgeConfToClash called with url '" + url + "'.", LOG_LEVEL_INFO);
 
-    std::string proxy = parseProxy(gProxyConfig);
+    std::string proxy = parseProxy(conf->proxy_config);
     YAML::Node clash;
     template_args tpl_args;
-    tpl_args.global_vars = gTemplateVars;
+    tpl_args.global_vars = conf->template_vars;
     tpl_args.local_vars["clash.new_field_name"] = gClashUseNewField ? "true" : "false";
     tpl_args.request_params["target"] = "clash";
     tpl_args.request_params["url"] = url;
 
-    if(render_template(fetchFile(gClashBase, proxy, gCacheConfig), tpl_args, base_content, gTemplatePath) != 0)
+    if(render_template(fetchFile(conf->clash_base, proxy, gCacheConfig), tpl_args, base_content, conf->template_path) != 0)
     {
         *status_code = 400;
         return base_content;
@@ -1964,15 +2193,17 @@ std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS)
         clash[proxygroup_name].push_back(singlegroup);
     }
 
-    proxy = parseProxy(gProxySubscription);
+    proxy = parseProxy(conf->proxy_subscription);
     eraseElements(dummy_str_array);
 
     std::string subInfo;
+    subscription_map prefetched;
+    prefetchSubscriptions(links, proxy, !gAPIMode, request.headers, prefetched);
     for(std::string &x : links)
     {
         //std::cerr<<"Fetching node data from url '"<<x<<"'."<<std::endl;
         writeLog(0, "Fetching node data from url '" + x + "'.", LOG_LEVEL_INFO);
-        if(addNodes(x, nodes, 0, proxy, dummy_str_array, dummy_str_array, dummy_str_array, dummy_str_array, subInfo, !gAPIMode, request.headers) == -1)
+        if(addNodes(x, nodes, 0, proxy, NodeFilter(), replace_rules(), replace_rules(), subInfo, !gAPIMode, request.headers, &prefetched) == -1)
         {
             if(gSkipFailedLinks)
                 writeLog(0, "The following link doesn't contain any valid node info: " + x, LOG_LEVEL_WARNING);
@@ -1991,8 +2222,8 @@ std::string surgeConfToClash(RESPONSE_CALLBACK_ARGS)
         return "No nodes were found!";
     }
 
-    extra_settings ext = {true, true, dummy_str_array, dummy_str_array, false, false, false, false, gEnableSort, gFilterDeprecated, gClashUseNewField, false, "", "", "", gUDP, gTFO, gSkipCertVerify, gTLS13};
-    ext.clash_proxies_style = gClashProxiesStyle;
+    extra_settings ext = {true, true, dummy_str_array, dummy_str_array, false, false, false, false, gEnableSort, gFilterDeprecated, gClashUseNewField, false, "", "", "", conf->udp, conf->tfo, conf->skip_cert_verify, conf->tls13};
+    ext.clash_proxies_style = conf->clash_proxies_style;
 
     netchToClash(nodes, clash, dummy_str_array, false, ext);
 
@@ -2080,6 +2311,7 @@ std::string getProfile(RESPONSE_CALLBACK_ARGS)
     std::string &argument = request.argument;
     int *status_code = &response.status_code;
 
+    pref_config_ptr conf = getPrefConfig();
     std::string name = UrlDecode(getUrlArg(argument, "name")), token = UrlDecode(getUrlArg(argument, "token"));
     string_array profiles = split(name, "|");
     name = profiles[0];
@@ -2122,11 +2354,11 @@ std::string getProfile(RESPONSE_CALLBACK_ARGS)
             *status_code = 403;
             return "Forbidden";
         }
-        token = gAccessToken;
+        token = conf->access_token;
     }
     else
     {
-        if(token != gAccessToken)
+        if(token != conf->access_token)
         {
             *status_code = 403;
             return "Forbidden";
@@ -2168,7 +2400,7 @@ std::string getProfile(RESPONSE_CALLBACK_ARGS)
     }
 
     contents.emplace("token", token);
-    contents.emplace("profile_data", base64_encode(gManagedConfigPrefix + "/getprofile?" + argument));
+    contents.emplace("profile_data", base64_encode(conf->managed_config_prefix + "/getprofile?" + argument));
     std::string query = std::accumulate(contents.begin(), contents.end(), std::string(), [](const std::string &x, auto y){ return x + y.first + "=" + UrlEncode(y.second) + "&"; });
     query += argument;
     request.argument = query;
@@ -2182,12 +2414,13 @@ std::string getScript(RESPONSE_CALLBACK_ARGS)
     std::string url = urlsafe_base64_decode(getUrlArg(argument, "url")), dev_id = getUrlArg(argument, "id");
     std::string output_content;
 
-    std::string proxy = parseProxy(gProxyConfig);
+    pref_config_ptr conf = getPrefConfig();
+    std::string proxy = parseProxy(conf->proxy_config);
 
     output_content = fetchFile(url, proxy, gCacheConfig);
 
     if(!dev_id.size())
-        dev_id = gQuanXDevID;
+        dev_id = conf->quanx_dev_id;
 
     const std::string pattern = "(\\/\\*[\\s\\S]*?)^(.*?@supported )(.*?\\s?)$([\\s\\S]*\\*\\/\\s?";
     if(dev_id.size())
@@ -2207,12 +2440,13 @@ std::string getRewriteRemote(RESPONSE_CALLBACK_ARGS)
     std::string url = urlsafe_base64_decode(getUrlArg(argument, "url")), dev_id = getUrlArg(argument, "id");
     std::string output_content;
 
-    std::string proxy = parseProxy(gProxyConfig);
+    pref_config_ptr conf = getPrefConfig();
+    std::string proxy = parseProxy(conf->proxy_config);
 
     output_content = fetchFile(url, proxy, gCacheConfig);
 
     if(!dev_id.size())
-        dev_id = gQuanXDevID;
+        dev_id = conf->quanx_dev_id;
 
     if(dev_id.size())
     {
@@ -2232,7 +2466,7 @@ std::string getRewriteRemote(RESPONSE_CALLBACK_ARGS)
 
             if(!strLine.empty() && regMatch(strLine, pattern))
             {
-                url = gManagedConfigPrefix + "/qx-script?id=" + dev_id + "&url=" + urlsafe_base64_encode(regReplace(strLine, pattern, "$2"));
+                url = conf->managed_config_prefix + "/qx-script?id=" + dev_id + "&url=" + urlsafe_base64_encode(regReplace(strLine, pattern, "$2"));
                 strLine = regReplace(strLine, pattern, "$1") + url;
             }
             output_content.append(strLine + "\n");
@@ -2249,7 +2483,7 @@ std::string parseHostname(inja::Arguments &args)
     if(!urls.size())
         return std::string();
 
-    std::string input_content, output_content, proxy = parseProxy(gProxyConfig);
+    std::string input_content, output_content, proxy = parseProxy(getPrefConfig()->proxy_config);
     for(std::string &x : urls)
     {
         input_content = webGet(x, proxy, gCacheConfig);
@@ -2273,14 +2507,14 @@ std::string parseHostname(inja::Arguments &args)
 
 std::string template_webGet(inja::Arguments &args)
 {
-    std::string data = args.at(0)->get<std::string>(), proxy = parseProxy(gProxyConfig);
+    std::string data = args.at(0)->get<std::string>(), proxy = parseProxy(getPrefConfig()->proxy_config);
     writeLog(0, "Template called fetch with url '" + data + "'.", LOG_LEVEL_INFO);
     return webGet(data, proxy, gCacheConfig);
 }
 
 std::string jinja2_webGet(const std::string &url)
 {
-    std::string proxy = parseProxy(gProxyConfig);
+    std::string proxy = parseProxy(getPrefConfig()->proxy_config);
     writeLog(0, "Template called fetch with url '" + url + "'.", LOG_LEVEL_INFO);
     return webGet(url, proxy, gCacheConfig);
 }
@@ -2375,7 +2609,8 @@ int simpleGenerator()
         writeLog(0, "Generating all artifacts...", LOG_LEVEL_INFO);
 
     string_multimap allItems;
-    std::string proxy = parseProxy(gProxySubscription);
+    pref_config_ptr conf = getPrefConfig();
+    std::string proxy = parseProxy(conf->proxy_subscription);
     Request request;
     Response response;
     for(std::string &x : sections)
@@ -2396,7 +2631,7 @@ int simpleGenerator()
         if(ini.ItemExist("profile"))
         {
             profile = ini.Get("profile");
-            request.argument = "name=" + UrlEncode(profile) + "&token=" + gAccessToken + "&expand=true";
+            request.argument = "name=" + UrlEncode(profile) + "&token=" + conf->access_token + "&expand=true";
             content = getProfile(request, response);
         }
         else
@@ -2454,22 +2689,23 @@ std::string renderTemplate(RESPONSE_CALLBACK_ARGS)
     std::string &argument = request.argument;
     int *status_code = &response.status_code;
 
+    pref_config_ptr conf = getPrefConfig();
     std::string path = UrlDecode(getUrlArg(argument, "path"));
     writeLog(0, "Trying to render template '" + path + "'...", LOG_LEVEL_INFO);
 
-    if(!startsWith(path, gTemplatePath) || !fileExist(path))
+    if(!startsWith(path, conf->template_path) || !fileExist(path))
     {
         *status_code = 404;
         return "Not found";
     }
-    std::string template_content = fetchFile(path, parseProxy(gProxyConfig), gCacheConfig);
+    std::string template_content = fetchFile(path, parseProxy(conf->proxy_config), gCacheConfig);
     if(template_content.empty())
     {
         *status_code = 400;
         return "File empty or out of scope";
     }
     template_args tpl_args;
-    tpl_args.global_vars = gTemplateVars;
+    tpl_args.global_vars = conf->template_vars;
 
     //load request arguments as template variables
     string_array req_args = split(argument, "&");
@@ -2486,7 +2722,7 @@ std::string renderTemplate(RESPONSE_CALLBACK_ARGS)
     tpl_args.request_params = req_arg_map;
 
     std::string output_content;
-    if(render_template(template_content, tpl_args, output_content, gTemplatePath) != 0)
+    if(render_template(template_content, tpl_args, output_content, conf->template_path) != 0)
     {
         *status_code = 400;
         writeLog(0, "Render failed with error.", LOG_LEVEL_WARNING);
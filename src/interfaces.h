@@ -3,13 +3,46 @@
 
 #include <string>
 #include <map>
+#include <memory>
 #include <inja.hpp>
 
 #include "subexport.h"
+#include "speedtestutil.h"
 #include "webserver.h"
 
-void refreshRulesets(string_array &ruleset_list, std::vector<ruleset_content> &rca);
-void readConf();
+/// Preference data read by readConf(), published as a whole and never modified afterwards.
+/// Requests take one snapshot with getPrefConfig() and keep using it even if the preference is reloaded meanwhile.
+struct pref_config
+{
+    string_array exclude_remarks, include_remarks;
+    string_array custom_rulesets, custom_proxy_groups;
+    std::vector<ruleset_content> ruleset_contents;
+    string_array renames, emojis, stream_rules, time_rules;
+    std::string default_urls, insert_urls, default_ext_config;
+    std::string clash_base, surge_base, surfboard_base, mellow_base, quan_base, quanx_base, loon_base, sssub_base;
+    std::string sort_script, filter_script;
+    string_map template_vars;
+    std::string access_token, base_path = "base", template_path = "templates", managed_config_prefix;
+    std::string proxy_config, proxy_ruleset, proxy_subscription;
+    std::string surge_ssr_path, quanx_dev_id, clash_proxies_style = "flow";
+    tribool udp, tfo, skip_cert_verify, tls13, enable_insert;
+    std::string listen_address = "127.0.0.1", serve_file_root;
+    string_map aliases;
+
+    /// compiled when the snapshot is published
+    node_transform_ptr transform;
+    replace_rules compiled_stream_rules, compiled_time_rules;
+};
+
+typedef std::shared_ptr<const pref_config> pref_config_ptr;
+
+void refreshRulesets(const string_array &ruleset_list, std::vector<ruleset_content> &rca, const std::string &proxy);
+pref_config_ptr getPrefConfig();
+/// returns true if the rulesets changed and were fetched with the new preference
+bool readConf();
+/// fetch the rulesets of the current preference again and publish them with a new snapshot
+void refreshPrefRulesets();
+void flushExternalConfigCache();
 int simpleGenerator();
 std::string convertRuleset(const std::string &content, int type);
 
@@ -8,13 +8,12 @@
 #include "misc.h"
 #include "socket.h"
 #include "webget.h"
+#include "speedtestutil.h"
 #include "logger.h"
 
-extern std::string gPrefPath, gAccessToken, gListenAddress, gGenerateProfiles, gManagedConfigPrefix;
+extern std::string gPrefPath, gGenerateProfiles;
 extern bool gAPIMode, gGeneratorMode, gCFWChildProcess, gUpdateRulesetOnRequest;
 extern int gListenPort, gMaxConcurThreads, gMaxPendingConns;
-extern string_array gCustomRulesets;
-extern std::vector<ruleset_content> gRulesetContent;
 
 #ifndef _WIN32
 void SetConsoleTitle(const std::string &title)
@@ -139,19 +138,18 @@ int main(int argc, char *argv[])
     signal(SIGINT, signal_handler);
 
     SetConsoleTitle("SubConverter " VERSION);
-    readConf();
-    if(!gUpdateRulesetOnRequest)
-        refreshRulesets(gCustomRulesets, gRulesetContent);
+    if(!readConf() && !gUpdateRulesetOnRequest)
+        refreshPrefRulesets();
 
-    std::string env_api_mode = GetEnv("API_MODE"), env_managed_prefix = GetEnv("MANAGED_PREFIX"), env_token = GetEnv("API_TOKEN");
+    std::string env_api_mode = GetEnv("API_MODE");
     gAPIMode = tribool().parse(toLower(env_api_mode)).get(gAPIMode);
-    if(env_managed_prefix.size())
-        gManagedConfigPrefix = env_managed_prefix;
-    if(env_token.size())
-        gAccessToken = env_token;
 
     if(gGeneratorMode)
-        return simpleGenerator();
+    {
+        int retVal = simpleGenerator();
+        stopCacheRefresh();
+        return retVal;
+    }
 
     /*
     append_response("GET", "/", "text/plain", [](RESPONSE_CALLBACK_ARGS) -> std::string
@@ -160,49 +158,52 @@ int main(int argc, char *argv[])
     });
     */
 
+    //health checks are answered on the event loops so that they still pass while every worker is busy
     append_response("GET", "/version", "text/plain", [](RESPONSE_CALLBACK_ARGS) -> std::string
     {
         return "subconverter " VERSION " backend\n";
-    });
+    }, true);
 
     append_response("GET", "/refreshrules", "text/plain", [](RESPONSE_CALLBACK_ARGS) -> std::string
     {
-        if(gAccessToken.size())
+        std::string access_token = getPrefConfig()->access_token;
+        if(access_token.size())
         {
             std::string token = getUrlArg(request.argument, "token");
-            if(token != gAccessToken)
+            if(token != access_token)
             {
                 response.status_code = 403;
                 return "Forbidden\n";
             }
         }
-        refreshRulesets(gCustomRulesets, gRulesetContent);
+        refreshPrefRulesets();
         return "done\n";
     });
 
     append_response("GET", "/readconf", "text/plain", [](RESPONSE_CALLBACK_ARGS) -> std::string
     {
-        if(gAccessToken.size())
+        std::string access_token = getPrefConfig()->access_token;
+        if(access_token.size())
         {
             std::string token = getUrlArg(request.argument, "token");
-            if(token != gAccessToken)
+            if(token != access_token)
             {
                 response.status_code = 403;
                 return "Forbidden\n";
             }
         }
-        readConf();
-        if(!gUpdateRulesetOnRequest)
-            refreshRulesets(gCustomRulesets, gRulesetContent);
+        if(!readConf() && !gUpdateRulesetOnRequest)
+            refreshPrefRulesets();
         return "done\n";
     });
 
     append_response("POST", "/updateconf", "text/plain", [](RESPONSE_CALLBACK_ARGS) -> std::string
     {
-        if(gAccessToken.size())
+        std::string access_token = getPrefConfig()->access_token;
+        if(access_token.size())
         {
             std::string token = getUrlArg(request.argument, "token");
-            if(token != gAccessToken)
+            if(token != access_token)
             {
                 response.status_code = 403;
                 return "Forbidden\n";
@@ -219,23 +220,33 @@ int main(int argc, char *argv[])
             return "Not Implemented\n";
         }
 
-        readConf();
-        if(!gUpdateRulesetOnRequest)
-            refreshRulesets(gCustomRulesets, gRulesetContent);
+        if(!readConf() && !gUpdateRulesetOnRequest)
+            refreshPrefRulesets();
         return "done\n";
     });
 
     append_response("GET", "/flushcache", "text/plain", [](RESPONSE_CALLBACK_ARGS) -> std::string
     {
-        if(getUrlArg(request.argument, "token") != gAccessToken)
+        if(getUrlArg(request.argument, "token") != getPrefConfig()->access_token)
         {
             response.status_code = 403;
             return "Forbidden";
         }
         flushCache();
+        flushExternalConfigCache();
         return "done";
     });
 
+    append_response("GET", "/cachestatus", "text/plain", [](RESPONSE_CALLBACK_ARGS) -> std::string
+    {
+        if(getUrlArg(request.argument, "token") != getPrefConfig()->access_token)
+        {
+            response.status_code = 403;
+            return "Forbidden";
+        }
+        return getCacheStatus() + getSubFormatStatus();
+    }, true);
+
     append_response("GET", "/sub", "text/plain;charset=utf-8", subconverter);
 
     append_response("GET", "/sub2clashr", "text/plain;charset=utf-8", simpleToClashR);
@@ -271,10 +282,11 @@ int main(int argc, char *argv[])
     std::string env_port = GetEnv("PORT");
     if(env_port.size())
         gListenPort = to_int(env_port, gListenPort);
-    listener_args args = {gListenAddress, gListenPort, gMaxPendingConns, gMaxConcurThreads};
+    listener_args args = {getPrefConfig()->listen_address, gListenPort, gMaxPendingConns, gMaxConcurThreads};
     //std::cout<<"Serving HTTP @ http://"<<listen_address<<":"<<listen_port<<std::endl;
-    writeLog(0, "Startup completed. Serving HTTP @ http://" + gListenAddress + ":" + std::to_string(gListenPort), LOG_LEVEL_INFO);
+    writeLog(0, "Startup completed. Serving HTTP @ http://" + args.listen_address + ":" + std::to_string(gListenPort), LOG_LEVEL_INFO);
     start_web_server_multi(&args);
+    stopCacheRefresh();
 
 #ifdef _WIN32
     WSACleanup();
@@ -2,6 +2,11 @@
 #include <fstream>
 #include <thread>
 #include <sstream>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
 #include <iosfwd>
 #include <iostream>
 #include <cstdio>
@@ -16,8 +21,8 @@
 #include <regex>
 #else
 */
-#include <jpcre2.hpp>
-typedef jpcre2::select<char> jp;
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
 //#endif // USE_STD_REGEX
 
 #include <rapidjson/document.h>
@@ -167,7 +172,7 @@ std::string UrlEncode(const std::string& str)
     return strTemp;
 }
 
-std::string UrlDecode(const std::string& str)
+std::string UrlDecode(std::string_view str)
 {
     std::string strTemp;
     string_size length = str.length();
@@ -250,14 +255,13 @@ std::string base64_encode(const std::string &string_to_encode)
 
 }
 
-std::string base64_decode(const std::string &encoded_string, bool accept_urlsafe)
+static void base64_decode_append(std::string_view encoded_string, std::string &ret, bool accept_urlsafe)
 {
     string_size in_len = encoded_string.size();
     string_size i = 0;
     string_size in_ = 0;
     unsigned char char_array_4[4], char_array_3[3], uchar;
     static unsigned char dtable[256], itable[256], table_ready = 0;
-    std::string ret;
 
     // Should not need thread_local with the flag...
     if (!table_ready)
@@ -318,7 +322,12 @@ std::string base64_decode(const std::string &encoded_string, bool accept_urlsafe
         for (string_size j = 0; (j < i - 1); j++)
             ret += char_array_3[j];
     }
+}
 
+std::string base64_decode(const std::string &encoded_string, bool accept_urlsafe)
+{
+    std::string ret;
+    base64_decode_append(encoded_string, ret, accept_urlsafe);
     return ret;
 }
 
@@ -682,66 +691,245 @@ int regGetMatch(const std::string &src, const std::string &match, size_t group_c
 
 #else
 */
-bool regMatch(const std::string &src, const std::string &match)
+typedef std::lock_guard<std::mutex> guarded_mutex;
+
+#define REGEX_CACHE_SIZE 4096
+
+struct compiled_regex
+{
+    pcre2_code *code = NULL;
+    uint32_t capture_count = 0;
+
+    ~compiled_regex()
+    {
+        if(code)
+            pcre2_code_free(code);
+    }
+};
+
+typedef std::list<std::string> regex_lru_list;
+
+static std::mutex regex_cache_lock;
+static regex_lru_list regex_cache_order;
+static std::unordered_map<std::string, std::pair<compiled_regex_ptr, regex_lru_list::iterator>> regex_cache;
+
+/// compile with JIT once per pattern and options, invalid patterns are cached as NULL code too
+static compiled_regex_ptr getCompiledRegex(const std::string &pattern, uint32_t options)
+{
+    std::string key(reinterpret_cast<const char*>(&options), sizeof(options));
+    key += pattern;
+    {
+        guarded_mutex guard(regex_cache_lock);
+        auto iter = regex_cache.find(key);
+        if(iter != regex_cache.end())
+        {
+            regex_cache_order.splice(regex_cache_order.begin(), regex_cache_order, iter->second.second);
+            return iter->second.first;
+        }
+    }
+
+    compiled_regex_ptr reg = std::make_shared<compiled_regex>();
+    int errornumber;
+    PCRE2_SIZE erroroffset;
+    reg->code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.data()), pattern.size(), options, &errornumber, &erroroffset, NULL);
+    if(reg->code)
+    {
+        pcre2_jit_compile(reg->code, PCRE2_JIT_COMPLETE);
+        pcre2_pattern_info(reg->code, PCRE2_INFO_CAPTURECOUNT, &reg->capture_count);
+    }
+
+    guarded_mutex guard(regex_cache_lock);
+    auto iter = regex_cache.find(key);
+    if(iter != regex_cache.end()) //compiled by another thread in the meantime
+        return iter->second.first;
+    if(regex_cache.size() >= REGEX_CACHE_SIZE)
+    {
+        regex_cache.erase(regex_cache_order.back());
+        regex_cache_order.pop_back();
+    }
+    regex_cache_order.push_front(key);
+    regex_cache.emplace(std::move(key), std::make_pair(reg, regex_cache_order.begin()));
+    return reg;
+}
+
+/// match data is reused within each thread and only grows when a pattern needs more groups
+static pcre2_match_data *getMatchData(const compiled_regex &reg)
+{
+    struct match_data_holder
+    {
+        pcre2_match_data *data = NULL;
+        ~match_data_holder()
+        {
+            if(data)
+                pcre2_match_data_free(data);
+        }
+    };
+    static thread_local match_data_holder holder;
+    if(!holder.data || pcre2_get_ovector_count(holder.data) < reg.capture_count + 1)
+    {
+        if(holder.data)
+            pcre2_match_data_free(holder.data);
+        holder.data = pcre2_match_data_create(std::max<uint32_t>(reg.capture_count + 1, 16), NULL);
+    }
+    return holder.data;
+}
+
+#define REGEX_JIT_STACK_START 32 * 1024
+#define REGEX_JIT_STACK_MAX 4 * 1024 * 1024
+
+/// JIT code runs on a per-thread stack that grows up to REGEX_JIT_STACK_MAX, the default 32K one is too small
+/// for patterns that backtrack once per line of a whole document
+static pcre2_match_context *getMatchContext()
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier("m").addPcre2Option(PCRE2_ANCHORED|PCRE2_ENDANCHORED|PCRE2_UTF).compile();
-    if(!reg)
+    struct match_context_holder
+    {
+        pcre2_match_context *context = NULL;
+        pcre2_jit_stack *stack = NULL;
+        match_context_holder()
+        {
+            context = pcre2_match_context_create(NULL);
+            stack = pcre2_jit_stack_create(REGEX_JIT_STACK_START, REGEX_JIT_STACK_MAX, NULL);
+            if(context && stack)
+                pcre2_jit_stack_assign(context, NULL, stack);
+        }
+        ~match_context_holder()
+        {
+            if(context)
+                pcre2_match_context_free(context);
+            if(stack)
+                pcre2_jit_stack_free(stack);
+        }
+    };
+    static thread_local match_context_holder holder;
+    return holder.context;
+}
+
+/// subjects that still exceed the JIT stack are matched again by the interpreter, which keeps its frames on the heap
+static int regMatchAt(const compiled_regex &reg, PCRE2_SPTR subject, PCRE2_SIZE length, PCRE2_SIZE offset, uint32_t options, pcre2_match_data *match_data)
+{
+    int rc = pcre2_match(reg.code, subject, length, offset, options, match_data, getMatchContext());
+    if(rc == PCRE2_ERROR_JIT_STACKLIMIT)
+        rc = pcre2_match(reg.code, subject, length, offset, options | PCRE2_NO_JIT, match_data, getMatchContext());
+    return rc;
+}
+
+#define REGEX_FIND_OPTIONS (PCRE2_MULTILINE|PCRE2_UTF|PCRE2_ALT_BSUX)
+#define REGEX_MATCH_OPTIONS (PCRE2_MULTILINE|PCRE2_ANCHORED|PCRE2_ENDANCHORED|PCRE2_UTF)
+
+compiled_regex_ptr regCompile(const std::string &match, bool full_match)
+{
+    return getCompiledRegex(match, full_match ? REGEX_MATCH_OPTIONS : REGEX_FIND_OPTIONS);
+}
+
+bool regExec(const std::string &src, const compiled_regex_ptr &reg)
+{
+    if(!reg || !reg->code)
         return false;
-    return reg.match(src, "g");
+    return regMatchAt(*reg, reinterpret_cast<PCRE2_SPTR>(src.data()), src.size(), 0, 0, getMatchData(*reg)) >= 0;
+}
+
+bool regMatch(const std::string &src, const std::string &match)
+{
+    return regExec(src, getCompiledRegex(match, REGEX_MATCH_OPTIONS));
 }
 
 bool regFind(const std::string &src, const std::string &match)
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier("m").addPcre2Option(PCRE2_UTF|PCRE2_ALT_BSUX).compile();
-    if(!reg)
-        return false;
-    return reg.match(src, "g");
+    return regExec(src, getCompiledRegex(match, REGEX_FIND_OPTIONS));
 }
 
 std::string regReplace(const std::string &src, const std::string &match, const std::string &rep, bool global, bool multiline)
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier(multiline ? "m" : "").addPcre2Option(PCRE2_UTF|PCRE2_MULTILINE|PCRE2_ALT_BSUX).compile();
-    if(!reg)
+    (void)multiline; /// PCRE2_MULTILINE has always been applied regardless of this flag
+    return regReplace(src, getCompiledRegex(match, REGEX_FIND_OPTIONS), rep, global);
+}
+
+std::string regReplace(const std::string &src, const compiled_regex_ptr &reg, const std::string &rep, bool global)
+{
+    if(!reg || !reg->code)
         return src;
-    return reg.replace(src, rep, global ? "gx" : "x");
+    uint32_t options = PCRE2_SUBSTITUTE_EXTENDED | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+    if(global)
+        options |= PCRE2_SUBSTITUTE_GLOBAL;
+    std::string result;
+    PCRE2_SIZE outlength = src.size() + rep.size() + 1;
+    for(int retry = 0; retry < 3; retry++)
+    {
+        PCRE2_SIZE capacity = outlength;
+        result.resize(capacity);
+        int rc = pcre2_substitute(reg->code, reinterpret_cast<PCRE2_SPTR>(src.data()), src.size(), 0, options, getMatchData(*reg), getMatchContext(), reinterpret_cast<PCRE2_SPTR>(rep.data()), rep.size(), reinterpret_cast<PCRE2_UCHAR*>(&result[0]), &outlength);
+        if(rc >= 0)
+        {
+            result.resize(outlength);
+            return result;
+        }
+        if(rc == PCRE2_ERROR_JIT_STACKLIMIT && !(options & PCRE2_NO_JIT))
+        {
+            /// same fallback as regMatchAt
+            options |= PCRE2_NO_JIT;
+            outlength = capacity;
+            continue;
+        }
+        if(rc != PCRE2_ERROR_NOMEMORY)
+            break;
+        /// outlength now holds the required size
+        outlength++;
+    }
+    return src;
 }
 
 bool regValid(const std::string &reg)
 {
-    jp::Regex r;
-    r.setPattern(reg).addPcre2Option(PCRE2_UTF|PCRE2_ALT_BSUX).compile();
-    return !!r;
+    return getCompiledRegex(reg, PCRE2_UTF|PCRE2_ALT_BSUX)->code != NULL;
 }
 
 int regGetMatch(const std::string &src, const std::string &match, size_t group_count, ...)
 {
-    jp::Regex reg;
-    reg.setPattern(match).addModifier("m").addPcre2Option(PCRE2_UTF|PCRE2_ALT_BSUX).compile();
-    jp::VecNum vec_num;
-    jp::RegexMatch rm;
-    size_t count = rm.setRegexObject(&reg).setSubject(src).setNumberedSubstringVector(&vec_num).setModifier("g").match();
-    if(!count)
+    compiled_regex_ptr reg = getCompiledRegex(match, REGEX_FIND_OPTIONS);
+    if(!reg->code)
         return -1;
+    pcre2_match_data *match_data = getMatchData(*reg);
+    PCRE2_SPTR subject = reinterpret_cast<PCRE2_SPTR>(src.data());
+    PCRE2_SIZE length = src.size(), offset = 0;
+    uint32_t options = 0;
+    string_array groups;
+
+    /// collect the groups of all matches in order, same as a global match
+    while(offset <= length && groups.size() < group_count)
+    {
+        int rc = regMatchAt(*reg, subject, length, offset, options, match_data);
+        if(rc == PCRE2_ERROR_NOMATCH && options != 0)
+        {
+            /// empty match at this position, advance by one character
+            offset++;
+            while(offset < length && (subject[offset] & 0xc0) == 0x80)
+                offset++;
+            options = 0;
+            continue;
+        }
+        if(rc < 0)
+            break;
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+        for(uint32_t i = 0; i <= reg->capture_count; i++)
+        {
+            if(i >= (uint32_t)rc || ovector[2 * i] == PCRE2_UNSET)
+                groups.emplace_back();
+            else
+                groups.emplace_back(src, ovector[2 * i], ovector[2 * i + 1] - ovector[2 * i]);
+        }
+        options = ovector[0] == ovector[1] ? PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED : 0;
+        offset = ovector[1];
+    }
+    if(groups.empty())
+        return -1;
+
     va_list vl;
     va_start(vl, group_count);
-    size_t index = 0, match_index = 0;
-    while(group_count)
+    for(size_t index = 0; index < group_count && index < groups.size(); index++)
     {
         std::string* arg = va_arg(vl, std::string*);
         if(arg != NULL)
-            *arg = std::move(vec_num[match_index][index]);
-        index++;
-        group_count--;
-        if(vec_num[match_index].size() <= index)
-        {
-            match_index++;
-            index = 0;
-        }
-        if(vec_num.size() <= match_index)
-            break;
+            *arg = std::move(groups[index]);
     }
     va_end(vl);
     return 0;
@@ -787,6 +975,12 @@ std::string urlsafe_base64_decode(const std::string &encoded_string)
     return base64_decode(encoded_string, true);
 }
 
+void urlsafe_base64_decode(std::string_view encoded_string, std::string &result)
+{
+    result.clear();
+    base64_decode_append(encoded_string, result, true);
+}
+
 std::string urlsafe_base64_encode(const std::string &string_to_encode)
 {
     return urlsafe_base64(base64_encode(string_to_encode));
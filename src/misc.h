@@ -2,7 +2,9 @@
 #define MISC_H_INCLUDED
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
 #include <sstream>
 #include <algorithm>
 #include <sys/types.h>
@@ -42,7 +44,7 @@ static const std::string base64_chars =
     "0123456789+/";
 
 std::string UrlEncode(const std::string& str);
-std::string UrlDecode(const std::string& str);
+std::string UrlDecode(std::string_view str);
 std::string base64_decode(const std::string &encoded_string, bool accept_urlsafe = false);
 std::string base64_encode(const std::string &string_to_encode);
 
@@ -52,6 +54,8 @@ std::string replace_all_distinct(std::string str, const std::string &old_value,
 std::string urlsafe_base64(const std::string &encoded_string);
 std::string urlsafe_base64_reverse(const std::string &encoded_string);
 std::string urlsafe_base64_decode(const std::string &encoded_string);
+/// decode into result, reusing its capacity
+void urlsafe_base64_decode(std::string_view encoded_string, std::string &result);
 std::string urlsafe_base64_encode(const std::string &string_to_encode);
 std::string UTF8ToACP(const std::string &str_src);
 std::string ACPToUTF8(const std::string &str_src);
@@ -70,6 +74,13 @@ bool regFind(const std::string &src, const std::string &match);
 std::string regReplace(const std::string &src, const std::string &match, const std::string &rep, bool global = true, bool multiline = true);
 bool regMatch(const std::string &src, const std::string &match);
 int regGetMatch(const std::string &src, const std::string &match, size_t group_count, ...);
+struct compiled_regex;
+typedef std::shared_ptr<compiled_regex> compiled_regex_ptr;
+/// compile once for repeated use, with the options of regFind or of regMatch if full_match is set
+compiled_regex_ptr regCompile(const std::string &match, bool full_match = false);
+/// an invalid pattern never matches
+bool regExec(const std::string &src, const compiled_regex_ptr &reg);
+std::string regReplace(const std::string &src, const compiled_regex_ptr &reg, const std::string &rep, bool global = true);
 std::string regTrim(const std::string &src);
 std::string speedCalc(double speed);
 std::string getMD5(const std::string &data);
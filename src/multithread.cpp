@@ -1,77 +1,131 @@
 #include <future>
 #include <thread>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <condition_variable>
 #include "webget.h"
 #include "multithread.h"
 
-//safety lock for multi-thread
-std::mutex on_emoji, on_rename, on_stream, on_time;
-
-extern string_array gEmojis, gRenames;
-extern string_array gStreamNodeRules, gTimeNodeRules;
-
-string_array safe_get_emojis()
+std::shared_future<std::string> fetchFileAsync(const std::string &path, const std::string &proxy, int cache_ttl, bool async)
 {
-    guarded_mutex guard(on_emoji);
-    return gEmojis;
+    std::shared_future<std::string> retVal;
+    if(fileExist(path, true))
+        retVal = std::async(std::launch::async, [path](){return fileGet(path, true);});
+    else if(isLink(path))
+        retVal = std::async(std::launch::async, [path, proxy, cache_ttl](){return webGet(path, proxy, cache_ttl);});
+    else
+        return std::async(std::launch::async, [](){return std::string();});
+    if(!async)
+        retVal.wait();
+    return retVal;
 }
 
-string_array safe_get_renames()
+std::string fetchFile(const std::string &path, const std::string &proxy, int cache_ttl)
 {
-    guarded_mutex guard(on_rename);
-    return gRenames;
+    return fetchFileAsync(path, proxy, cache_ttl, false).get();
 }
 
-string_array safe_get_streams()
+struct parallel_batch
 {
-    guarded_mutex guard(on_stream);
-    return gStreamNodeRules;
-}
+    const std::function<void(size_t)> *func = NULL;
+    size_t count = 0;
+    std::atomic<size_t> next {0}, done {0};
+    std::atomic_bool failed {false};
+    std::exception_ptr error; /// first exception thrown by func, guarded by lock
+    std::mutex lock;
+    std::condition_variable cv;
+};
 
-string_array safe_get_times()
+/// never destroyed, detached workers may still be waiting on it while the process exits
+struct parallel_pool
 {
-    guarded_mutex guard(on_time);
-    return gTimeNodeRules;
-}
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<parallel_batch>> queue;
+};
 
-void safe_set_emojis(string_array &data)
+static void parallelWork(parallel_batch &batch)
 {
-    guarded_mutex guard(on_emoji);
-    gEmojis.swap(data);
+    size_t index;
+    while((index = batch.next++) < batch.count)
+    {
+        /// once an item has failed the rest are only counted, the caller rethrows the exception
+        if(!batch.failed)
+        {
+            try
+            {
+                (*batch.func)(index);
+            }
+            catch(...)
+            {
+                guarded_mutex guard(batch.lock);
+                if(!batch.error)
+                    batch.error = std::current_exception();
+                batch.failed = true;
+            }
+        }
+        if(++batch.done == batch.count)
+        {
+            guarded_mutex guard(batch.lock);
+            batch.cv.notify_all();
+        }
+    }
 }
 
-void safe_set_renames(string_array &data)
+static void parallelWorker(parallel_pool *pool)
 {
-    guarded_mutex guard(on_rename);
-    gRenames.swap(data);
+    while(true)
+    {
+        std::shared_ptr<parallel_batch> batch;
+        {
+            std::unique_lock<std::mutex> lock(pool->lock);
+            pool->cv.wait(lock, [pool](){ return !pool->queue.empty(); });
+            batch = pool->queue.front();
+            /// drained batches are dropped here, their callers might have returned already
+            if(batch->next >= batch->count)
+            {
+                pool->queue.pop_front();
+                continue;
+            }
+        }
+        parallelWork(*batch);
+    }
 }
 
-void safe_set_streams(string_array &data)
+static parallel_pool &getParallelPool()
 {
-    guarded_mutex guard(on_stream);
-    gStreamNodeRules.swap(data);
+    static parallel_pool *pool = []()
+    {
+        parallel_pool *pool = new parallel_pool;
+        unsigned int nworkers = std::thread::hardware_concurrency();
+        nworkers = nworkers > 1 ? nworkers - 1 : 1;
+        for(unsigned int i = 0; i < nworkers; i++)
+            std::thread(parallelWorker, pool).detach();
+        return pool;
+    }();
+    return *pool;
 }
 
-void safe_set_times(string_array &data)
+void parallelRun(size_t count, const std::function<void(size_t)> &func)
 {
-    guarded_mutex guard(on_time);
-    gTimeNodeRules.swap(data);
-}
+    if(!count)
+        return;
+    parallel_pool &pool = getParallelPool();
+    std::shared_ptr<parallel_batch> batch = std::make_shared<parallel_batch>();
+    batch->func = &func;
+    batch->count = count;
+    {
+        guarded_mutex guard(pool.lock);
+        pool.queue.push_back(batch);
+    }
+    pool.cv.notify_all();
 
-std::shared_future<std::string> fetchFileAsync(const std::string &path, const std::string &proxy, int cache_ttl, bool async)
-{
-    std::shared_future<std::string> retVal;
-    if(fileExist(path, true))
-        retVal = std::async(std::launch::async, [path](){return fileGet(path, true);});
-    else if(isLink(path))
-        retVal = std::async(std::launch::async, [path, proxy, cache_ttl](){return webGet(path, proxy, cache_ttl);});
-    else
-        return std::async(std::launch::async, [](){return std::string();});
-    if(!async)
-        retVal.wait();
-    return retVal;
-}
-
-std::string fetchFile(const std::string &path, const std::string &proxy, int cache_ttl)
-{
-    return fetchFileAsync(path, proxy, cache_ttl, false).get();
+    /// work on our own batch too, so nested or concurrent callers never wait on a busy pool
+    parallelWork(*batch);
+    std::unique_lock<std::mutex> lock(batch->lock);
+    batch->cv.wait(lock, [&](){ return batch->done == count; });
+    if(batch->error)
+        std::rethrow_exception(batch->error);
 }
@@ -3,6 +3,7 @@
 
 #include <mutex>
 #include <future>
+#include <functional>
 
 #include <yaml-cpp/yaml.h>
 
@@ -11,17 +12,12 @@
 
 typedef std::lock_guard<std::mutex> guarded_mutex;
 
-string_array safe_get_emojis();
-string_array safe_get_renames();
-string_array safe_get_streams();
-string_array safe_get_times();
 YAML::Node safe_get_clash_base();
 INIReader safe_get_mellow_base();
-void safe_set_emojis(string_array &data);
-void safe_set_renames(string_array &data);
-void safe_set_streams(string_array &data);
-void safe_set_times(string_array &data);
 std::shared_future<std::string> fetchFileAsync(const std::string &path, const std::string &proxy, int cache_ttl, bool async = false);
 std::string fetchFile(const std::string &path, const std::string &proxy, int cache_ttl);
+/// Run func(0) to func(count - 1) on the shared worker threads, the caller takes part and returns when all are done
+/// If func throws, the remaining items are skipped and the first exception is rethrown here
+void parallelRun(size_t count, const std::function<void(size_t)> &func);
 
 #endif // MULTITHREAD_H_INCLUDED
@@ -3,6 +3,38 @@
 
 #include <string>
 
+#include "misc.h"
+
+/// typed proxy settings, which fields are in use depends on nodeInfo::linkType
+struct proxyInfo
+{
+    std::string hostname;
+    int port = 0;
+    std::string username;
+    std::string password;
+    std::string encrypt_method;
+    std::string plugin;
+    std::string plugin_option;
+    std::string protocol;
+    std::string protocol_param;
+    std::string obfs;
+    std::string obfs_param;
+    std::string user_id;
+    int alter_id = 0;
+    std::string transfer_protocol;
+    std::string fake_type;
+    std::string host;
+    std::string edge;
+    std::string path;
+    std::string quic_secure;
+    std::string quic_secret;
+    bool tls_secure = false;
+    tribool udp;
+    tribool tfo;
+    tribool allow_insecure;
+    tribool tls13;
+};
+
 struct nodeInfo
 {
     int linkType = -1;
@@ -12,7 +44,7 @@ struct nodeInfo
     std::string remarks;
     std::string server;
     int port = 0;
-    std::string proxyStr;
+    proxyInfo proxy;
 };
 
 #endif // NODEINFO_H_INCLUDED
@@ -2,8 +2,10 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <memory>
 
 #include "nodeinfo.h"
+#include "nodemanip.h"
 #include "printout.h"
 #include "logger.h"
 #include "webget.h"
@@ -13,47 +15,39 @@
 std::string override_conf_port;
 bool ss_libev, ssr_libev;
 extern int gCacheSubscription;
+extern long gMaxAllowedDownloadSize;
 
 void copyNodes(std::vector<nodeInfo> &source, std::vector<nodeInfo> &dest)
 {
     std::move(source.begin(), source.end(), std::back_inserter(dest));
 }
 
-int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, const std::string &proxy, string_array &exclude_remarks, string_array &include_remarks, string_array &stream_rules, string_array &time_rules, std::string &subInfo, bool authorized, string_map &request_headers)
+static void evalScriptLink(std::string &link)
 {
-    int linkType = -1;
-    std::vector<nodeInfo> nodes;
-    nodeInfo node;
-    std::string strSub, extra_headers, custom_group;
-
-    // TODO: replace with startsWith if appropriate
-    link = replace_all_distinct(link, "\"", "");
-
-    /// script:filepath,arg1,arg2,...
-    if(startsWith(link, "script:") && authorized) /// process subscription with script
+    writeLog(0, "Found script link. Start running...", LOG_LEVEL_INFO);
+    string_array args = split(link.substr(7), ",");
+    if(args.size() >= 1)
     {
-        writeLog(0, "Found script link. Start running...", LOG_LEVEL_INFO);
-        string_array args = split(link.substr(7), ",");
-        if(args.size() >= 1)
+        std::string script = fileGet(args[0], false);
+        duk_context *ctx = duktape_acquire();
+        defer(duktape_release(ctx);)
+        duktape_peval(ctx, script);
+        duk_get_global_string(ctx, "parse");
+        for(size_t i = 1; i < args.size(); i++)
+            duk_push_string(ctx, trim(args[i]).c_str());
+        if(duk_pcall(ctx, args.size() - 1) == 0)
+            link = duktape_get_res_str(ctx);
+        else
         {
-            std::string script = fileGet(args[0], false);
-            duk_context *ctx = duktape_init();
-            defer(duk_destroy_heap(ctx);)
-            duktape_peval(ctx, script);
-            duk_get_global_string(ctx, "parse");
-            for(size_t i = 1; i < args.size(); i++)
-                duk_push_string(ctx, trim(args[i]).c_str());
-            if(duk_pcall(ctx, args.size() - 1) == 0)
-                link = duktape_get_res_str(ctx);
-            else
-            {
-                writeLog(0, "Error when trying to evaluate script:\n" + duktape_get_err_stack(ctx), LOG_LEVEL_ERROR);
-                duk_pop(ctx); /// pop err
-            }
+            writeLog(0, "Error when trying to evaluate script:\n" + duktape_get_err_stack(ctx), LOG_LEVEL_ERROR);
+            duk_pop(ctx); /// pop err
         }
     }
+}
 
-    /// tag:group_name,link
+static std::string stripLinkTag(std::string &link)
+{
+    std::string custom_group;
     if(startsWith(link, "tag:"))
     {
         string_size pos = link.find(",");
@@ -63,6 +57,110 @@ int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, con
             link.erase(0, pos + 1);
         }
     }
+    return custom_group;
+}
+
+static int getLinkType(const std::string &link)
+{
+    if(startsWith(link, "https://t.me/socks") || startsWith(link, "tg://socks"))
+        return SPEEDTEST_MESSAGE_FOUNDSOCKS;
+    else if(startsWith(link, "https://t.me/http") || startsWith(link, "tg://http"))
+        return SPEEDTEST_MESSAGE_FOUNDHTTP;
+    else if(isLink(link) || startsWith(link, "surge:///install-config"))
+        return SPEEDTEST_MESSAGE_FOUNDSUB;
+    else if(startsWith(link, "Netch://"))
+        return SPEEDTEST_MESSAGE_FOUNDNETCH;
+    else if(fileExist(link))
+        return SPEEDTEST_MESSAGE_FOUNDLOCAL;
+    return -1;
+}
+
+void prefetchSubscriptions(string_array &links, const std::string &proxy, bool authorized, string_map &request_headers, subscription_map &prefetched)
+{
+    std::vector<FetchArgument> arguments;
+    std::vector<FetchResult> results;
+    std::vector<int> status_codes;
+    std::vector<std::unique_ptr<SubStreamParser>> parsers;
+    std::vector<stream_sink> sinks;
+    string_array urls;
+
+    for(std::string &x : links)
+    {
+        std::string link = replace_all_distinct(x, "\"", "");
+        if(startsWith(link, "script:") && authorized)
+        {
+            /// evaluate only once, addNodes will receive the resulting link
+            evalScriptLink(link);
+            x = link;
+        }
+        stripLinkTag(link);
+        if(getLinkType(link) != SPEEDTEST_MESSAGE_FOUNDSUB)
+            continue;
+        if(startsWith(link, "surge:///install-config"))
+            link = UrlDecode(getUrlArg(link, "url"));
+        if(prefetched.find(link) != prefetched.end())
+            continue;
+        prefetched[link];
+        urls.emplace_back(link);
+    }
+    if(urls.empty())
+        return;
+
+    writeLog(0, "Downloading " + std::to_string(urls.size()) + " subscription(s) concurrently...", LOG_LEVEL_INFO);
+    status_codes.resize(urls.size());
+    parsers.resize(urls.size());
+    sinks.resize(urls.size());
+    for(size_t i = 0; i < urls.size(); i++)
+    {
+        subscription_data &data = prefetched[urls[i]];
+        arguments.push_back(FetchArgument{urls[i], proxy, &request_headers, (unsigned int)gCacheSubscription});
+        results.push_back(FetchResult{&status_codes[i], &data.content, &data.headers});
+        /// cached fetches stay buffered: the cache entry needs the whole body anyway and a hit has no transfer to overlap with
+        if(!gCacheSubscription)
+        {
+            /// parse while downloading, only formats that can not be streamed are kept in content
+            SubStreamParser *parser = new SubStreamParser(override_conf_port, ss_libev, ssr_libev, data.nodes, data.content, gMaxAllowedDownloadSize);
+            parsers[i].reset(parser);
+            sinks[i] = [parser](const char *chunk, size_t len){ return parser->feed(chunk, len); };
+            results[i].stream = &sinks[i];
+        }
+    }
+    webGetMulti(arguments, results);
+
+    for(size_t i = 0; i < urls.size(); i++)
+    {
+        if(!parsers[i])
+            continue;
+        subscription_data &data = prefetched[urls[i]];
+        if(status_codes[i] != 0)
+        {
+            eraseElements(data.nodes);
+            data.content.clear();
+            continue;
+        }
+        data.streamed = parsers[i]->finish();
+        data.format = parsers[i]->getFormat();
+    }
+}
+
+int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, const std::string &proxy, const NodeFilter &filter, const replace_rules &stream_rules, const replace_rules &time_rules, std::string &subInfo, bool authorized, string_map &request_headers, const subscription_map *prefetched)
+{
+    int linkType = -1;
+    std::vector<nodeInfo> nodes;
+    nodeInfo node;
+    std::string strSub, extra_headers, custom_group;
+    subscription_map fetched;
+    const subscription_data *data = NULL;
+
+    // TODO: replace with startsWith if appropriate
+    link = replace_all_distinct(link, "\"", "");
+
+    /// script:filepath,arg1,arg2,...
+    if(startsWith(link, "script:") && authorized) /// process subscription with script
+        evalScriptLink(link);
+
+    /// tag:group_name,link
+    custom_group = stripLinkTag(link);
 
     if(link == "nullnode")
     {
@@ -73,16 +171,7 @@ int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, con
     }
 
     writeLog(LOG_TYPE_INFO, "Received Link.");
-    if(startsWith(link, "https://t.me/socks") || startsWith(link, "tg://socks"))
-        linkType = SPEEDTEST_MESSAGE_FOUNDSOCKS;
-    else if(startsWith(link, "https://t.me/http") || startsWith(link, "tg://http"))
-        linkType = SPEEDTEST_MESSAGE_FOUNDHTTP;
-    else if(isLink(link) || startsWith(link, "surge:///install-config"))
-        linkType = SPEEDTEST_MESSAGE_FOUNDSUB;
-    else if(startsWith(link, "Netch://"))
-        linkType = SPEEDTEST_MESSAGE_FOUNDNETCH;
-    else if(fileExist(link))
-        linkType = SPEEDTEST_MESSAGE_FOUNDLOCAL;
+    linkType = getLinkType(link);
 
     switch(linkType)
     {
@@ -90,7 +179,15 @@ int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, con
         writeLog(LOG_TYPE_INFO, "Downloading subscription data...");
         if(startsWith(link, "surge:///install-config")) //surge config link
             link = UrlDecode(getUrlArg(link, "url"));
-        strSub = webGet(link, proxy, gCacheSubscription, &extra_headers, &request_headers);
+        if(!prefetched || prefetched->find(link) == prefetched->end())
+        {
+            string_array links = {link};
+            prefetchSubscriptions(links, proxy, authorized, request_headers, fetched);
+            prefetched = &fetched;
+        }
+        data = &prefetched->at(link);
+        strSub = data->content;
+        extra_headers = data->headers;
         /*
         if(strSub.size() == 0)
         {
@@ -105,10 +202,20 @@ int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, con
                 writeLog(LOG_TYPE_WARN, "No system proxy is set. Skipping.");
         }
         */
-        if(strSub.size())
+        if(data->streamed || strSub.size())
         {
             writeLog(LOG_TYPE_INFO, "Parsing subscription data...");
-            if(explodeConfContent(strSub, override_conf_port, ss_libev, ssr_libev, nodes) == SPEEDTEST_ERROR_UNRECOGFILE)
+            int format = data->format, result;
+            if(data->streamed)
+            {
+                nodes = data->nodes;
+                result = nodes.empty() ? SPEEDTEST_ERROR_UNRECOGFILE : SPEEDTEST_ERROR_NONE; /// same as explodeConfContent
+            }
+            else
+                result = explodeConfContent(strSub, override_conf_port, ss_libev, ssr_libev, nodes, &format);
+            writeLog(LOG_TYPE_INFO, "Detected subscription format: " + getSubFormatName(format));
+            countSubFormat(format);
+            if(result == SPEEDTEST_ERROR_UNRECOGFILE)
             {
                 writeLog(LOG_TYPE_ERROR, "Invalid subscription!");
                 return -1;
@@ -122,7 +229,7 @@ int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, con
                 if(!getSubInfoFromHeader(extra_headers, subInfo))
                     getSubInfoFromNodes(nodes, stream_rules, time_rules, subInfo);
             }
-            filterNodes(nodes, exclude_remarks, include_remarks, groupID);
+            filter.apply(nodes, groupID);
             for(nodeInfo &x : nodes)
             {
                 x.groupID = groupID;
@@ -154,7 +261,7 @@ int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, con
         {
             getSubInfoFromNodes(nodes, stream_rules, time_rules, subInfo);
         }
-        filterNodes(nodes, exclude_remarks, include_remarks, groupID);
+        filter.apply(nodes, groupID);
         for(nodeInfo &x : nodes)
         {
             x.groupID = groupID;
@@ -3,9 +3,24 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
 #include "nodeinfo.h"
+#include "speedtestutil.h"
 
-int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, const std::string &proxy, string_array &exclude_remarks, string_array &include_remarks, string_array &stream_rules, string_array &time_rules, std::string &subInfo, bool authorized, string_map &request_headers);
+struct subscription_data
+{
+    std::string content;
+    std::string headers;
+    /// nodes parsed while downloading, content only holds formats that could not be streamed
+    std::vector<nodeInfo> nodes;
+    bool streamed = false;
+    int format = 0;
+};
+
+typedef std::map<std::string, subscription_data> subscription_map;
+
+void prefetchSubscriptions(string_array &links, const std::string &proxy, bool authorized, string_map &request_headers, subscription_map &prefetched);
+int addNodes(std::string link, std::vector<nodeInfo> &allNodes, int groupID, const std::string &proxy, const NodeFilter &filter, const replace_rules &stream_rules, const replace_rules &time_rules, std::string &subInfo, bool authorized, string_map &request_headers, const subscription_map *prefetched = NULL);
 
 #endif // NODEMANIP_H_INCLUDED
@@ -2,6 +2,7 @@
 #define RAPIDJSON_EXTRA_H_INCLUDED
 
 #include <exception>
+#include <algorithm>
 
 template <typename T> void exception_thrower(T e)
 {
@@ -15,7 +16,12 @@ template <typename T> void exception_thrower(T e)
 #define RAPIDJSON_ASSERT(x) exception_thrower(x)
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
+#include <rapidjson/reader.h>
 #include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <initializer_list>
 
 static inline void operator >> (const rapidjson::Value& value, std::string& i)
 {
@@ -71,4 +77,123 @@ static inline std::string SerializeObject(const rapidjson::Value& value)
 }
 
 
+static inline std::string GetMember(const std::map<std::string, std::string> &entry, const std::string &member)
+{
+    auto iter = entry.find(member);
+    return iter != entry.end() ? iter->second : std::string();
+}
+
+static inline void GetMember(const std::map<std::string, std::string> &entry, const std::string &member, std::string& target)
+{
+    std::string retStr = GetMember(entry, member);
+    if(retStr.size())
+        target.assign(retStr);
+}
+
+/// SAX reader for client configs: every object inside one of the watched arrays is flattened into
+/// path => value pairs ("settings.vnext.0.address") and handed over on its closing brace, so only
+/// one entry is held in memory at a time. Scalars are converted like operator >>, nulls are left out
+/// and containers are recorded with an empty value so their presence can still be tested.
+/// Members of the root object are kept in root the same way, without their children.
+/// An array watched as "" is the root array itself.
+class JsonEntryReader : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, JsonEntryReader>
+{
+public:
+    typedef std::function<void(const std::string &section, std::map<std::string, std::string> &entry)> entry_handler;
+    std::map<std::string, std::string> root;
+
+    JsonEntryReader(std::initializer_list<std::string> sections, entry_handler handler) : sections(sections), handler(handler) {}
+
+    /// returns false on a parse error, entries completed before the error have already been handled
+    bool Parse(const std::string &content)
+    {
+        rapidjson::Reader reader;
+        rapidjson::StringStream stream(content.data());
+        return !reader.Parse(stream, *this).IsError();
+    }
+
+    bool Null() { nextName(); return true; }
+    bool Bool(bool b) { return value(b ? "true" : "false"); }
+    bool Int(int i) { return value(std::to_string(i)); }
+    bool Uint(unsigned u) { return value(std::to_string(u)); }
+    bool Int64(int64_t i) { return value(std::to_string(i)); }
+    bool Uint64(uint64_t u) { return value(std::to_string(u)); }
+    bool Double(double d) { return value(std::to_string(d)); }
+    bool String(const char *str, rapidjson::SizeType length, bool) { return value(std::string(str, length)); }
+    bool Key(const char *str, rapidjson::SizeType length, bool) { key.assign(str, length); return true; }
+    bool StartObject() { return start(false); }
+    bool EndObject(rapidjson::SizeType) { return end(); }
+    bool StartArray() { return start(true); }
+    bool EndArray(rapidjson::SizeType) { return end(); }
+
+private:
+    struct level
+    {
+        bool array;
+        unsigned int index;
+        size_t path_size;
+    };
+    std::vector<std::string> sections;
+    entry_handler handler;
+    std::vector<level> levels;
+    std::map<std::string, std::string> entry;
+    std::string key, path, saved_path, section;
+    size_t entry_depth = 0;
+
+    std::string nextName()
+    {
+        if(levels.empty())
+            return std::string();
+        if(levels.back().array)
+            return std::to_string(levels.back().index++);
+        return key;
+    }
+
+    bool value(std::string &&data)
+    {
+        std::string name = nextName();
+        if(entry_depth)
+            entry[path + name] = std::move(data);
+        else if(levels.size() == 1 && !levels[0].array)
+            root[name] = std::move(data);
+        return true;
+    }
+
+    bool start(bool array)
+    {
+        bool in_section = !entry_depth && !array && levels.size() && levels.back().array && std::find(sections.begin(), sections.end(), path.substr(0, path.size() ? path.size() - 1 : 0)) != sections.end();
+        std::string name = nextName();
+        if(entry_depth)
+            entry[path + name];
+        else if(levels.size() == 1 && !levels[0].array)
+            root[name];
+        levels.push_back({array, 0, path.size()});
+        if(in_section)
+        {
+            section = path.substr(0, path.size() ? path.size() - 1 : 0);
+            saved_path.swap(path);
+            path.clear();
+            entry_depth = levels.size();
+        }
+        else if(levels.size() > 1)
+            path += name + ".";
+        return true;
+    }
+
+    bool end()
+    {
+        if(entry_depth && levels.size() == entry_depth)
+        {
+            entry_depth = 0;
+            path.swap(saved_path);
+            if(handler)
+                handler(section, entry);
+            entry.clear();
+        }
+        path.resize(levels.back().path_size);
+        levels.pop_back();
+        return true;
+    }
+};
+
 #endif // RAPIDJSON_EXTRA_H_INCLUDED
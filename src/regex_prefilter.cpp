@@ -0,0 +1,494 @@
+#include <deque>
+#include <algorithm>
+#include <cctype>
+
+#include "regex_prefilter.h"
+
+enum
+{
+    QUANT_NONE,
+    QUANT_REQUIRED,
+    QUANT_OPTIONAL
+};
+
+/// any match of the pattern contains at least one of these literals
+struct literal_set
+{
+    bool valid = false;
+    string_array literals;
+};
+
+static size_t utf8Length(unsigned char c)
+{
+    if((c & 0xe0) == 0xc0)
+        return 2;
+    if((c & 0xf0) == 0xe0)
+        return 3;
+    if((c & 0xf8) == 0xf0)
+        return 4;
+    return 1;
+}
+
+static size_t weakestLiteral(const literal_set &x)
+{
+    size_t result = std::string::npos;
+    for(const std::string &y : x.literals)
+        result = std::min(result, y.size());
+    return result;
+}
+
+/// Conservative walk over the PCRE2 syntax used in rule files, anything it does not fully understand
+/// makes the pattern unusable for prefiltering instead of risking a wrong literal.
+class literal_extractor
+{
+public:
+    bool caseless = false;
+
+    literal_extractor(const std::string &pattern) : pattern(pattern) {}
+
+    literal_set extract()
+    {
+        literal_set result = alternation();
+        if(failed || pos != pattern.size())
+            return literal_set();
+        return result;
+    }
+
+private:
+    const std::string &pattern;
+    size_t pos = 0;
+    bool failed = false;
+
+    literal_set alternation()
+    {
+        literal_set result = sequence(), next;
+        bool all_valid = result.valid;
+        while(!failed && pos < pattern.size() && pattern[pos] == '|')
+        {
+            pos++;
+            next = sequence();
+            all_valid = all_valid && next.valid;
+            std::move(next.literals.begin(), next.literals.end(), std::back_inserter(result.literals));
+        }
+        result.valid = all_valid;
+        return result;
+    }
+
+    literal_set sequence()
+    {
+        literal_set best, inner;
+        std::string run;
+        bool use;
+        auto offer = [&best](literal_set &&candidate)
+        {
+            if(!best.valid || weakestLiteral(candidate) > weakestLiteral(best) || (weakestLiteral(candidate) == weakestLiteral(best) && candidate.literals.size() < best.literals.size()))
+                best = std::move(candidate);
+        };
+        auto flush = [&]()
+        {
+            if(run.size())
+                offer(literal_set{true, {run}});
+            run.clear();
+        };
+        auto literal = [&](const std::string &atom)
+        {
+            int quant = quantifier();
+            if(quant == QUANT_OPTIONAL)
+                flush();
+            else
+            {
+                run += atom;
+                if(quant == QUANT_REQUIRED)
+                    flush();
+            }
+        };
+
+        while(!failed && pos < pattern.size() && pattern[pos] != '|' && pattern[pos] != ')')
+        {
+            unsigned char c = pattern[pos];
+            switch(c)
+            {
+            case '(':
+                flush();
+                pos++;
+                use = true;
+                if(pos < pattern.size() && pattern[pos] == '?' && !groupPrefix(use))
+                    break;
+                inner = alternation();
+                if(failed || pos >= pattern.size() || pattern[pos] != ')')
+                {
+                    failed = true;
+                    break;
+                }
+                pos++;
+                if(quantifier() != QUANT_OPTIONAL && use && inner.valid)
+                    offer(std::move(inner));
+                break;
+            case '[':
+                flush();
+                skipClass();
+                quantifier();
+                break;
+            case '.':
+            case '^':
+            case '$':
+                flush();
+                pos++;
+                quantifier();
+                break;
+            case '\\':
+                escape(flush, literal);
+                break;
+            case '*':
+            case '+':
+            case '?':
+                failed = true;
+                break;
+            case '{':
+                if(quantifier() != QUANT_NONE)
+                {
+                    failed = true;
+                    break;
+                }
+                pos++;
+                literal("{");
+                break;
+            default:
+                pos += utf8Length(c);
+                literal(pattern.substr(pos - utf8Length(c), utf8Length(c)));
+            }
+        }
+        flush();
+        return best;
+    }
+
+    /// handles the part after "(?", returns false when there is no group content to parse
+    bool groupPrefix(bool &use)
+    {
+        pos++;
+        if(pos >= pattern.size())
+        {
+            failed = true;
+            return false;
+        }
+        char c = pattern[pos];
+        switch(c)
+        {
+        case ':':
+            pos++;
+            return true;
+        case '=': //lookarounds do not consume, their content is not used
+        case '!':
+            pos++;
+            use = false;
+            return true;
+        case '<':
+            if(pos + 1 < pattern.size() && (pattern[pos + 1] == '=' || pattern[pos + 1] == '!'))
+            {
+                pos += 2;
+                use = false;
+                return true;
+            }
+            return skipName('>');
+        case 'P':
+            if(pos + 1 < pattern.size() && pattern[pos + 1] == '<')
+            {
+                pos++;
+                return skipName('>');
+            }
+            break;
+        case '\'':
+            return skipName('\'');
+        case '#':
+            pos = pattern.find(')', pos);
+            if(pos == pattern.npos)
+                break;
+            pos++;
+            return false;
+        default:
+            bool negated = false;
+            while(pos < pattern.size() && strchr("imnsUJ-^", pattern[pos]))
+            {
+                if(pattern[pos] == '-')
+                    negated = true;
+                else if(pattern[pos] == 'i' && !negated)
+                    caseless = true;
+                pos++;
+            }
+            if(pos >= pattern.size())
+                break;
+            if(pattern[pos] == ':')
+            {
+                pos++;
+                return true;
+            }
+            if(pattern[pos] == ')')
+            {
+                pos++;
+                return false;
+            }
+        }
+        failed = true;
+        return false;
+    }
+
+    bool skipName(char terminator)
+    {
+        pos = pattern.find(terminator, pos + 1);
+        if(pos == pattern.npos)
+        {
+            failed = true;
+            return false;
+        }
+        pos++;
+        return true;
+    }
+
+    void skipClass()
+    {
+        pos++;
+        if(pos < pattern.size() && pattern[pos] == '^')
+            pos++;
+        if(pos < pattern.size() && pattern[pos] == ']')
+            pos++;
+        while(pos < pattern.size() && pattern[pos] != ']')
+        {
+            if(pattern[pos] == '\\')
+                pos++;
+            else if(pattern.compare(pos, 2, "[:") == 0)
+            {
+                string_size end = pattern.find(":]", pos + 2);
+                if(end != pattern.npos)
+                    pos = end + 1;
+            }
+            pos++;
+        }
+        if(pos >= pattern.size())
+            failed = true;
+        else
+            pos++;
+    }
+
+    template <typename F, typename L> void escape(F &flush, L &literal)
+    {
+        if(pos + 1 >= pattern.size())
+        {
+            failed = true;
+            return;
+        }
+        unsigned char c = pattern[pos + 1];
+        if(isdigit(c)) //back reference
+        {
+            flush();
+            pos++;
+            while(pos < pattern.size() && isdigit(pattern[pos]))
+                pos++;
+            quantifier();
+        }
+        else if(isalpha(c))
+        {
+            if(!strchr("dDwWsShHvVRXbBAzZGK", c))
+            {
+                failed = true;
+                return;
+            }
+            flush();
+            pos += 2;
+            quantifier();
+        }
+        else
+        {
+            size_t length = utf8Length(c);
+            pos += 1 + length;
+            literal(pattern.substr(pos - length, length));
+        }
+    }
+
+    int quantifier()
+    {
+        int result;
+        if(pos >= pattern.size())
+            return QUANT_NONE;
+        switch(pattern[pos])
+        {
+        case '*':
+        case '?':
+            result = QUANT_OPTIONAL;
+            pos++;
+            break;
+        case '+':
+            result = QUANT_REQUIRED;
+            pos++;
+            break;
+        case '{':
+        {
+            string_size end = pattern.find('}', pos), comma;
+            if(end == pattern.npos)
+                return QUANT_NONE;
+            std::string body = pattern.substr(pos + 1, end - pos - 1);
+            if(body.empty() || body.find_first_not_of("0123456789, ") != body.npos)
+                return QUANT_NONE;
+            comma = body.find(',');
+            //only the classic forms are read, anything newer PCRE2 versions might also accept is refused
+            if(body.find(' ') != body.npos || comma == 0 || body.find(',', comma == body.npos ? comma : comma + 1) != body.npos)
+            {
+                failed = true;
+                return QUANT_NONE;
+            }
+            result = to_int(body.substr(0, comma)) > 0 ? QUANT_REQUIRED : QUANT_OPTIONAL;
+            pos = end + 1;
+            break;
+        }
+        default:
+            return QUANT_NONE;
+        }
+        if(pos < pattern.size() && (pattern[pos] == '?' || pattern[pos] == '+')) //lazy or possessive
+            pos++;
+        return result;
+    }
+};
+
+/// characters without case variants apart from ASCII: CJK symbols, kana, ideographs and Hangul syllables
+static bool isFoldSafe(const std::string &literal)
+{
+    for(string_size i = 0; i < literal.size(); i++)
+    {
+        unsigned char c = literal[i];
+        if(c < 0x80)
+            continue;
+        if(i + 2 < literal.size() && ((c >= 0xe3 && c <= 0xe9) || (c >= 0xeb && c <= 0xed) || (c == 0xea && (unsigned char)literal[i + 1] >= 0xb0)))
+        {
+            i += 2;
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+/// ASCII case folding, plus the only two non-ASCII characters a caseless ASCII letter can match
+static void foldSubject(const std::string &src, std::string &result)
+{
+    result.clear();
+    result.reserve(src.size());
+    for(string_size i = 0; i < src.size(); i++)
+    {
+        unsigned char c = src[i];
+        if(c >= 'A' && c <= 'Z')
+            result += c + 32;
+        else if(src.compare(i, 3, "\xe2\x84\xaa") == 0) //KELVIN SIGN
+        {
+            result += 'k';
+            i += 2;
+        }
+        else if(src.compare(i, 2, "\xc5\xbf") == 0) //LATIN SMALL LETTER LONG S
+        {
+            result += 's';
+            i++;
+        }
+        else
+            result += c;
+    }
+}
+
+static int automatonStep(const std::vector<std::pair<unsigned char, int>> &next, unsigned char c)
+{
+    for(const auto &x : next)
+        if(x.first == c)
+            return x.second;
+    return -1;
+}
+
+void RegexPrefilter::automaton::insert(const std::string &literal, int pattern)
+{
+    int current = 0, next;
+    for(unsigned char c : literal)
+    {
+        next = automatonStep(states[current].next, c);
+        if(next == -1)
+        {
+            next = states.size();
+            states.emplace_back();
+            states[current].next.emplace_back(c, next);
+        }
+        current = next;
+    }
+    states[current].output.push_back(pattern);
+}
+
+void RegexPrefilter::automaton::build()
+{
+    std::deque<int> queue;
+    int fail, next;
+    for(const auto &x : states[0].next)
+        queue.push_back(x.second);
+    while(queue.size())
+    {
+        int current = queue.front();
+        queue.pop_front();
+        for(const auto &x : states[current].next)
+        {
+            queue.push_back(x.second);
+            if(!current)
+                continue;
+            fail = states[current].fail;
+            while(fail && automatonStep(states[fail].next, x.first) == -1)
+                fail = states[fail].fail;
+            next = automatonStep(states[fail].next, x.first);
+            states[x.second].fail = next == -1 ? 0 : next;
+            //states are visited by depth, so the fail state already holds its own suffixes
+            const std::vector<int> &inherited = states[states[x.second].fail].output;
+            states[x.second].output.insert(states[x.second].output.end(), inherited.begin(), inherited.end());
+        }
+    }
+}
+
+void RegexPrefilter::automaton::scan(const std::string &src, std::vector<char> &candidates) const
+{
+    int current = 0, next;
+    for(unsigned char c : src)
+    {
+        while((next = automatonStep(states[current].next, c)) == -1 && current)
+            current = states[current].fail;
+        current = next == -1 ? 0 : next;
+        for(int x : states[current].output)
+            candidates[x] = 1;
+    }
+}
+
+RegexPrefilter::RegexPrefilter(const string_array &patterns) : always(patterns.size(), 0)
+{
+    for(size_t i = 0; i < patterns.size(); i++)
+    {
+        literal_extractor extractor(patterns[i]);
+        literal_set required = extractor.extract();
+        if(required.valid && extractor.caseless)
+        {
+            required.valid = std::all_of(required.literals.begin(), required.literals.end(), isFoldSafe);
+            for(std::string &x : required.literals)
+                std::transform(x.begin(), x.end(), x.begin(), [](unsigned char c){ return c >= 'A' && c <= 'Z' ? c + 32 : c; });
+        }
+        if(!required.valid)
+        {
+            always[i] = 1;
+            continue;
+        }
+        for(const std::string &x : required.literals)
+            (extractor.caseless ? folded : exact).insert(x, i);
+    }
+    exact.build();
+    folded.build();
+}
+
+void RegexPrefilter::scan(const std::string &src, std::vector<char> &candidates) const
+{
+    candidates = always;
+    if(!exact.empty())
+        exact.scan(src, candidates);
+    if(!folded.empty())
+    {
+        std::string folded_src;
+        foldSubject(src, folded_src);
+        folded.scan(folded_src, candidates);
+    }
+}
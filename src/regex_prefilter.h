@@ -0,0 +1,42 @@
+#ifndef REGEX_PREFILTER_H_INCLUDED
+#define REGEX_PREFILTER_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "misc.h"
+
+/// Multi-pattern prefilter for long regex lists: the literals that every match of a pattern has to contain
+/// are searched for all patterns at once with an Aho-Corasick automaton, so only the patterns whose literals
+/// occur in a subject need to be run. Patterns without usable literals are always candidates.
+class RegexPrefilter
+{
+public:
+    RegexPrefilter() = default;
+    /// patterns are regFind patterns, an empty one is always a candidate
+    explicit RegexPrefilter(const string_array &patterns);
+    /// candidates[i] is set to 1 if patterns[i] may match src, 0 if it cannot
+    void scan(const std::string &src, std::vector<char> &candidates) const;
+    size_t size() const { return always.size(); }
+
+private:
+    struct automaton
+    {
+        struct state
+        {
+            std::vector<std::pair<unsigned char, int>> next;
+            std::vector<int> output;
+            int fail = 0;
+        };
+        std::vector<state> states = std::vector<state>(1);
+
+        void insert(const std::string &literal, int pattern);
+        void build();
+        void scan(const std::string &src, std::vector<char> &candidates) const;
+        bool empty() const { return states.size() == 1; }
+    };
+    automaton exact, folded;
+    std::vector<char> always;
+};
+
+#endif // REGEX_PREFILTER_H_INCLUDED
@@ -1,16 +1,22 @@
 #include <string>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <list>
+#include <numeric>
+#include <sys/stat.h>
 #include <duktape.h>
 #include <duk_module_node.h>
 
 #include "misc.h"
 #include "multithread.h"
 #include "nodeinfo.h"
+#include "speedtestutil.h"
 #include "socket.h"
 #include "webget.h"
+#include "script_duktape.h"
 
 extern int gCacheConfig;
-extern std::string gProxyConfig;
 
 std::string parseProxy(const std::string &source);
 
@@ -85,10 +91,42 @@ duk_ret_t cb_resolve_module(duk_context *ctx)
     return 1;  /*nrets*/
 }
 
+struct module_source
+{
+    time_t mtime = 0;
+    off_t size = 0;
+    std::string content;
+};
+
+static std::mutex module_cache_lock;
+static std::unordered_map<std::string, module_source> module_cache;
+
+/// module files are only read again after they have been modified
+static std::string getModuleSource(const std::string &path)
+{
+    struct stat st;
+    if(stat(path.data(), &st) != 0)
+        return fileGet(path, true);
+    {
+        guarded_mutex guard(module_cache_lock);
+        auto iter = module_cache.find(path);
+        if(iter != module_cache.end() && iter->second.mtime == st.st_mtime && iter->second.size == st.st_size)
+            return iter->second.content;
+    }
+    module_source source;
+    source.mtime = st.st_mtime;
+    source.size = st.st_size;
+    source.content = fileGet(path, true);
+    std::string content = source.content;
+    guarded_mutex guard(module_cache_lock);
+    module_cache[path] = std::move(source);
+    return content;
+}
+
 duk_ret_t cb_load_module(duk_context *ctx)
 {
     const char *resolved_id = duk_get_string(ctx, 0);
-    std::string module_source = fileGet(resolved_id, true);
+    std::string module_source = getModuleSource(resolved_id);
 
     /* Arrive at the JS source code for the module somehow. */
 
@@ -157,11 +195,8 @@ static duk_ret_t getGeoIP(duk_context *ctx)
     return 1;
 }
 
-duk_context *duktape_init()
+static void duktape_register(duk_context *ctx)
 {
-    duk_context *ctx = duk_create_heap_default();
-    if(!ctx)
-        return NULL;
     /// init module
     duk_push_object(ctx);
     duk_push_c_function(ctx, cb_resolve_module, DUK_VARARGS);
@@ -180,12 +215,121 @@ duk_context *duktape_init()
     duk_put_global_string(ctx, "btoa");
     duk_push_c_function(ctx, getGeoIP, DUK_VARARGS);
     duk_put_global_string(ctx, "geoip");
+}
+
+/// one heap per thread, destroyed when the thread exits
+struct duktape_thread_heap
+{
+    duk_context *heap = NULL;
+    duk_uarridx_t next_id = 0;
+
+    ~duktape_thread_heap()
+    {
+        if(heap)
+            duk_destroy_heap(heap);
+    }
+};
+
+static thread_local duktape_thread_heap thread_heap;
+
+duk_context *duktape_acquire()
+{
+    if(!thread_heap.heap && !(thread_heap.heap = duk_create_heap_default()))
+        return NULL;
+    duk_context *heap = thread_heap.heap;
+    duk_uarridx_t id = thread_heap.next_id++;
+    /// the context is a thread with its own globals, nothing a script defines survives its release
+    duk_push_thread_new_globalenv(heap);
+    duk_context *ctx = duk_get_context(heap, -1);
+    /// the heap stash keeps it alive, so contexts can be released in any order
+    duk_push_heap_stash(heap);
+    duk_dup(heap, -2);
+    duk_put_prop_index(heap, -2, id);
+    duk_pop_2(heap);
+    duktape_register(ctx);
+    duk_push_uint(ctx, id);
+    duk_put_global_string(ctx, DUK_HIDDEN_SYMBOL("id"));
     return ctx;
 }
 
+void duktape_release(duk_context *ctx)
+{
+    if(!ctx)
+        return;
+    duk_get_global_string(ctx, DUK_HIDDEN_SYMBOL("id"));
+    duk_uarridx_t id = duk_get_uint(ctx, -1);
+    duk_set_top(ctx, 0);
+    /// dropping the stash entry frees the thread along with its globals, done on the heap itself since ctx goes away
+    duk_context *heap = thread_heap.heap;
+    duk_push_heap_stash(heap);
+    duk_del_prop_index(heap, -1, id);
+    duk_pop(heap);
+}
+
+#define SCRIPT_CACHE_SIZE 256
+
+struct script_bytecode
+{
+    std::string source; /// to tell hash collisions apart
+    std::string bytecode;
+};
+
+typedef std::shared_ptr<const script_bytecode> script_bytecode_ptr;
+typedef std::list<size_t> script_lru_list;
+
+static std::mutex script_cache_lock;
+static script_lru_list script_cache_order;
+static std::unordered_map<size_t, std::pair<script_bytecode_ptr, script_lru_list::iterator>> script_cache;
+
+/// scripts are compiled once per content, later runs load the dumped bytecode
 int duktape_peval(duk_context *ctx, const std::string &script)
 {
-    return duk_peval_string(ctx, script.c_str());
+    size_t key = std::hash<std::string>()(script);
+    script_bytecode_ptr cached;
+    {
+        guarded_mutex guard(script_cache_lock);
+        auto iter = script_cache.find(key);
+        if(iter != script_cache.end() && iter->second.first->source == script)
+        {
+            script_cache_order.splice(script_cache_order.begin(), script_cache_order, iter->second.second);
+            cached = iter->second.first;
+        }
+    }
+    if(cached)
+    {
+        void *buffer = duk_push_fixed_buffer(ctx, cached->bytecode.size());
+        memcpy(buffer, cached->bytecode.data(), cached->bytecode.size());
+        duk_load_function(ctx);
+    }
+    else
+    {
+        if(duk_pcompile_lstring(ctx, 0, script.data(), script.size()) != 0)
+            return DUK_EXEC_ERROR;
+        duk_dup(ctx, -1);
+        duk_dump_function(ctx);
+        duk_size_t size = 0;
+        const char *data = reinterpret_cast<const char*>(duk_get_buffer_data(ctx, -1, &size));
+        script_bytecode_ptr entry = std::make_shared<const script_bytecode>(script_bytecode{script, std::string(data, size)});
+        duk_pop(ctx);
+        guarded_mutex guard(script_cache_lock);
+        auto iter = script_cache.find(key);
+        if(iter != script_cache.end()) /// compiled by another thread meanwhile, or a collision which the newer script replaces
+        {
+            iter->second.first = entry;
+            script_cache_order.splice(script_cache_order.begin(), script_cache_order, iter->second.second);
+        }
+        else
+        {
+            if(script_cache.size() >= SCRIPT_CACHE_SIZE)
+            {
+                script_cache.erase(script_cache_order.back());
+                script_cache_order.pop_back();
+            }
+            script_cache_order.push_front(key);
+            script_cache.emplace(key, std::make_pair(entry, script_cache_order.begin()));
+        }
+    }
+    return duk_pcall(ctx, 0);
 }
 
 int duktape_call_function(duk_context *ctx, const std::string &name, size_t nargs, ...)
@@ -207,19 +351,68 @@ int duktape_call_function(duk_context *ctx, const std::string &name, size_t narg
     return duk_pcall(ctx, nargs);
 }
 
-int duktape_push_nodeinfo(duk_context *ctx, const nodeInfo &node)
+/// Node objects only refer to their node through a slot of this table, which is emptied by duktape_unbind_nodes()
+/// after each call. A script that keeps a node object gets an error instead of a dangling node from ProxyInfo.
+static thread_local std::vector<const nodeInfo*> bound_nodes;
+static thread_local duk_uint_t bound_generation = 0;
+
+static void duktape_bind_node(duk_context *ctx, const nodeInfo &node, duk_idx_t obj_idx)
 {
-    duk_push_object(ctx);
+    obj_idx = duk_normalize_index(ctx, obj_idx);
+    duk_push_uint(ctx, bound_nodes.size());
+    duk_put_prop_string(ctx, obj_idx, DUK_HIDDEN_SYMBOL("slot"));
+    duk_push_uint(ctx, bound_generation);
+    duk_put_prop_string(ctx, obj_idx, DUK_HIDDEN_SYMBOL("generation"));
+    bound_nodes.push_back(&node);
+}
+
+void duktape_unbind_nodes()
+{
+    bound_nodes.clear();
+    bound_generation++;
+}
+
+/// ProxyInfo is serialized only when a script reads it
+static duk_ret_t getProxyInfo(duk_context *ctx)
+{
+    duk_push_this(ctx);
+    duk_get_prop_string(ctx, -1, DUK_HIDDEN_SYMBOL("slot"));
+    duk_get_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("generation"));
+    duk_uint_t slot = duk_get_uint(ctx, -2), generation = duk_get_uint(ctx, -1);
+    duk_pop_3(ctx);
+    if(generation != bound_generation || slot >= bound_nodes.size())
+        return duk_error(ctx, DUK_ERR_TYPE_ERROR, "ProxyInfo is only available during the call the node was passed to");
+    std::string proxy = proxyInfoToJson(*bound_nodes[slot]);
+    duk_push_lstring(ctx, proxy.c_str(), proxy.size());
+    return 1;
+}
+
+static void duktape_put_nodeinfo_fields(duk_context *ctx, const nodeInfo &node, duk_idx_t obj_idx)
+{
+    obj_idx = duk_normalize_index(ctx, obj_idx);
     duk_push_string(ctx, node.group.c_str());
-    duk_put_prop_string(ctx, -2, "Group");
+    duk_put_prop_string(ctx, obj_idx, "Group");
     duk_push_int(ctx, node.groupID);
-    duk_put_prop_string(ctx, -2, "GroupID");
+    duk_put_prop_string(ctx, obj_idx, "GroupID");
     duk_push_int(ctx, node.id);
-    duk_put_prop_string(ctx, -2, "Index");
+    duk_put_prop_string(ctx, obj_idx, "Index");
     duk_push_string(ctx, node.remarks.c_str());
-    duk_put_prop_string(ctx, -2, "Remark");
-    duk_push_string(ctx, node.proxyStr.c_str());
-    duk_put_prop_string(ctx, -2, "ProxyInfo");
+    duk_put_prop_string(ctx, obj_idx, "Remark");
+}
+
+static void duktape_push_nodeinfo_object(duk_context *ctx, const nodeInfo &node)
+{
+    duk_push_object(ctx);
+    duktape_put_nodeinfo_fields(ctx, node, -1);
+    duk_push_string(ctx, "ProxyInfo");
+    duk_push_c_function(ctx, getProxyInfo, 0);
+    duk_def_prop(ctx, -3, DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_SET_ENUMERABLE);
+}
+
+int duktape_push_nodeinfo(duk_context *ctx, const nodeInfo &node)
+{
+    duktape_push_nodeinfo_object(ctx, node);
+    duktape_bind_node(ctx, node, -1);
     return 0;
 }
 
@@ -238,12 +431,101 @@ int duktape_push_nodeinfo_arr(duk_context *ctx, const nodeInfo &node, duk_idx_t
     duk_push_string(ctx, "Remark");
     duk_push_string(ctx, node.remarks.c_str());
     duk_def_prop(ctx, index - 2, DUK_DEFPROP_HAVE_VALUE);
+    duktape_bind_node(ctx, node, index);
     duk_push_string(ctx, "ProxyInfo");
-    duk_push_string(ctx, node.proxyStr.c_str());
-    duk_def_prop(ctx, index - 2, DUK_DEFPROP_HAVE_VALUE);
+    duk_push_c_function(ctx, getProxyInfo, 0);
+    duk_def_prop(ctx, index - 2, DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_SET_ENUMERABLE);
     return 0;
 }
 
+DuktapeNodeList::~DuktapeNodeList()
+{
+    /// a list left behind by another thread goes away with that thread's heap
+    if(!heap || heap != thread_heap.heap)
+        return;
+    duk_push_heap_stash(heap);
+    duk_del_prop_index(heap, -1, id);
+    duk_pop(heap);
+}
+
+void DuktapeNodeList::push(duk_context *ctx, const std::vector<nodeInfo> &nodes)
+{
+    std::vector<size_t> index(nodes.size());
+    std::iota(index.begin(), index.end(), 0);
+    push(ctx, nodes, index);
+}
+
+void DuktapeNodeList::push(duk_context *ctx, const std::vector<nodeInfo> &nodes, const std::vector<size_t> &index)
+{
+    duk_idx_t arr_idx = duk_push_array(ctx), stash_idx, cache_idx;
+    if(!heap && (heap = thread_heap.heap))
+        id = thread_heap.next_id++;
+    if(!heap || heap != thread_heap.heap) /// objects cannot be shared with contexts of other heaps
+    {
+        for(size_t i = 0; i < index.size(); i++)
+        {
+            duktape_push_nodeinfo(ctx, nodes[index[i]]);
+            duk_put_prop_index(ctx, arr_idx, i);
+        }
+        return;
+    }
+    duk_push_heap_stash(ctx);
+    stash_idx = duk_get_top(ctx) - 1;
+    if(!built || count != nodes.size())
+    {
+        cache_idx = duk_push_array(ctx);
+        for(size_t i = 0; i < nodes.size(); i++)
+        {
+            duktape_push_nodeinfo_object(ctx, nodes[i]);
+            duk_put_prop_index(ctx, cache_idx, i);
+        }
+        duk_put_prop_index(ctx, stash_idx, id);
+        count = nodes.size();
+        built = true;
+    }
+    duk_get_prop_index(ctx, stash_idx, id);
+    cache_idx = duk_get_top(ctx) - 1;
+    for(size_t i = 0; i < index.size(); i++)
+    {
+        /// earlier hooks may have changed the nodes, and scripts the objects
+        duk_get_prop_index(ctx, cache_idx, index[i]);
+        duktape_put_nodeinfo_fields(ctx, nodes[index[i]], -1);
+        duktape_bind_node(ctx, nodes[index[i]], -1);
+        duk_put_prop_index(ctx, arr_idx, i);
+    }
+    duk_pop_2(ctx);
+}
+
+void DuktapeNodeList::remove(const std::vector<char> &keep)
+{
+    if(!built || heap != thread_heap.heap || keep.size() != count)
+    {
+        built = false;
+        return;
+    }
+    duk_push_heap_stash(heap);
+    duk_get_prop_index(heap, -1, id);
+    duk_push_array(heap);
+    count = 0;
+    for(size_t i = 0; i < keep.size(); i++)
+    {
+        if(!keep[i])
+            continue;
+        duk_get_prop_index(heap, -2, i);
+        duk_put_prop_index(heap, -2, count++);
+    }
+    duk_put_prop_index(heap, -3, id);
+    duk_pop_2(heap);
+}
+
+bool duktape_has_function(duk_context *ctx, const std::string &name)
+{
+    duk_get_global_string(ctx, name.c_str());
+    bool result = duk_is_function(ctx, -1);
+    duk_pop(ctx);
+    return result;
+}
+
 int duktape_get_res_int(duk_context *ctx)
 {
     int retval = duk_to_int(ctx, -1);
@@ -267,6 +549,34 @@ bool duktape_get_res_bool(duk_context *ctx)
     return ret;
 }
 
+void duktape_get_res_bool_list(duk_context *ctx, std::vector<char> &result)
+{
+    if(duk_is_object(ctx, -1))
+    {
+        for(size_t i = 0; i < result.size(); i++)
+        {
+            if(duk_get_prop_index(ctx, -1, i))
+                result[i] = duk_to_boolean(ctx, -1);
+            duk_pop(ctx);
+        }
+    }
+    duk_pop(ctx);
+}
+
+void duktape_get_res_str_list(duk_context *ctx, string_array &result)
+{
+    if(duk_is_object(ctx, -1))
+    {
+        for(size_t i = 0; i < result.size(); i++)
+        {
+            if(duk_get_prop_index(ctx, -1, i) && !duk_is_null_or_undefined(ctx, -1))
+                result[i] = duk_safe_to_string(ctx, -1);
+            duk_pop(ctx);
+        }
+    }
+    duk_pop(ctx);
+}
+
 std::string duktape_get_err_stack(duk_context *ctx)
 {
     duk_get_prop_string(ctx, -1, "stack");
@@ -2,18 +2,52 @@
 #define SCRIPT_DUKTAPE_H_INCLUDED
 
 #include <string>
+#include <vector>
 #include <duktape.h>
 
+#include "misc.h"
 #include "nodeinfo.h"
 
-duk_context *duktape_init();
+/// Context with fresh globals in the heap of the calling thread, return it with duktape_release on the same thread.
+/// Contexts of one thread share the heap, so values can be passed between them.
+duk_context *duktape_acquire();
+void duktape_release(duk_context *ctx);
+/// Pushed nodes are bound to the objects until duktape_unbind_nodes() is called, which has to be done after each call
 int duktape_push_nodeinfo(duk_context *ctx, const nodeInfo &node);
 int duktape_push_nodeinfo_arr(duk_context *ctx, const nodeInfo &node, duk_idx_t index = -1);
+void duktape_unbind_nodes();
 int duktape_peval(duk_context *ctx, const std::string &script);
+bool duktape_has_function(duk_context *ctx, const std::string &name);
 int duktape_call_function(duk_context *ctx, const std::string &name, size_t nargs, ...);
 int duktape_get_res_int(duk_context *ctx);
 std::string duktape_get_res_str(duk_context *ctx);
 bool duktape_get_res_bool(duk_context *ctx);
+/// Read the array returned by a batch function, items it does not have keep their current value
+void duktape_get_res_bool_list(duk_context *ctx, std::vector<char> &result);
+void duktape_get_res_str_list(duk_context *ctx, string_array &result);
 std::string duktape_get_err_stack(duk_context *ctx);
 
+/// Node objects of one conversion, built once in the heap of the calling thread and shared by the batch functions
+/// filterAll/renameAll/getEmojiAll of all scripts. Objects follow the node list by position, their fields are
+/// written again and the nodes bound whenever they are pushed.
+class DuktapeNodeList
+{
+public:
+    DuktapeNodeList() = default;
+    DuktapeNodeList(const DuktapeNodeList&) = delete;
+    DuktapeNodeList &operator=(const DuktapeNodeList&) = delete;
+    ~DuktapeNodeList();
+    /// push one array with the objects of nodes[index[0]], nodes[index[1]]...
+    void push(duk_context *ctx, const std::vector<nodeInfo> &nodes, const std::vector<size_t> &index);
+    void push(duk_context *ctx, const std::vector<nodeInfo> &nodes);
+    /// drop the objects of the nodes removed from the list, keep[i] tells whether nodes[i] stays
+    void remove(const std::vector<char> &keep);
+
+private:
+    duk_context *heap = NULL;
+    duk_uarridx_t id = 0;
+    size_t count = 0;
+    bool built = false;
+};
+
 #endif // SCRIPT_DUKTAPE_H_INCLUDED
@@ -2,10 +2,14 @@
 #include <algorithm>
 #include <cmath>
 #include <time.h>
+#include <string.h>
+#include <atomic>
 
 #define PCRE2_CODE_UNIT_WIDTH 8
 #include <pcre2.h>
 
+#include <yaml-cpp/eventhandler.h>
+
 #include "yamlcpp_extra.h"
 #include "misc.h"
 #include "printout.h"
@@ -13,8 +17,8 @@
 #include "speedtestutil.h"
 #include "webget.h"
 #include "rapidjson_extra.h"
-#include "ini_reader.h"
 #include "string_hash.h"
+#include "multithread.h"
 
 using namespace rapidjson;
 using namespace YAML;
@@ -27,33 +31,79 @@ std::string modSSMD5 = "f7653207090ce3389115e9c88541afe0";
 
 //remake from speedtestutil
 
-void explodeVmess(std::string vmess, const std::string &custom_port, nodeInfo &node)
+/// scratch buffer of the link decoders, reused by every link a thread explodes
+static thread_local std::string link_buffer;
+/// vmess JSON is parsed in situ, its values come from this pool which is reset after each link
+static thread_local char json_pool_buffer[4096];
+static thread_local MemoryPoolAllocator<> json_allocator(json_pool_buffer, sizeof(json_pool_buffer));
+
+#define LINK_ARGS_MAX 32
+
+/// query arguments of a link scanned once, lookups return the last occurrence like getUrlArg
+struct link_args
+{
+    std::pair<std::string_view, std::string_view> items[LINK_ARGS_MAX];
+    size_t count = 0;
+
+    link_args(std::string_view query)
+    {
+        while(query.size() && count < LINK_ARGS_MAX)
+        {
+            string_size end = query.find('&'), pos_equal;
+            std::string_view item = query.substr(0, end);
+            pos_equal = item.find('=');
+            if(pos_equal != item.npos)
+                items[count++] = std::make_pair(item.substr(0, pos_equal), item.substr(pos_equal + 1));
+            if(end == query.npos)
+                break;
+            query.remove_prefix(end + 1);
+        }
+    }
+
+    std::string_view get(std::string_view name) const
+    {
+        for(size_t i = count; i > 0; i--)
+            if(items[i - 1].first == name)
+                return items[i - 1].second;
+        return std::string_view();
+    }
+};
+
+static inline void removeSpaces(std::string &str)
+{
+    str.erase(std::remove_if(str.begin(), str.end(), [](unsigned char c){ return isspace(c); }), str.end());
+}
+
+void explodeVmess(std::string_view vmess, const std::string &custom_port, nodeInfo &node)
 {
     std::string version, ps, add, port, type, id, aid, net, path, host, tls;
-    Document jsondata;
     std::vector<std::string> vArray;
-    if(regMatch(vmess, "vmess://(.*?)@(.*)"))
+    bool is_vmess = vmess.compare(0, 8, "vmess://") == 0;
+    if(is_vmess && vmess.find('@', 8) != vmess.npos)
     {
-        explodeStdVMess(vmess, custom_port, node);
+        explodeStdVMess(std::string(vmess), custom_port, node);
         return;
     }
-    else if(regMatch(vmess, "vmess://(.*?)\\?(.*)")) //shadowrocket style link
+    else if(is_vmess && vmess.find('?', 8) != vmess.npos) //shadowrocket style link
     {
-        explodeShadowrocket(vmess, custom_port, node);
+        explodeShadowrocket(std::string(vmess), custom_port, node);
         return;
     }
-    else if(regMatch(vmess, "vmess1://(.*?)\\?(.*)")) //kitsunebi style link
+    else if(vmess.compare(0, 9, "vmess1://") == 0 && vmess.find('?', 9) != vmess.npos) //kitsunebi style link
     {
-        explodeKitsunebi(vmess, custom_port, node);
+        explodeKitsunebi(std::string(vmess), custom_port, node);
         return;
     }
-    vmess = urlsafe_base64_decode(regReplace(vmess, "(vmess|vmess1)://", ""));
-    if(regMatch(vmess, "(.*?) = (.*)"))
+    string_size pos = vmess.find("://");
+    urlsafe_base64_decode(pos != vmess.npos ? vmess.substr(pos + 3) : vmess, link_buffer);
+    if(link_buffer.find(" = ") != link_buffer.npos && link_buffer.find('\n') == link_buffer.npos)
     {
-        explodeQuan(vmess, custom_port, node);
+        explodeQuan(link_buffer, custom_port, node);
         return;
     }
-    jsondata.Parse(vmess.data());
+    defer(json_allocator.Clear();)
+    Document jsondata(&json_allocator);
+    jsondata.ParseInsitu(&link_buffer[0]);
     if(jsondata.HasParseError())
         return;
 
@@ -96,158 +146,119 @@ void explodeVmess(std::string vmess, const std::string &custom_port, nodeInfo &n
     node.remarks = ps;
     node.server = add;
     node.port = to_int(port, 1);
-    node.proxyStr = vmessConstruct(node.group, ps, add, port, type, id, aid, net, "auto", path, host, "", tls);
+    node.proxy = vmessConstruct(add, port, type, id, aid, net, "auto", path, host, "", tls);
 }
 
 void explodeVmessConf(std::string content, const std::string &custom_port, bool libev, std::vector<nodeInfo> &nodes)
 {
-    nodeInfo node;
-    Document json;
-    rapidjson::Value nodejson, settings;
-    std::string group, ps, add, port, type, id, aid, net, path, host, edge, tls, cipher, subid;
-    tribool udp, tfo, scv;
-    int configType, index = nodes.size();
-    std::map<std::string, std::string> subdata;
-    std::map<std::string, std::string>::iterator iter;
+    nodeInfo single;
+    size_t start = nodes.size();
+    int index = nodes.size();
+    bool first_outbound = true;
     std::string streamset = "streamSettings", tcpset = "tcpSettings", wsset = "wsSettings";
     regGetMatch(content, "((?i)streamsettings)", 2, 0, &streamset);
     regGetMatch(content, "((?i)tcpsettings)", 2, 0, &tcpset);
     regGetMatch(content, "((?1)wssettings)", 2, 0, &wsset);
 
-    json.Parse(content.data());
-    if(json.HasParseError())
-        return;
-    try
+    JsonEntryReader reader({"outbounds", "vmess"}, [&](const std::string &section, string_map &json)
     {
-        if(json.HasMember("outbounds")) //single config
+        nodeInfo node;
+        std::string group, ps, add, port, type, id, aid, net, path, host, edge, tls, cipher, settings;
+        tribool udp, tfo, scv;
+        int configType;
+        if(section == "outbounds") //single config, only the first outbound is used
         {
-            if(json["outbounds"].Size() > 0 && json["outbounds"][0].HasMember("settings") && json["outbounds"][0]["settings"].HasMember("vnext") && json["outbounds"][0]["settings"]["vnext"].Size() > 0)
+            if(!first_outbound)
+                return;
+            first_outbound = false;
+            if(!json.count("settings.vnext.0"))
+                return;
+            add = GetMember(json, "settings.vnext.0.address");
+            port = custom_port.size() ? custom_port : GetMember(json, "settings.vnext.0.port");
+            if(port == "0")
+                return;
+            if(json.count("settings.vnext.0.users.0"))
             {
-                nodejson = json["outbounds"][0];
-                add = GetMember(nodejson["settings"]["vnext"][0], "address");
-                port = custom_port.size() ? custom_port : GetMember(nodejson["settings"]["vnext"][0], "port");
-                if(port == "0")
-                    return;
-                if(nodejson["settings"]["vnext"][0]["users"].Size())
+                id = GetMember(json, "settings.vnext.0.users.0.id");
+                aid = GetMember(json, "settings.vnext.0.users.0.alterId");
+                cipher = GetMember(json, "settings.vnext.0.users.0.security");
+            }
+            if(json.count(streamset))
+            {
+                net = GetMember(json, streamset + ".network");
+                tls = GetMember(json, streamset + ".security");
+                if(net == "ws")
                 {
-                    id = GetMember(nodejson["settings"]["vnext"][0]["users"][0], "id");
-                    aid = GetMember(nodejson["settings"]["vnext"][0]["users"][0], "alterId");
-                    cipher = GetMember(nodejson["settings"]["vnext"][0]["users"][0], "security");
+                    settings = streamset + "." + wsset + ".";
+                    path = GetMember(json, settings + "path");
+                    host = GetMember(json, settings + "headers.Host");
+                    edge = GetMember(json, settings + "headers.Edge");
                 }
-                if(nodejson.HasMember(streamset.data()))
+                settings = streamset + "." + tcpset + ".header.";
+                type = GetMember(json, settings + "type");
+                if(type == "http")
                 {
-                    net = GetMember(nodejson[streamset.data()], "network");
-                    tls = GetMember(nodejson[streamset.data()], "security");
-                    if(net == "ws")
-                    {
-                        if(nodejson[streamset.data()].HasMember(wsset.data()))
-                            settings = nodejson[streamset.data()][wsset.data()];
-                        else
-                            settings.RemoveAllMembers();
-                        path = GetMember(settings, "path");
-                        if(settings.HasMember("headers"))
-                        {
-                            host = GetMember(settings["headers"], "Host");
-                            edge = GetMember(settings["headers"], "Edge");
-                        }
-                    }
-                    if(nodejson[streamset.data()].HasMember(tcpset.data()))
-                        settings = nodejson[streamset.data()][tcpset.data()];
-                    else
-                        settings.RemoveAllMembers();
-                    if(settings.IsObject() && settings.HasMember("header"))
+                    if(json.count(settings + "request.path.0"))
+                        path = GetMember(json, settings + "request.path.0");
+                    if(json.count(settings + "request.headers"))
                     {
-                        type = GetMember(settings["header"], "type");
-                        if(type == "http")
-                        {
-                            if(settings["header"].HasMember("request"))
-                            {
-                                if(settings["header"]["request"].HasMember("path") && settings["header"]["request"]["path"].Size())
-                                    settings["header"]["request"]["path"][0] >> path;
-                                if(settings["header"]["request"].HasMember("headers"))
-                                {
-                                    host = GetMember(settings["header"]["request"]["headers"], "Host");
-                                    edge = GetMember(settings["header"]["request"]["headers"], "Edge");
-                                }
-                            }
-                        }
+                        host = GetMember(json, settings + "request.headers.Host");
+                        edge = GetMember(json, settings + "request.headers.Edge");
                     }
                 }
-                node.linkType = SPEEDTEST_MESSAGE_FOUNDVMESS;
-                node.group = V2RAY_DEFAULT_GROUP;
-                node.remarks = add + ":" + port;
-                node.server = add;
-                node.port = to_int(port, 1);
-                node.proxyStr = vmessConstruct(node.group, node.remarks, add, port, type, id, aid, net, cipher, path, host, edge, tls, udp, tfo, scv);
-                nodes.emplace_back(std::move(node));
-                node = nodeInfo();
             }
+            single.linkType = SPEEDTEST_MESSAGE_FOUNDVMESS;
+            single.group = V2RAY_DEFAULT_GROUP;
+            single.remarks = add + ":" + port;
+            single.server = add;
+            single.port = to_int(port, 1);
+            single.proxy = vmessConstruct(add, port, type, id, aid, net, cipher, path, host, edge, tls, udp, tfo, scv);
             return;
         }
-    }
-    catch(std::exception & e)
-    {
-        writeLog(0, "VMessConf parser throws an error. Leaving...", LOG_LEVEL_WARNING);
-        return;
-        //ignore
-    }
-    //read all subscribe remark as group name
-    for(unsigned int i = 0; i < json["subItem"].Size(); i++)
-        subdata.insert(std::pair<std::string, std::string>(json["subItem"][i]["id"].GetString(), json["subItem"][i]["remarks"].GetString()));
 
-    for(unsigned int i = 0; i < json["vmess"].Size(); i++)
-    {
-        if(json["vmess"][i]["address"].IsNull() || json["vmess"][i]["port"].IsNull() || json["vmess"][i]["id"].IsNull())
-            continue;
+        if(!json.count("address") || !json.count("port") || !json.count("id"))
+            return;
 
         //common info
-        json["vmess"][i]["remarks"] >> ps;
-        json["vmess"][i]["address"] >> add;
-        port = custom_port.size() ? custom_port : GetMember(json["vmess"][i], "port");
+        ps = GetMember(json, "remarks");
+        add = GetMember(json, "address");
+        port = custom_port.size() ? custom_port : GetMember(json, "port");
         if(port == "0")
-            continue;
-        json["vmess"][i]["subid"] >> subid;
-
-        if(subid.size())
-        {
-            iter = subdata.find(subid);
-            if(iter != subdata.end())
-                group = iter->second;
-        }
+            return;
         if(ps.empty())
             ps = add + ":" + port;
 
-        scv = GetMember(json["vmess"][i], "allowInsecure");
-        json["vmess"][i]["configType"] >> configType;
+        scv = GetMember(json, "allowInsecure");
+        configType = to_int(GetMember(json, "configType"));
         switch(configType)
         {
         case 1: //vmess config
-            json["vmess"][i]["headerType"] >> type;
-            json["vmess"][i]["id"] >> id;
-            json["vmess"][i]["alterId"] >> aid;
-            json["vmess"][i]["network"] >> net;
-            json["vmess"][i]["path"] >> path;
-            json["vmess"][i]["requestHost"] >> host;
-            json["vmess"][i]["streamSecurity"] >> tls;
-            json["vmess"][i]["security"] >> cipher;
+            type = GetMember(json, "headerType");
+            id = GetMember(json, "id");
+            aid = GetMember(json, "alterId");
+            net = GetMember(json, "network");
+            path = GetMember(json, "path");
+            host = GetMember(json, "requestHost");
+            tls = GetMember(json, "streamSecurity");
+            cipher = GetMember(json, "security");
             group = V2RAY_DEFAULT_GROUP;
             node.linkType = SPEEDTEST_MESSAGE_FOUNDVMESS;
-            node.proxyStr = vmessConstruct(group, ps, add, port, type, id, aid, net, cipher, path, host, "", tls, udp, tfo, scv);
+            node.proxy = vmessConstruct(add, port, type, id, aid, net, cipher, path, host, "", tls, udp, tfo, scv);
             break;
         case 3: //ss config
-            json["vmess"][i]["id"] >> id;
-            json["vmess"][i]["security"] >> cipher;
+            id = GetMember(json, "id");
+            cipher = GetMember(json, "security");
             group = SS_DEFAULT_GROUP;
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
-            node.proxyStr = ssConstruct(group, ps, add, port, id, cipher, "", "", libev, udp, tfo, scv);
+            node.proxy = ssConstruct(add, port, id, cipher, "", "", libev, udp, tfo, scv);
             break;
         case 4: //socks config
             group = SOCKS_DEFAULT_GROUP;
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSOCKS;
-            node.proxyStr = socksConstruct(group, ps, add, port, "", "", udp, tfo, scv);
+            node.proxy = socksConstruct(add, port, "", "", udp, tfo, scv);
             break;
         default:
-            continue;
+            return;
         }
 
         node.group = group;
@@ -256,43 +267,71 @@ void explodeVmessConf(std::string content, const std::string &custom_port, bool
         node.server = add;
         node.port = to_int(port, 1);
         nodes.emplace_back(std::move(node));
-        node = nodeInfo();
-    }
-    return;
+    });
+
+    //a broken file yields no nodes, a single config ignores any subscription entries
+    if(!reader.Parse(content) || reader.root.count("outbounds"))
+        nodes.resize(start);
+    if(reader.root.count("outbounds") && single.linkType == SPEEDTEST_MESSAGE_FOUNDVMESS)
+        nodes.emplace_back(std::move(single));
 }
 
-void explodeSS(std::string ss, bool libev, const std::string &custom_port, nodeInfo &node)
+void explodeSS(std::string_view ss, bool libev, const std::string &custom_port, nodeInfo &node)
 {
-    std::string ps, password, method, server, port, plugins, plugin, pluginopts, addition, group = SS_DEFAULT_GROUP, secret;
-    //std::vector<std::string> args, secret;
-    ss = replace_all_distinct(ss.substr(5), "/?", "?");
-    if(strFind(ss, "#"))
+    std::string ps, password, method, server, port, plugins, plugin, pluginopts, group = SS_DEFAULT_GROUP;
+    string_size pos, pos_method, pos_at, pos_port;
+    std::string_view decoded;
+    ss.remove_prefix(5);
+    pos = ss.find('#');
+    if(pos != ss.npos)
     {
-        ps = UrlDecode(ss.substr(ss.find("#") + 1));
-        ss.erase(ss.find("#"));
+        ps = UrlDecode(ss.substr(pos + 1));
+        ss = ss.substr(0, pos);
     }
 
-    if(strFind(ss, "?"))
+    pos = ss.find('?');
+    if(pos != ss.npos)
     {
-        addition = ss.substr(ss.find("?") + 1);
-        plugins = UrlDecode(getUrlArg(addition, "plugin"));
+        link_args args(ss.substr(pos + 1));
+        plugins = UrlDecode(args.get("plugin"));
         plugin = plugins.substr(0, plugins.find(";"));
         pluginopts = plugins.substr(plugins.find(";") + 1);
-        if(getUrlArg(addition, "group").size())
-            group = urlsafe_base64_decode(getUrlArg(addition, "group"));
-        ss.erase(ss.find("?"));
+        if(args.get("group").size())
+            urlsafe_base64_decode(args.get("group"), group);
+        ss = ss.substr(0, pos && ss[pos - 1] == '/' ? pos - 1 : pos); //both "?" and "/?" are accepted
     }
-    if(strFind(ss, "@"))
+    pos_at = ss.find('@');
+    if(pos_at != ss.npos)
     {
-        if(regGetMatch(ss, "(.*?)@(.*):(.*)", 4, 0, &secret, &server, &port))
+        //secret@server:port
+        pos_port = ss.rfind(':');
+        if(pos_port == ss.npos || pos_port < pos_at)
             return;
-        if(regGetMatch(urlsafe_base64_decode(secret), "(.*?):(.*)", 3, 0, &method, &password))
+        server = ss.substr(pos_at + 1, pos_port - pos_at - 1);
+        port = ss.substr(pos_port + 1);
+        urlsafe_base64_decode(ss.substr(0, pos_at), link_buffer);
+        pos_method = link_buffer.find(':');
+        if(pos_method == link_buffer.npos)
             return;
+        method = link_buffer.substr(0, pos_method);
+        password = link_buffer.substr(pos_method + 1);
     }
     else
     {
-        if(regGetMatch(urlsafe_base64_decode(ss), "(.*?):(.*)@(.*):(.*)", 5, 0, &method, &password, &server, &port))
+        //method:password@server:port
+        urlsafe_base64_decode(ss, link_buffer);
+        decoded = link_buffer;
+        pos_method = decoded.find(':');
+        pos_port = decoded.rfind(':');
+        if(pos_method == decoded.npos || !pos_port)
+            return;
+        pos_at = decoded.rfind('@', pos_port - 1);
+        if(pos_at == decoded.npos || pos_at < pos_method)
             return;
+        method = decoded.substr(0, pos_method);
+        password = decoded.substr(pos_method + 1, pos_at - pos_method - 1);
+        server = decoded.substr(pos_at + 1, pos_port - pos_at - 1);
+        port = decoded.substr(pos_port + 1);
     }
     if(custom_port.size())
         port = custom_port;
@@ -306,7 +345,7 @@ void explodeSS(std::string ss, bool libev, const std::string &custom_port, nodeI
     node.remarks = ps;
     node.server = server;
     node.port = to_int(port, 1);
-    node.proxyStr = ssConstruct(group, ps, server, port, password, method, plugin, pluginopts, libev);
+    node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, libev);
 }
 
 void explodeSSD(std::string link, bool libev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
@@ -385,7 +424,7 @@ void explodeSSD(std::string link, bool libev, const std::string &custom_port, st
         node.remarks = remarks;
         node.server = server;
         node.port = to_int(port, 1);
-        node.proxyStr = ssConstruct(group, remarks, server, port, password, method, plugin, pluginopts, libev);
+        node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, libev);
         node.id = index;
         nodes.emplace_back(std::move(node));
         node = nodeInfo();
@@ -396,33 +435,28 @@ void explodeSSD(std::string link, bool libev, const std::string &custom_port, st
 
 void explodeSSAndroid(std::string ss, bool libev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
 {
-    std::string ps, password, method, server, port, group = SS_DEFAULT_GROUP;
-    std::string plugin, pluginopts;
-
-    Document json;
-    nodeInfo node;
+    size_t start = nodes.size();
     int index = nodes.size();
-    //first add some extra data before parsing
-    ss = "{\"nodes\":" + ss + "}";
-    json.Parse(ss.data());
-    if(json.HasParseError())
-        return;
 
-    for(unsigned int i = 0; i < json["nodes"].Size(); i++)
+    JsonEntryReader reader({""}, [&](const std::string &, string_map &json)
     {
-        server = GetMember(json["nodes"][i], "server");
+        std::string ps, password, method, server, port, group = SS_DEFAULT_GROUP;
+        std::string plugin, pluginopts;
+        nodeInfo node;
+
+        server = GetMember(json, "server");
         if(server.empty())
-            continue;
-        ps = GetMember(json["nodes"][i], "remarks");
-        port = custom_port.size() ? custom_port : GetMember(json["nodes"][i], "server_port");
+            return;
+        ps = GetMember(json, "remarks");
+        port = custom_port.size() ? custom_port : GetMember(json, "server_port");
         if(port == "0")
-            continue;
+            return;
         if(ps.empty())
             ps = server + ":" + port;
-        password = GetMember(json["nodes"][i], "password");
-        method = GetMember(json["nodes"][i], "method");
-        plugin = GetMember(json["nodes"][i], "plugin");
-        pluginopts = GetMember(json["nodes"][i], "plugin_opts");
+        password = GetMember(json, "password");
+        method = GetMember(json, "method");
+        plugin = GetMember(json, "plugin");
+        pluginopts = GetMember(json, "plugin_opts");
 
         node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
         node.id = index;
@@ -430,77 +464,100 @@ void explodeSSAndroid(std::string ss, bool libev, const std::string &custom_port
         node.remarks = ps;
         node.server = server;
         node.port = to_int(port, 1);
-        node.proxyStr = ssConstruct(group, ps, server, port, password, method, plugin, pluginopts, libev);
+        node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, libev);
         nodes.emplace_back(std::move(node));
-        node = nodeInfo();
         index++;
-    }
+    });
+    if(!reader.Parse(ss))
+        nodes.resize(start);
 }
 
 void explodeSSConf(std::string content, const std::string &custom_port, bool libev, std::vector<nodeInfo> &nodes)
 {
-    nodeInfo node;
-    Document json;
-    std::string ps, password, method, server, port, plugin, pluginopts, group = SS_DEFAULT_GROUP;
+    std::string server, group = SS_DEFAULT_GROUP;
+    std::vector<nodeInfo> servers, configs;
     int index = nodes.size();
 
-    json.Parse(content.data());
-    if(json.HasParseError())
-        return;
-    const char *section = json.HasMember("version") && json.HasMember("remarks") && json.HasMember("servers") ? "servers" : "configs";
-    if(!json.HasMember(section))
-        return;
-    GetMember(json, "remarks", group);
-
-    for(unsigned int i = 0; i < json[section].Size(); i++)
+    //the keys choosing between both sections may come after them, so nodes of each are kept apart
+    JsonEntryReader reader({"servers", "configs"}, [&](const std::string &section, string_map &json)
     {
-        ps = GetMember(json[section][i], "remarks");
-        port = custom_port.size() ? custom_port : GetMember(json[section][i], "server_port");
+        nodeInfo node;
+        std::string ps, password, method, port, plugin, pluginopts;
+        ps = GetMember(json, "remarks");
+        port = custom_port.size() ? custom_port : GetMember(json, "server_port");
         if(port == "0")
-            continue;
+            return;
         if(ps.empty())
             ps = server + ":" + port;
 
-        password = GetMember(json[section][i], "password");
-        method = GetMember(json[section][i], "method");
-        server = GetMember(json[section][i], "server");
-        plugin = GetMember(json[section][i], "plugin");
-        pluginopts = GetMember(json[section][i], "plugin_opts");
+        password = GetMember(json, "password");
+        method = GetMember(json, "method");
+        server = GetMember(json, "server");
+        plugin = GetMember(json, "plugin");
+        pluginopts = GetMember(json, "plugin_opts");
 
         node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
-        node.group = group;
         node.remarks = ps;
-        node.id = index;
         node.server = server;
         node.port = to_int(port, 1);
-        node.proxyStr = ssConstruct(group, ps, server, port, password, method, plugin, pluginopts, libev);
+        node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, libev);
+        (section == "servers" ? servers : configs).emplace_back(std::move(node));
+    });
+    if(!reader.Parse(content))
+        return;
+    const string_map &json = reader.root;
+    std::vector<nodeInfo> &section = json.count("version") && json.count("remarks") && json.count("servers") ? servers : configs;
+    GetMember(json, "remarks", group);
+
+    for(nodeInfo &node : section)
+    {
+        node.group = group;
+        node.id = index;
         nodes.emplace_back(std::move(node));
-        node = nodeInfo();
         index++;
     }
     return;
 }
 
-void explodeSSR(std::string ssr, bool ss_libev, bool ssr_libev, const std::string &custom_port, nodeInfo &node)
+void explodeSSR(std::string_view ssr, bool ss_libev, bool ssr_libev, const std::string &custom_port, nodeInfo &node)
 {
-    std::string strobfs;
-    std::string remarks, group, server, port, method, password, protocol, protoparam, obfs, obfsparam, remarks_base64;
-    ssr = replace_all_distinct(ssr.substr(6), "\r", "");
-    ssr = urlsafe_base64_decode(ssr);
-    if(strFind(ssr, "/?"))
+    std::string remarks, group, server, port, method, password, protocol, protoparam, obfs, obfsparam;
+    std::string_view decoded;
+    string_size pos, colons[5];
+    ssr.remove_prefix(6);
+    if(ssr.find('\r') != ssr.npos)
+        urlsafe_base64_decode(replace_all_distinct(std::string(ssr), "\r", ""), link_buffer);
+    else
+        urlsafe_base64_decode(ssr, link_buffer);
+    decoded = link_buffer;
+    pos = decoded.find("/?");
+    if(pos != decoded.npos)
     {
-        strobfs = ssr.substr(ssr.find("/?") + 2);
-        ssr = ssr.substr(0, ssr.find("/?"));
-        group = urlsafe_base64_decode(getUrlArg(strobfs, "group"));
-        remarks = urlsafe_base64_decode(getUrlArg(strobfs, "remarks"));
-        remarks_base64 = urlsafe_base64_reverse(getUrlArg(strobfs, "remarks"));
-        obfsparam = regReplace(urlsafe_base64_decode(getUrlArg(strobfs, "obfsparam")), "\\s", "");
-        protoparam = regReplace(urlsafe_base64_decode(getUrlArg(strobfs, "protoparam")), "\\s", "");
+        link_args args(decoded.substr(pos + 2));
+        decoded = decoded.substr(0, pos);
+        urlsafe_base64_decode(args.get("group"), group);
+        urlsafe_base64_decode(args.get("remarks"), remarks);
+        urlsafe_base64_decode(args.get("obfsparam"), obfsparam);
+        urlsafe_base64_decode(args.get("protoparam"), protoparam);
+        removeSpaces(obfsparam);
+        removeSpaces(protoparam);
     }
 
-    if(regGetMatch(ssr, "(.*):(.*?):(.*?):(.*?):(.*?):(.*)", 7, 0, &server, &port, &protocol, &method, &obfs, &password))
-        return;
-    password = urlsafe_base64_decode(password);
+    //server:port:protocol:method:obfs:password, the server may contain colons itself
+    pos = decoded.size();
+    for(int i = 4; i >= 0; i--)
+    {
+        pos = pos ? decoded.rfind(':', pos - 1) : decoded.npos;
+        if(pos == decoded.npos)
+            return;
+        colons[i] = pos;
+    }
+    server = decoded.substr(0, colons[0]);
+    port = decoded.substr(colons[0] + 1, colons[1] - colons[0] - 1);
+    protocol = decoded.substr(colons[1] + 1, colons[2] - colons[1] - 1);
+    method = decoded.substr(colons[2] + 1, colons[3] - colons[2] - 1);
+    obfs = decoded.substr(colons[3] + 1, colons[4] - colons[3] - 1);
+    urlsafe_base64_decode(decoded.substr(colons[4] + 1), password);
     if(custom_port.size())
         port = custom_port;
     if(port == "0")
@@ -509,10 +566,7 @@ void explodeSSR(std::string ssr, bool ss_libev, bool ssr_libev, const std::strin
     if(group.empty())
         group = SSR_DEFAULT_GROUP;
     if(remarks.empty())
-    {
         remarks = server + ":" + port;
-        remarks_base64 = base64_encode(remarks);
-    }
 
     node.group = group;
     node.remarks = remarks;
@@ -521,28 +575,64 @@ void explodeSSR(std::string ssr, bool ss_libev, bool ssr_libev, const std::strin
     if(find(ss_ciphers.begin(), ss_ciphers.end(), method) != ss_ciphers.end() && (obfs.empty() || obfs == "plain") && (protocol.empty() || protocol == "origin"))
     {
         node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
-        node.proxyStr = ssConstruct(group, remarks, server, port, password, method, "", "", ss_libev);
+        node.proxy = ssConstruct(server, port, password, method, "", "", ss_libev);
     }
     else
     {
         node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
-        node.proxyStr = ssrConstruct(group, remarks, remarks_base64, server, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev);
+        node.proxy = ssrConstruct(server, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev);
     }
 }
 
 void explodeSSRConf(std::string content, const std::string &custom_port, bool ss_libev, bool ssr_libev, std::vector<nodeInfo> &nodes)
 {
     nodeInfo node;
-    Document json;
-    std::string remarks, remarks_base64, group, server, port, method, password, protocol, protoparam, obfs, obfsparam, plugin, pluginopts;
+    std::string remarks, group, server, port, method, password, protocol, protoparam, obfs, obfsparam, plugin, pluginopts;
+    size_t start = nodes.size();
     int index = nodes.size();
 
-    json.Parse(content.data());
-    if(json.HasParseError())
+    JsonEntryReader reader({"configs"}, [&](const std::string &, string_map &json)
+    {
+        group = GetMember(json, "group");
+        if(group.empty())
+            group = SSR_DEFAULT_GROUP;
+        remarks = GetMember(json, "remarks");
+        server = GetMember(json, "server");
+        port = custom_port.size() ? custom_port : GetMember(json, "server_port");
+        if(port == "0")
+            return;
+        if(remarks.empty())
+            remarks = server + ":" + port;
+
+        password = GetMember(json, "password");
+        method = GetMember(json, "method");
+
+        protocol = GetMember(json, "protocol");
+        protoparam = GetMember(json, "protocolparam");
+        obfs = GetMember(json, "obfs");
+        obfsparam = GetMember(json, "obfsparam");
+
+        node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
+        node.group = group;
+        node.remarks = remarks;
+        node.id = index;
+        node.server = server;
+        node.port = to_int(port, 1);
+        node.proxy = ssrConstruct(server, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev);
+        nodes.emplace_back(std::move(node));
+        node = nodeInfo();
+        index++;
+    });
+    if(!reader.Parse(content))
+    {
+        nodes.resize(start);
         return;
+    }
 
-    if(json.HasMember("local_port") && json.HasMember("local_address")) //single libev config
+    const string_map &json = reader.root;
+    if(json.count("local_port") && json.count("local_address")) //single libev config
     {
+        nodes.resize(start);
         server = GetMember(json, "server");
         port = GetMember(json, "server_port");
         node.remarks = server + ":" + port;
@@ -557,7 +647,7 @@ void explodeSSRConf(std::string content, const std::string &custom_port, bool ss
             pluginopts = GetMember(json, "plugin_opts");
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
             node.group = SS_DEFAULT_GROUP;
-            node.proxyStr = ssConstruct(node.group, node.remarks, server, port, password, method, plugin, pluginopts, ss_libev);
+            node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, ss_libev);
         }
         else
         {
@@ -565,75 +655,42 @@ void explodeSSRConf(std::string content, const std::string &custom_port, bool ss
             obfsparam = GetMember(json, "obfs_param");
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
             node.group = SSR_DEFAULT_GROUP;
-            node.proxyStr = ssrConstruct(node.group, node.remarks, base64_encode(node.remarks), server, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev);
+            node.proxy = ssrConstruct(server, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev);
         }
         nodes.emplace_back(std::move(node));
-        node = nodeInfo();
-        return;
-    }
-
-    for(unsigned int i = 0; i < json["configs"].Size(); i++)
-    {
-        group = GetMember(json["configs"][i], "group");
-        if(group.empty())
-            group = SSR_DEFAULT_GROUP;
-        remarks = GetMember(json["configs"][i], "remarks");
-        server = GetMember(json["configs"][i], "server");
-        port = custom_port.size() ? custom_port : GetMember(json["configs"][i], "server_port");
-        if(port == "0")
-            continue;
-        if(remarks.empty())
-            remarks = server + ":" + port;
-
-        remarks_base64 = GetMember(json["configs"][i], "remarks_base64"); // electron-ssr does not contain this field
-        password = GetMember(json["configs"][i], "password");
-        method = GetMember(json["configs"][i], "method");
-
-        protocol = GetMember(json["configs"][i], "protocol");
-        protoparam = GetMember(json["configs"][i], "protocolparam");
-        obfs = GetMember(json["configs"][i], "obfs");
-        obfsparam = GetMember(json["configs"][i], "obfsparam");
-
-        node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
-        node.group = group;
-        node.remarks = remarks;
-        node.id = index;
-        node.server = server;
-        node.port = to_int(port, 1);
-        node.proxyStr = ssrConstruct(group, remarks, remarks_base64, server, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev);
-        nodes.emplace_back(std::move(node));
-        node = nodeInfo();
-        index++;
     }
     return;
 }
 
-void explodeSocks(std::string link, const std::string &custom_port, nodeInfo &node)
+void explodeSocks(std::string_view link, const std::string &custom_port, nodeInfo &node)
 {
     std::string group, remarks, server, port, username, password;
-    if(strFind(link, "socks://")) //v2rayn socks link
+    string_size pos;
+    if(link.find("socks://") != link.npos) //v2rayn socks link
     {
-        std::vector<std::string> arguments;
-        if(strFind(link, "#"))
+        pos = link.find('#');
+        if(pos != link.npos)
         {
-            remarks = UrlDecode(link.substr(link.find("#") + 1));
-            link.erase(link.find("#"));
+            remarks = UrlDecode(link.substr(pos + 1));
+            link = link.substr(0, pos);
         }
-        link = urlsafe_base64_decode(link.substr(8));
-        arguments = split(link, ":");
-        if(arguments.size() < 2)
+        urlsafe_base64_decode(link.substr(8), link_buffer);
+        pos = link_buffer.find(':');
+        if(pos == link_buffer.npos)
             return;
-        server = arguments[0];
-        port = arguments[1];
+        server = link_buffer.substr(0, pos);
+        port = link_buffer.substr(pos + 1, link_buffer.find(':', pos + 1) - pos - 1);
     }
-    else if(strFind(link, "https://t.me/socks") || strFind(link, "tg://socks")) //telegram style socks link
+    else if(link.find("https://t.me/socks") != link.npos || link.find("tg://socks") != link.npos) //telegram style socks link
     {
-        server = getUrlArg(link, "server");
-        port = getUrlArg(link, "port");
-        username = UrlDecode(getUrlArg(link, "user"));
-        password = UrlDecode(getUrlArg(link, "pass"));
-        remarks = UrlDecode(getUrlArg(link, "remarks"));
-        group = UrlDecode(getUrlArg(link, "group"));
+        pos = link.find('?');
+        link_args args(pos != link.npos ? link.substr(pos + 1) : std::string_view());
+        server = args.get("server");
+        port = args.get("port");
+        username = UrlDecode(args.get("user"));
+        password = UrlDecode(args.get("pass"));
+        remarks = UrlDecode(args.get("remarks"));
+        group = UrlDecode(args.get("group"));
     }
     if(group.empty())
         group = SOCKS_DEFAULT_GROUP;
@@ -649,7 +706,7 @@ void explodeSocks(std::string link, const std::string &custom_port, nodeInfo &no
     node.remarks = remarks;
     node.server = server;
     node.port = to_int(port, 1);
-    node.proxyStr = socksConstruct(group, remarks, server, port, username, password);
+    node.proxy = socksConstruct(server, port, username, password);
 }
 
 void explodeHTTP(const std::string &link, const std::string &custom_port, nodeInfo &node)
@@ -676,7 +733,7 @@ void explodeHTTP(const std::string &link, const std::string &custom_port, nodeIn
     node.remarks = remarks;
     node.server = server;
     node.port = to_int(port, 1);
-    node.proxyStr = httpConstruct(group, remarks, server, port, username, password, strFind(link, "/https"));
+    node.proxy = httpConstruct(server, port, username, password, strFind(link, "/https"));
 }
 
 void explodeHTTPSub(std::string link, const std::string &custom_port, nodeInfo &node)
@@ -719,39 +776,47 @@ void explodeHTTPSub(std::string link, const std::string &custom_port, nodeInfo &
     node.remarks = remarks;
     node.server = server;
     node.port = to_int(port, 1);
-    node.proxyStr = httpConstruct(group, remarks, server, port, username, password, tls);
+    node.proxy = httpConstruct(server, port, username, password, tls);
 }
 
-void explodeTrojan(std::string trojan, const std::string &custom_port, nodeInfo &node)
+void explodeTrojan(std::string_view trojan, const std::string &custom_port, nodeInfo &node)
 {
-    std::string server, port, psk, addition, group, remark, host;
+    std::string server, port, psk, group, remark, host;
+    std::string_view addition;
     tribool tfo, scv;
-    trojan.erase(0, 9);
-    string_size pos = trojan.rfind("#");
+    trojan.remove_prefix(9);
+    string_size pos = trojan.rfind("#"), pos_port;
 
     if(pos != trojan.npos)
     {
         remark = UrlDecode(trojan.substr(pos + 1));
-        trojan.erase(pos);
+        trojan = trojan.substr(0, pos);
     }
     pos = trojan.find("?");
     if(pos != trojan.npos)
     {
         addition = trojan.substr(pos + 1);
-        trojan.erase(pos);
+        trojan = trojan.substr(0, pos);
     }
 
-    if(regGetMatch(trojan, "(.*?)@(.*):(.*)", 4, 0, &psk, &server, &port))
+    //password@server:port
+    pos = trojan.find('@');
+    pos_port = trojan.rfind(':');
+    if(pos == trojan.npos || pos_port == trojan.npos || pos_port < pos)
         return;
+    psk = trojan.substr(0, pos);
+    server = trojan.substr(pos + 1, pos_port - pos - 1);
+    port = trojan.substr(pos_port + 1);
     if(custom_port.size())
         port = custom_port;
     if(port == "0")
         return;
 
-    host = getUrlArg(addition, "peer");
-    tfo = getUrlArg(addition, "tfo");
-    scv = getUrlArg(addition, "allowInsecure");
-    group = UrlDecode(getUrlArg(addition, "group"));
+    link_args args(addition);
+    host = args.get("peer");
+    tfo = std::string(args.get("tfo"));
+    scv = std::string(args.get("allowInsecure"));
+    group = UrlDecode(args.get("group"));
 
     if(remark.empty())
         remark = server + ":" + port;
@@ -765,7 +830,7 @@ void explodeTrojan(std::string trojan, const std::string &custom_port, nodeInfo
     node.remarks = remark;
     node.server = server;
     node.port = to_int(port, 1);
-    node.proxyStr = trojanConstruct(group, remark, server, port, psk, host, true, tribool(), tfo, scv);
+    node.proxy = trojanConstruct(server, port, psk, host, true, tribool(), tfo, scv);
 }
 
 void explodeQuan(const std::string &quan, const std::string &custom_port, nodeInfo &node)
@@ -827,20 +892,14 @@ void explodeQuan(const std::string &quan, const std::string &custom_port, nodeIn
         node.remarks = ps;
         node.server = add;
         node.port = to_int(port, 1);
-        node.proxyStr = vmessConstruct(group, ps, add, port, type, id, aid, net, cipher, path, host, edge, tls);
+        node.proxy = vmessConstruct(add, port, type, id, aid, net, cipher, path, host, edge, tls);
     }
 }
 
-void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::string &custom_port, nodeInfo &node)
+static void explodeNetchEntry(const string_map &json, bool ss_libev, bool ssr_libev, const std::string &custom_port, nodeInfo &node)
 {
-    Document json;
     std::string type, group, remark, address, port, username, password, method, plugin, pluginopts, protocol, protoparam, obfs, obfsparam, id, aid, transprot, faketype, host, edge, path, tls;
     tribool udp, tfo, scv;
-    netch = urlsafe_base64_decode(netch.substr(8));
-
-    json.Parse(netch.data());
-    if(json.HasParseError())
-        return;
     type = GetMember(json, "Type");
     group = GetMember(json, "Group");
     remark = GetMember(json, "Remark");
@@ -864,7 +923,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
             group = SS_DEFAULT_GROUP;
         node.group = group;
         node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
-        node.proxyStr = ssConstruct(group, remark, address, port, password, method, plugin, pluginopts, ss_libev, udp, tfo, scv);
+        node.proxy = ssConstruct(address, port, password, method, plugin, pluginopts, ss_libev, udp, tfo, scv);
         break;
     case "SSR"_hash:
         protocol = GetMember(json, "Protocol");
@@ -877,7 +936,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
                 group = SS_DEFAULT_GROUP;
             node.group = group;
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
-            node.proxyStr = ssConstruct(group, remark, address, port, password, method, plugin, pluginopts, ss_libev, udp, tfo, scv);
+            node.proxy = ssConstruct(address, port, password, method, plugin, pluginopts, ss_libev, udp, tfo, scv);
         }
         else
         {
@@ -887,7 +946,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
                 group = SSR_DEFAULT_GROUP;
             node.group = group;
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
-            node.proxyStr = ssrConstruct(group, remark, base64_encode(remark), address, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev, udp, tfo, scv);
+            node.proxy = ssrConstruct(address, port, protocol, method, obfs, password, obfsparam, protoparam, ssr_libev, udp, tfo, scv);
         }
         break;
     case "VMess"_hash:
@@ -903,7 +962,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
         if(group.empty())
             group = V2RAY_DEFAULT_GROUP;
         node.group = group;
-        node.proxyStr = vmessConstruct(group, remark, address, port, faketype, id, aid, transprot, method, path, host, edge, tls, udp, tfo, scv);
+        node.proxy = vmessConstruct(address, port, faketype, id, aid, transprot, method, path, host, edge, tls, udp, tfo, scv);
         break;
     case "Socks5"_hash:
         username = GetMember(json, "Username");
@@ -911,7 +970,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
         if(group.empty())
             group = SOCKS_DEFAULT_GROUP;
         node.group = group;
-        node.proxyStr = socksConstruct(group, remark, address, port, username, password, udp, tfo, scv);
+        node.proxy = socksConstruct(address, port, username, password, udp, tfo, scv);
         break;
     case "HTTP"_hash:
     case "HTTPS"_hash:
@@ -919,7 +978,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
         if(group.empty())
             group = HTTP_DEFAULT_GROUP;
         node.group = group;
-        node.proxyStr = httpConstruct(group, remark, address, port, username, password, type == "HTTPS", tfo, scv);
+        node.proxy = httpConstruct(address, port, username, password, type == "HTTPS", tfo, scv);
         break;
     case "Trojan"_hash:
         host = GetMember(json, "Host");
@@ -928,7 +987,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
         if(group.empty())
             group = TROJAN_DEFAULT_GROUP;
         node.group = group;
-        node.proxyStr = trojanConstruct(group, remark, address, port, password, host, tls == "true", udp, tfo, scv);
+        node.proxy = trojanConstruct(address, port, password, host, tls == "true", udp, tfo, scv);
         break;
     case "Snell"_hash:
         obfs = GetMember(json, "OBFS");
@@ -937,7 +996,7 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
         if(group.empty())
             group = SNELL_DEFAULT_GROUP;
         node.group = group;
-        node.proxyStr = snellConstruct(group, remark, address, port, password, obfs, host, udp, tfo, scv);
+        node.proxy = snellConstruct(address, port, password, obfs, host, udp, tfo, scv);
         break;
     default:
         return;
@@ -948,6 +1007,14 @@ void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::s
     node.port = (unsigned short)to_int(port, 1);
 }
 
+void explodeNetch(std::string netch, bool ss_libev, bool ssr_libev, const std::string &custom_port, nodeInfo &node)
+{
+    JsonEntryReader reader({}, nullptr);
+    if(!reader.Parse(urlsafe_base64_decode(netch.substr(8))))
+        return;
+    explodeNetchEntry(reader.root, ss_libev, ssr_libev, custom_port, node);
+}
+
 void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nodeInfo> &nodes, bool ss_libev, bool ssr_libev)
 {
     std::string proxytype, ps, server, port, cipher, group, password; //common
@@ -995,7 +1062,7 @@ void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nod
             tls = safe_as<std::string>(singleproxy["tls"]) == "true" ? "tls" : "";
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDVMESS;
-            node.proxyStr = vmessConstruct(group, ps, server, port, "", id, aid, net, cipher, path, host, edge, tls, udp, tfo, scv);
+            node.proxy = vmessConstruct(server, port, "", id, aid, net, cipher, path, host, edge, tls, udp, tfo, scv);
             break;
         case "ss"_hash:
             group = SS_DEFAULT_GROUP;
@@ -1066,7 +1133,7 @@ void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nod
             }
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
-            node.proxyStr = ssConstruct(group, ps, server, port, password, cipher, plugin, pluginopts, ss_libev, udp, tfo, scv);
+            node.proxy = ssConstruct(server, port, password, cipher, plugin, pluginopts, ss_libev, udp, tfo, scv);
             break;
         case "socks5"_hash:
             group = SOCKS_DEFAULT_GROUP;
@@ -1075,7 +1142,7 @@ void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nod
             singleproxy["password"] >>= password;
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSOCKS;
-            node.proxyStr = socksConstruct(group, ps, server, port, user, password);
+            node.proxy = socksConstruct(server, port, user, password);
             break;
         case "ssr"_hash:
             group = SSR_DEFAULT_GROUP;
@@ -1094,7 +1161,7 @@ void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nod
                 singleproxy["obfsparam"] >>= obfsparam;
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
-            node.proxyStr = ssrConstruct(group, ps, base64_encode(ps), server, port, protocol, cipher, obfs, password, obfsparam, protoparam, ssr_libev, udp, tfo, scv);
+            node.proxy = ssrConstruct(server, port, protocol, cipher, obfs, password, obfsparam, protoparam, ssr_libev, udp, tfo, scv);
             break;
         case "http"_hash:
             group = HTTP_DEFAULT_GROUP;
@@ -1104,7 +1171,7 @@ void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nod
             singleproxy["tls"] >>= tls;
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDHTTP;
-            node.proxyStr = httpConstruct(group, ps, server, port, user, password, tls == "true", tfo, scv);
+            node.proxy = httpConstruct(server, port, user, password, tls == "true", tfo, scv);
             break;
         case "trojan"_hash:
             group = TROJAN_DEFAULT_GROUP;
@@ -1112,7 +1179,7 @@ void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nod
             singleproxy["sni"] >>= host;
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDTROJAN;
-            node.proxyStr = trojanConstruct(group, ps, server, port, password, host, true, udp, tfo, scv);
+            node.proxy = trojanConstruct(server, port, password, host, true, udp, tfo, scv);
             break;
         case "snell"_hash:
             group = SNELL_DEFAULT_GROUP;
@@ -1121,7 +1188,7 @@ void explodeClash(Node yamlnode, const std::string &custom_port, std::vector<nod
             singleproxy["obfs-opts"]["host"] >>= host;
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSNELL;
-            node.proxyStr = snellConstruct(group, ps, server, port, password, obfs, host, udp, tfo, scv);
+            node.proxy = snellConstruct(server, port, password, obfs, host, udp, tfo, scv);
             break;
         default:
             continue;
@@ -1186,7 +1253,7 @@ void explodeStdVMess(std::string vmess, const std::string &custom_port, nodeInfo
     node.remarks = remarks;
     node.server = add;
     node.port = to_int(port, 0);
-    node.proxyStr = vmessConstruct(node.group, remarks, add, port, type, id, aid, net, "auto", path, host, "", tls);
+    node.proxy = vmessConstruct(add, port, type, id, aid, net, "auto", path, host, "", tls);
     return;
 }
 
@@ -1238,7 +1305,7 @@ void explodeShadowrocket(std::string rocket, const std::string &custom_port, nod
     node.remarks = remarks;
     node.server = add;
     node.port = to_int(port, 0);
-    node.proxyStr = vmessConstruct(node.group, remarks, add, port, type, id, aid, net, cipher, path, host, "", tls);
+    node.proxy = vmessConstruct(add, port, type, id, aid, net, cipher, path, host, "", tls);
 }
 
 void explodeKitsunebi(std::string kit, const std::string &custom_port, nodeInfo &node)
@@ -1283,39 +1350,49 @@ void explodeKitsunebi(std::string kit, const std::string &custom_port, nodeInfo
     node.remarks = remarks;
     node.server = add;
     node.port = to_int(port, 0);
-    node.proxyStr = vmessConstruct(node.group, remarks, add, port, type, id, aid, net, cipher, path, host, "", tls);
+    node.proxy = vmessConstruct(add, port, type, id, aid, net, cipher, path, host, "", tls);
 }
 
-bool explodeSurge(std::string surge, const std::string &custom_port, std::vector<nodeInfo> &nodes, bool libev)
+bool explodeSurge(const std::string &surge, const std::string &custom_port, std::vector<nodeInfo> &nodes, bool libev)
 {
-    std::multimap<std::string, std::string> proxies;
+    std::vector<std::pair<string_size, string_size>> lines;
     nodeInfo node;
     unsigned int i, index = nodes.size();
-    INIReader ini;
+    string_size pos = surge.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0, next, len;
+    char delimiter = getLineBreak(surge);
+    bool in_proxy = true, found_proxy = false;
 
-    /*
-    if(!strFind(surge, "[Proxy]"))
-        return false;
-    */
-
-    ini.store_isolated_line = true;
-    ini.keep_empty_section = false;
-    ini.allow_dup_section_titles = true;
-    ini.SetIsolatedItemsSection("Proxy");
-    ini.IncludeSection("Proxy");
-    ini.AddDirectSaveSection("Proxy");
-    if(surge.find("[Proxy]") != surge.npos)
-        surge = regReplace(surge, "^[\\S\\s]*?\\[", "[", false);
-    ini.Parse(surge);
-
-    if(!ini.SectionExist("Proxy"))
+    //locate the proxy lines in one pass without copying anything,
+    //lines before the first section title only count when there is no [Proxy] section
+    for(; pos < surge.size(); pos = next + 1)
+    {
+        next = surge.find(delimiter, pos);
+        if(next == surge.npos)
+            next = surge.size();
+        len = next - pos;
+        if(len && surge[pos + len - 1] == '\r')
+            len--;
+        if(!len || surge[pos] == ';' || surge[pos] == '#' || surge.compare(pos, 2, "//") == 0)
+            continue;
+        if(surge[pos] == '[' && surge[pos + len - 1] == ']')
+        {
+            if(found_proxy) //only the first [Proxy] section is read
+                break;
+            in_proxy = surge.compare(pos, len, "[Proxy]") == 0;
+            if(in_proxy)
+            {
+                eraseElements(lines);
+                found_proxy = true;
+            }
+            continue;
+        }
+        if(in_proxy)
+            lines.emplace_back(pos, len);
+    }
+    if(lines.empty())
         return false;
-    ini.EnterSection("Proxy");
-    ini.GetItems(proxies);
 
-    const std::string proxystr = "(.*?)\\s*=\\s*(.*)";
-
-    for(auto &x : proxies)
+    for(auto &x : lines)
     {
         std::string remarks, server, port, method, username, password; //common
         std::string plugin, pluginopts, pluginopts_mode, pluginopts_host, mod_url, mod_md5; //ss
@@ -1325,11 +1402,18 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
         std::vector<std::string> configs, vArray, headers, header;
         tribool udp, tfo, scv, tls13;
 
-        /*
-        remarks = regReplace(x.second, proxystr, "$1");
-        configs = split(regReplace(x.second, proxystr, "$2"), ",");
-        */
-        regGetMatch(x.second, proxystr, 3, 0, &remarks, &config);
+        //name = type, server, port, ...
+        std::string strLine = surge.substr(x.first, x.second);
+        ProcessEscapeChar(strLine);
+        string_size pos_equal = strLine.find('='), pos_config;
+        if(pos_equal == strLine.npos)
+            continue;
+        pos = pos_equal ? strLine.find_last_not_of(" \t", pos_equal - 1) : strLine.npos;
+        if(pos != strLine.npos)
+            remarks = strLine.substr(0, pos + 1);
+        pos_config = strLine.find_first_not_of(" \t", pos_equal + 1);
+        if(pos_config != strLine.npos)
+            config = strLine.substr(pos_config);
         configs = split(config, ",");
         if(configs.size() < 3)
             continue;
@@ -1392,7 +1476,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
 
                 node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
                 node.group = SS_DEFAULT_GROUP;
-                node.proxyStr = ssConstruct(node.group, remarks, server, port, password, method, plugin, pluginopts, libev, udp, tfo, scv);
+                node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, libev, udp, tfo, scv);
             }
             //else
             //    continue;
@@ -1432,7 +1516,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
             node.group = SS_DEFAULT_GROUP;
-            node.proxyStr = ssConstruct(node.group, remarks, server, port, password, method, plugin, pluginopts, libev, udp, tfo, scv);
+            node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, libev, udp, tfo, scv);
             break;
         case "socks5"_hash: //surge 3 style socks5 proxy
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSOCKS;
@@ -1461,7 +1545,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
                     default: continue;
                 }
             }
-            node.proxyStr = socksConstruct(node.group, remarks, server, port, username, password, udp, tfo, scv);
+            node.proxy = socksConstruct(server, port, username, password, udp, tfo, scv);
             break;
         case "vmess"_hash: //surge 4 style vmess proxy
             server = trim(configs[1]);
@@ -1510,7 +1594,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
 
             node.linkType = SPEEDTEST_MESSAGE_FOUNDVMESS;
             node.group = V2RAY_DEFAULT_GROUP;
-            node.proxyStr = vmessConstruct(node.group, remarks, server, port, "", id, "0", net, method, path, host, edge, tls, udp, tfo, scv, tls13);
+            node.proxy = vmessConstruct(server, port, "", id, "0", net, method, path, host, edge, tls, udp, tfo, scv, tls13);
             break;
         case "http"_hash: //http proxy
             node.linkType = SPEEDTEST_MESSAGE_FOUNDHTTP;
@@ -1534,7 +1618,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
                     default: continue;
                 }
             }
-            node.proxyStr = httpConstruct(node.group, remarks, server, port, username, password, false, tfo, scv);
+            node.proxy = httpConstruct(server, port, username, password, false, tfo, scv);
             break;
         case "trojan"_hash: // surge 4 style trojan proxy
             node.linkType = SPEEDTEST_MESSAGE_FOUNDTROJAN;
@@ -1564,7 +1648,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
             if(host.empty() && !isIPv4(server) && !isIPv6(server))
                 host = server;
 
-            node.proxyStr = trojanConstruct(node.group, remarks, server, port, password, host, true, udp, tfo, scv);
+            node.proxy = trojanConstruct(server, port, password, host, true, udp, tfo, scv);
             break;
         case "snell"_hash:
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSNELL;
@@ -1596,7 +1680,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
             if(host.empty() && !isIPv4(server) && !isIPv6(server))
                 host = server;
 
-            node.proxyStr = snellConstruct(node.group, remarks, server, port, password, plugin, host, udp, tfo, scv);
+            node.proxy = snellConstruct(server, port, password, plugin, host, udp, tfo, scv);
             break;
         default:
             switch(hash_(remarks))
@@ -1675,13 +1759,13 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
                 {
                     node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
                     node.group = SSR_DEFAULT_GROUP;
-                    node.proxyStr = ssrConstruct(node.group, remarks, base64_encode(remarks), server, port, protocol, method, pluginopts_mode, password, pluginopts_host, protoparam, libev, udp, tfo, scv);
+                    node.proxy = ssrConstruct(server, port, protocol, method, pluginopts_mode, password, pluginopts_host, protoparam, libev, udp, tfo, scv);
                 }
                 else
                 {
                     node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
                     node.group = SS_DEFAULT_GROUP;
-                    node.proxyStr = ssConstruct(node.group, remarks, server, port, password, method, plugin, pluginopts, libev, udp, tfo, scv, tls13);
+                    node.proxy = ssConstruct(server, port, password, method, plugin, pluginopts, libev, udp, tfo, scv, tls13);
                 }
                 break;
             case "vmess"_hash: //quantumult x style vmess link
@@ -1728,7 +1812,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
 
                 node.linkType = SPEEDTEST_MESSAGE_FOUNDVMESS;
                 node.group = V2RAY_DEFAULT_GROUP;
-                node.proxyStr = vmessConstruct(node.group, remarks, server, port, "", id, "0", net, method, path, host, "", tls, udp, tfo, scv, tls13);
+                node.proxy = vmessConstruct(server, port, "", id, "0", net, method, path, host, "", tls, udp, tfo, scv, tls13);
                 break;
             case "trojan"_hash: //quantumult x style trojan link
                 server = trim(configs[0].substr(0, configs[0].rfind(":")));
@@ -1764,7 +1848,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
 
                 node.linkType = SPEEDTEST_MESSAGE_FOUNDTROJAN;
                 node.group = TROJAN_DEFAULT_GROUP;
-                node.proxyStr = trojanConstruct(node.group, remarks, server, port, password, host, tls == "true", udp, tfo, scv, tls13);
+                node.proxy = trojanConstruct(server, port, password, host, tls == "true", udp, tfo, scv, tls13);
                 break;
             case "http"_hash: //quantumult x style http links
                 server = trim(configs[0].substr(0, configs[0].rfind(":")));
@@ -1804,7 +1888,7 @@ bool explodeSurge(std::string surge, const std::string &custom_port, std::vector
 
                 node.linkType = SPEEDTEST_MESSAGE_FOUNDHTTP;
                 node.group = HTTP_DEFAULT_GROUP;
-                node.proxyStr = httpConstruct(node.group, remarks, server, port, username, password, tls == "true", tfo, scv, tls13);
+                node.proxy = httpConstruct(server, port, username, password, tls == "true", tfo, scv, tls13);
                 break;
             default:
                 continue;
@@ -1829,53 +1913,50 @@ void explodeSSTap(std::string sstap, const std::string &custom_port, std::vector
     std::string cipher;
     std::string user, pass;
     std::string protocol, protoparam, obfs, obfsparam;
-    Document json;
     nodeInfo node;
+    size_t start = nodes.size();
     unsigned int index = nodes.size();
-    json.Parse(sstap.data());
-    if(json.HasParseError())
-        return;
 
-    for(unsigned int i = 0; i < json["configs"].Size(); i++)
+    JsonEntryReader reader({"configs"}, [&](const std::string &, string_map &json)
     {
-        json["configs"][i]["group"] >> group;
-        json["configs"][i]["remarks"] >> remarks;
-        json["configs"][i]["server"] >> server;
-        port = custom_port.size() ? custom_port : GetMember(json["configs"][i], "server_port");
+        group = GetMember(json, "group");
+        remarks = GetMember(json, "remarks");
+        server = GetMember(json, "server");
+        port = custom_port.size() ? custom_port : GetMember(json, "server_port");
         if(port == "0")
-            continue;
+            return;
 
         if(remarks.empty())
             remarks = server + ":" + port;
 
-        json["configs"][i]["password"] >> pass;
-        json["configs"][i]["type"] >> configType;
+        pass = GetMember(json, "password");
+        configType = GetMember(json, "type");
         switch(to_int(configType, 0))
         {
         case 5: //socks 5
-            json["configs"][i]["username"] >> user;
+            user = GetMember(json, "username");
             node.linkType = SPEEDTEST_MESSAGE_FOUNDSOCKS;
-            node.proxyStr = socksConstruct(group, remarks, server, port, user, pass);
+            node.proxy = socksConstruct(server, port, user, pass);
             break;
         case 6: //ss/ssr
-            json["configs"][i]["protocol"] >> protocol;
-            json["configs"][i]["obfs"] >> obfs;
-            json["configs"][i]["method"] >> cipher;
+            protocol = GetMember(json, "protocol");
+            obfs = GetMember(json, "obfs");
+            cipher = GetMember(json, "method");
             if(find(ss_ciphers.begin(), ss_ciphers.end(), cipher) != ss_ciphers.end() && protocol == "origin" && obfs == "plain") //is ss
             {
                 node.linkType = SPEEDTEST_MESSAGE_FOUNDSS;
-                node.proxyStr = ssConstruct(group, remarks, server, port, pass, cipher, "", "", ss_libev);
+                node.proxy = ssConstruct(server, port, pass, cipher, "", "", ss_libev);
             }
             else //is ssr cipher
             {
-                json["configs"][i]["obfsparam"] >> obfsparam;
-                json["configs"][i]["protocolparam"] >> protoparam;
+                obfsparam = GetMember(json, "obfsparam");
+                protoparam = GetMember(json, "protocolparam");
                 node.linkType = SPEEDTEST_MESSAGE_FOUNDSSR;
-                node.proxyStr = ssrConstruct(group, remarks, base64_encode(remarks), server, port, protocol, cipher, obfs, pass, obfsparam, protoparam, ssr_libev);
+                node.proxy = ssrConstruct(server, port, protocol, cipher, obfs, pass, obfsparam, protoparam, ssr_libev);
             }
             break;
         default:
-            continue;
+            return;
         }
 
         node.group = group;
@@ -1885,140 +1966,668 @@ void explodeSSTap(std::string sstap, const std::string &custom_port, std::vector
         node.port = to_int(port, 1);
         nodes.emplace_back(std::move(node));
         node = nodeInfo();
-    }
+    });
+    if(!reader.Parse(sstap))
+        nodes.resize(start);
 }
 
 void explodeNetchConf(std::string netch, bool ss_libev, bool ssr_libev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
 {
-    Document json;
     nodeInfo node;
+    size_t start = nodes.size();
     unsigned int index = nodes.size();
 
-    json.Parse(netch.data());
-    if(json.HasParseError())
-        return;
-
-    if(!json.HasMember("Server"))
-        return;
-
-    for(unsigned int i = 0; i < json["Server"].Size(); i++)
+    JsonEntryReader reader({"Server"}, [&](const std::string &, string_map &json)
     {
-        explodeNetch("Netch://" + base64_encode(SerializeObject(json["Server"][i])), ss_libev, ssr_libev, custom_port, node);
+        explodeNetchEntry(json, ss_libev, ssr_libev, custom_port, node);
 
         node.id = index;
         nodes.emplace_back(std::move(node));
         node = nodeInfo();
         index++;
-    }
+    });
+    if(!reader.Parse(netch))
+        nodes.resize(start);
 }
 
-bool applyMatcher(const std::string &rule, std::string &real_rule, const nodeInfo &node);
+bool matchRange(const std::string &range, int target);
 
-bool chkIgnore(const nodeInfo &node, string_array &exclude_remarks, string_array &include_remarks)
+enum
+{
+    NODE_MATCHER_ANY,
+    NODE_MATCHER_GROUP,
+    NODE_MATCHER_GROUPID,
+    NODE_MATCHER_INSERT
+};
+
+NodeFilter::NodeFilter(const string_array &exclude_remarks, const string_array &include_remarks)
+{
+    compile(exclude_remarks, exclude);
+    compile(include_remarks, include);
+}
+
+void NodeFilter::compile(const string_array &source, std::vector<rule> &rules)
 {
-    bool excluded = false, included = false;
-    //std::string remarks = UTF8ToACP(node.remarks);
-    //std::string remarks = node.remarks;
-    //writeLog(LOG_TYPE_INFO, "Comparing exclude remarks...");
-    excluded = std::any_of(exclude_remarks.cbegin(), exclude_remarks.cend(), [&node](const auto &x)
+    static const std::string groupid_regex = R"(^!!(?:GROUPID|INSERT)=([\d\-+!,]+)(?:!!(.*))?$)", group_regex = R"(^!!(?:GROUP)=(.*?)(?:!!(.*))?$)";
+    std::string group, real_rule;
+    for(const std::string &x : source)
     {
-        std::string real_rule;
-        if(applyMatcher(x, real_rule, node))
+        rule item;
+        group.clear();
+        real_rule.clear();
+        if(startsWith(x, "!!GROUP="))
         {
-            if(real_rule.empty()) return true;
-            return regFind(node.remarks, real_rule);
+            regGetMatch(x, group_regex, 3, 0, &group, &real_rule);
+            item.matcher = NODE_MATCHER_GROUP;
+            item.group = regCompile(group);
         }
-        else
-            return false;
-    });
-    if(include_remarks.size() != 0)
-    {
-        //writeLog(LOG_TYPE_INFO, "Comparing include remarks...");
-        included = std::any_of(include_remarks.cbegin(), include_remarks.cend(), [&node](const auto &x)
+        else if(startsWith(x, "!!GROUPID=") || startsWith(x, "!!INSERT="))
         {
-            std::string real_rule;
-            if(applyMatcher(x, real_rule, node))
-            {
-                if(real_rule.empty()) return true;
-                return regFind(node.remarks, real_rule);
-            }
-            else
-                return false;
-        });
+            regGetMatch(x, groupid_regex, 3, 0, &group, &real_rule);
+            item.matcher = startsWith(x, "!!INSERT=") ? NODE_MATCHER_INSERT : NODE_MATCHER_GROUPID;
+            item.range = group;
+        }
+        else
+            real_rule = x;
+        if(real_rule.size())
+            item.remarks = regCompile(real_rule);
+        rules.emplace_back(std::move(item));
     }
-    else
+}
+
+bool NodeFilter::matches(const rule &x, const nodeInfo &node)
+{
+    switch(x.matcher)
     {
-        included = true;
+    case NODE_MATCHER_GROUP:
+        if(!regExec(node.group, x.group))
+            return false;
+        break;
+    case NODE_MATCHER_GROUPID:
+    case NODE_MATCHER_INSERT:
+        if(!matchRange(x.range, (x.matcher == NODE_MATCHER_INSERT ? -1 : 1) * node.groupID))
+            return false;
+        break;
     }
-
-    return excluded || !included;
+    //a rule without remarks pattern matches every node its prefix accepts
+    return !x.remarks || regExec(node.remarks, x.remarks);
 }
 
-int explodeConf(std::string filepath, const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes)
+bool NodeFilter::ignored(const nodeInfo &node) const
 {
-    std::ifstream infile;
-    std::stringstream contentstrm;
-    infile.open(filepath);
-
-    contentstrm << infile.rdbuf();
-    infile.close();
-
-    return explodeConfContent(contentstrm.str(), custom_port, sslibev, ssrlibev, nodes);
+    auto match = [&node](const rule &x)
+    {
+        return matches(x, node);
+    };
+    if(std::any_of(exclude.cbegin(), exclude.cend(), match))
+        return true;
+    return include.size() && std::none_of(include.cbegin(), include.cend(), match);
 }
 
-int explodeConfContent(const std::string &content, const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes)
+void NodeFilter::apply(std::vector<nodeInfo> &nodes, int groupID) const
 {
-    int filetype = -1;
-
-    if(strFind(content, "\"version\""))
-        filetype = SPEEDTEST_MESSAGE_FOUNDSS;
-    else if(strFind(content, "\"serverSubscribes\""))
-        filetype = SPEEDTEST_MESSAGE_FOUNDSSR;
-    else if(strFind(content, "\"uiItem\"") || strFind(content, "vnext"))
-        filetype = SPEEDTEST_MESSAGE_FOUNDVMESS;
-    else if(strFind(content, "\"proxy_apps\""))
-        filetype = SPEEDTEST_MESSAGE_FOUNDSSCONF;
-    else if(strFind(content, "\"idInUse\""))
-        filetype = SPEEDTEST_MESSAGE_FOUNDSSTAP;
-    else if(strFind(content, "\"local_address\"") && strFind(content, "\"local_port\""))
-        filetype = SPEEDTEST_MESSAGE_FOUNDSSR; //use ssr config parser
-    else if(strFind(content, "\"ModeFileNameType\""))
-        filetype = SPEEDTEST_MESSAGE_FOUNDNETCH;
-
-    switch(filetype)
+    int node_index = 0;
+    size_t total = nodes.size();
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [this](const nodeInfo &x)
     {
-    case SPEEDTEST_MESSAGE_FOUNDSS:
-        explodeSSConf(content, custom_port, sslibev, nodes);
-        break;
-    case SPEEDTEST_MESSAGE_FOUNDSSR:
-        explodeSSRConf(content, custom_port, sslibev, ssrlibev, nodes);
-        break;
-    case SPEEDTEST_MESSAGE_FOUNDVMESS:
-        explodeVmessConf(content, custom_port, sslibev, nodes);
-        break;
-    case SPEEDTEST_MESSAGE_FOUNDSSCONF:
-        explodeSSAndroid(content, sslibev, custom_port, nodes);
-        break;
-    case SPEEDTEST_MESSAGE_FOUNDSSTAP:
-        explodeSSTap(content, custom_port, nodes, sslibev, ssrlibev);
-        break;
-    case SPEEDTEST_MESSAGE_FOUNDNETCH:
-        explodeNetchConf(content, sslibev, ssrlibev, custom_port, nodes);
-        break;
-    default:
-        //try to parse as a local subscription
-        explodeSub(content, sslibev, ssrlibev, custom_port, nodes);
+        if(!ignored(x))
+            return false;
+        writeLog(LOG_TYPE_INFO, "Node  " + x.group + " - " + x.remarks + "  has been ignored and will not be added.");
+        return true;
+    }), nodes.end());
+    for(nodeInfo &x : nodes)
+    {
+        x.id = node_index++;
+        x.groupID = groupID;
     }
-
-    if(nodes.size() == 0)
-        return SPEEDTEST_ERROR_UNRECOGFILE;
-    else
-        return SPEEDTEST_ERROR_NONE;
+    writeLog(LOG_TYPE_INFO, "Filter done, " + std::to_string(nodes.size()) + " of " + std::to_string(total) + " nodes have been added.");
 }
 
-void explode(const std::string &link, bool sslibev, bool ssrlibev, const std::string &custom_port, nodeInfo &node)
+bool chkIgnore(const nodeInfo &node, string_array &exclude_remarks, string_array &include_remarks)
 {
-    // TODO: replace strFind with startsWith if appropriate
+    return NodeFilter(exclude_remarks, include_remarks).ignored(node);
+}
+
+#define SUB_PARALLEL_THRESHOLD 2048 /// links needed before exploding on multiple cores
+#define SUB_PARALLEL_CHUNK 512
+
+static inline bool isBase64Char(char c)
+{
+    return isalnum(static_cast<unsigned char>(c)) || c == '+' || c == '/' || c == '-' || c == '_';
+}
+
+static bool isBase64Line(const std::string &content, string_size begin, string_size end)
+{
+    if(begin >= end || !isalnum(static_cast<unsigned char>(content[begin])))
+        return false;
+    for(string_size i = begin; i < end; i++)
+        if(!isBase64Char(content[i]) && content[i] != '=')
+            return false;
+    return true;
+}
+
+static int detectJsonFormat(const std::string &content, string_size pos)
+{
+    enum
+    {
+        KEY_SERVER_SUBSCRIBES = 1,
+        KEY_VMESS = 2,
+        KEY_PROXY_APPS = 4,
+        KEY_ID_IN_USE = 8,
+        KEY_LOCAL_ADDRESS = 16,
+        KEY_LOCAL_PORT = 32,
+        KEY_NETCH = 64,
+        KEY_CLASH = 128
+    };
+    int keys = 0;
+    string_size end;
+
+    //one pass over all quoted strings, the precedence below is the same as the old per-key searches
+    while((pos = content.find('"', pos)) != content.npos)
+    {
+        for(end = pos + 1; end < content.size() && content[end] != '"'; end++)
+            if(content[end] == '\\')
+                end++;
+        if(end >= content.size())
+            break;
+        if(end - pos - 1 <= 16)
+        {
+            switch(hash_(content.substr(pos + 1, end - pos - 1)))
+            {
+            case "version"_hash:
+                return SUB_FORMAT_SS_CONF;
+            case "serverSubscribes"_hash:
+                keys |= KEY_SERVER_SUBSCRIBES;
+                break;
+            case "uiItem"_hash:
+            case "vnext"_hash:
+                keys |= KEY_VMESS;
+                break;
+            case "proxy_apps"_hash:
+                keys |= KEY_PROXY_APPS;
+                break;
+            case "idInUse"_hash:
+                keys |= KEY_ID_IN_USE;
+                break;
+            case "local_address"_hash:
+                keys |= KEY_LOCAL_ADDRESS;
+                break;
+            case "local_port"_hash:
+                keys |= KEY_LOCAL_PORT;
+                break;
+            case "ModeFileNameType"_hash:
+                keys |= KEY_NETCH;
+                break;
+            case "Proxy"_hash:
+            case "proxies"_hash:
+                keys |= KEY_CLASH;
+                break;
+            }
+        }
+        pos = end + 1;
+    }
+
+    if(keys & KEY_SERVER_SUBSCRIBES)
+        return SUB_FORMAT_SSR_CONF;
+    else if(keys & KEY_VMESS)
+        return SUB_FORMAT_VMESS_CONF;
+    else if(keys & KEY_PROXY_APPS)
+        return SUB_FORMAT_SS_ANDROID;
+    else if(keys & KEY_ID_IN_USE)
+        return SUB_FORMAT_SSTAP;
+    else if((keys & KEY_LOCAL_ADDRESS) && (keys & KEY_LOCAL_PORT))
+        return SUB_FORMAT_SSR_CONF; //use ssr config parser
+    else if(keys & KEY_NETCH)
+        return SUB_FORMAT_NETCH;
+    else if(keys & KEY_CLASH)
+        return SUB_FORMAT_CLASH; //Clash configuration written in JSON
+    return SUB_FORMAT_UNKNOWN;
+}
+
+int detectSubFormat(const std::string &content)
+{
+    string_size pos = startsWith(content, "\xEF\xBB\xBF") ? 3 : 0, next;
+    bool surge = false;
+
+    pos = content.find_first_not_of(" \t\r\n", pos);
+    if(pos == content.npos)
+        return SUB_FORMAT_UNKNOWN;
+    if(content[pos] == '{')
+        return detectJsonFormat(content, pos);
+    if(content[pos] == '[')
+    {
+        //either a SS Android export (a top-level JSON array) or a Surge configuration starting with a section title
+        int format = detectJsonFormat(content, pos);
+        if(format != SUB_FORMAT_UNKNOWN)
+            return format;
+    }
+    if(content.compare(pos, 6, "ssd://") == 0)
+        return SUB_FORMAT_SSD;
+    next = content.find_first_of("\r\n", pos);
+    if(isBase64Line(content, pos, next == content.npos ? content.size() : next))
+        return SUB_FORMAT_BASE64;
+
+    //only look at the start of each line for a top-level Clash key or a Surge section title
+    for(; pos < content.size(); pos = next + 1)
+    {
+        next = content.find('\n', pos);
+        if(next == content.npos)
+            next = content.size();
+        string_size key = content[pos] == '"' ? pos + 1 : pos;
+        if(content.compare(key, 5, "Proxy") == 0 || content.compare(key, 7, "proxies") == 0)
+        {
+            key += content[key] == 'P' ? 5 : 7;
+            if(key < next && content[key] == '"')
+                key++;
+            if(key < next && content[key] == ':')
+                return SUB_FORMAT_CLASH;
+        }
+        if(!surge && content.compare(pos, 7, "[Proxy]") == 0)
+            surge = true;
+    }
+    return surge ? SUB_FORMAT_SURGE : SUB_FORMAT_UNKNOWN;
+}
+
+std::string getSubFormatName(int format)
+{
+    switch(format)
+    {
+    case SUB_FORMAT_SSD:
+        return "SSD";
+    case SUB_FORMAT_CLASH:
+        return "Clash";
+    case SUB_FORMAT_SURGE:
+        return "Surge";
+    case SUB_FORMAT_BASE64:
+        return "Base64";
+    case SUB_FORMAT_SS_CONF:
+        return "SS";
+    case SUB_FORMAT_SSR_CONF:
+        return "SSR";
+    case SUB_FORMAT_VMESS_CONF:
+        return "V2Ray";
+    case SUB_FORMAT_SS_ANDROID:
+        return "SS Android";
+    case SUB_FORMAT_SSTAP:
+        return "SSTap";
+    case SUB_FORMAT_NETCH:
+        return "Netch";
+    default:
+        return "Unknown";
+    }
+}
+
+static std::atomic<unsigned long long> sub_format_counts[SUB_FORMAT_NETCH + 1];
+
+void countSubFormat(int format)
+{
+    if(format < SUB_FORMAT_UNKNOWN || format > SUB_FORMAT_NETCH)
+        format = SUB_FORMAT_UNKNOWN;
+    sub_format_counts[format]++;
+}
+
+std::string getSubFormatStatus()
+{
+    std::string status;
+    for(int i = SUB_FORMAT_UNKNOWN; i <= SUB_FORMAT_NETCH; i++)
+    {
+        std::string name = getSubFormatName(i);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return c == ' ' ? '_' : tolower(c); });
+        status += "sub_format_" + name + ": " + std::to_string(sub_format_counts[i]) + "\n";
+    }
+    return status;
+}
+
+/// read-only streambuf over an existing string, saves copying large configurations into a stringstream
+struct string_read_buf : std::streambuf
+{
+    string_read_buf(const std::string &content)
+    {
+        char *data = const_cast<char*>(content.data());
+        setg(data, data, data + content.size());
+    }
+};
+
+/// thrown to stop the YAML parser once the proxy list is complete
+struct clash_proxies_done {};
+
+/// Builds nodes only for the top-level proxy list and anchored values it may refer to, everything else is skipped
+class ClashProxyHandler : public YAML::EventHandler
+{
+public:
+    Node proxies;
+    std::string section;
+
+    void OnDocumentStart(const YAML::Mark&) override {}
+    void OnDocumentEnd() override {}
+
+    void OnNull(const YAML::Mark&, YAML::anchor_t anchor) override
+    {
+        if(stack.empty() && !anchor)
+            return skipValue();
+        addValue(Node(), anchor);
+    }
+
+    void OnAlias(const YAML::Mark&, YAML::anchor_t anchor) override
+    {
+        auto iter = anchors.find(anchor);
+        Node value = iter != anchors.end() ? iter->second : Node();
+        if(stack.empty() && isProxiesValue() && value.IsSequence())
+            finishProxies(value);
+        addValue(value, 0);
+    }
+
+    void OnScalar(const YAML::Mark&, const std::string&, YAML::anchor_t anchor, const std::string &value) override
+    {
+        if(stack.empty() && depth == 1 && key_expected)
+            top_key = value;
+        if(stack.empty() && !anchor)
+            return skipValue();
+        addValue(Node(value), anchor);
+    }
+
+    void OnSequenceStart(const YAML::Mark&, const std::string&, YAML::anchor_t anchor, YAML::EmitterStyle::value) override
+    {
+        startContainer(Node(YAML::NodeType::Sequence), anchor);
+    }
+
+    void OnSequenceEnd() override
+    {
+        endContainer();
+    }
+
+    void OnMapStart(const YAML::Mark&, const std::string&, YAML::anchor_t anchor, YAML::EmitterStyle::value) override
+    {
+        startContainer(Node(YAML::NodeType::Map), anchor);
+    }
+
+    void OnMapEnd() override
+    {
+        endContainer();
+    }
+
+private:
+    struct build_frame
+    {
+        Node node;
+        YAML::anchor_t anchor = 0;
+        bool is_proxies = false;
+        bool has_key = false;
+        std::string key;
+    };
+
+    std::vector<build_frame> stack;
+    std::map<YAML::anchor_t, Node> anchors;
+    std::string top_key;
+    int depth = 0;
+    bool key_expected = false;
+
+    bool isProxiesValue()
+    {
+        return depth == 1 && !key_expected && (top_key == "proxies" || top_key == "Proxy");
+    }
+
+    void finishProxies(const Node &value)
+    {
+        proxies = value;
+        section = top_key;
+        /// later parts of the document can not affect the proxy list
+        throw clash_proxies_done();
+    }
+
+    void skipValue()
+    {
+        /// keys and values of the top-level mapping alternate
+        if(depth == 1)
+            key_expected = !key_expected;
+    }
+
+    void addValue(const Node &value, YAML::anchor_t anchor)
+    {
+        if(anchor)
+            anchors[anchor] = value;
+        if(stack.empty())
+            return skipValue();
+        build_frame &frame = stack.back();
+        if(frame.node.IsSequence())
+            frame.node.push_back(value);
+        else if(!frame.has_key)
+        {
+            frame.key = value.IsScalar() ? value.Scalar() : "";
+            frame.has_key = true;
+        }
+        else
+        {
+            frame.node[frame.key] = value;
+            frame.has_key = false;
+        }
+    }
+
+    void startContainer(const Node &node, YAML::anchor_t anchor)
+    {
+        build_frame frame;
+        if(stack.empty())
+        {
+            if(depth == 0)
+            {
+                depth++;
+                key_expected = node.IsMap();
+                return;
+            }
+            frame.is_proxies = isProxiesValue();
+            depth++;
+            /// anything else is skipped unless it might be referenced later
+            if(!frame.is_proxies && !anchor)
+                return;
+        }
+        else
+            depth++;
+        frame.node = node;
+        frame.anchor = anchor;
+        stack.emplace_back(std::move(frame));
+    }
+
+    void endContainer()
+    {
+        depth--;
+        if(stack.empty())
+        {
+            if(depth == 1)
+                key_expected = true;
+            return;
+        }
+        build_frame frame = std::move(stack.back());
+        stack.pop_back();
+        if(frame.is_proxies)
+            finishProxies(frame.node);
+        addValue(frame.node, frame.anchor);
+    }
+};
+
+/// returns false if the document could not be parsed, yamlnode only receives the proxy list
+static bool loadClashProxies(const std::string &sub, Node &yamlnode)
+{
+    string_read_buf buffer(sub);
+    std::istream stream(&buffer);
+    ClashProxyHandler handler;
+    try
+    {
+        YAML::Parser parser(stream);
+        parser.HandleNextDocument(handler);
+    }
+    catch (clash_proxies_done&)
+    {
+        yamlnode[handler.section] = handler.proxies;
+    }
+    catch (std::exception &e)
+    {
+        writeLog(0, e.what(), LOG_LEVEL_DEBUG);
+        return false;
+    }
+    return true;
+}
+
+static bool explodeClashContent(std::string sub, const std::string &custom_port, std::vector<nodeInfo> &nodes, bool sslibev, bool ssrlibev)
+{
+    Node yamlnode;
+    try
+    {
+        if(!loadClashProxies(sub, yamlnode))
+        {
+            //other parts of the document might be broken, load the proxy block only
+            regGetMatch(sub, R"(^(?:Proxy|proxies):$\s(?:(?:^ +?.*$| *?-.*$|)\s?)+)", 1, &sub);
+            yamlnode = Load(sub);
+        }
+        if(yamlnode.size() && (yamlnode["Proxy"].IsDefined() || yamlnode["proxies"].IsDefined()))
+        {
+            explodeClash(yamlnode, custom_port, nodes, sslibev, ssrlibev);
+            return true;
+        }
+    }
+    catch (std::exception &e)
+    {
+        writeLog(0, e.what(), LOG_LEVEL_DEBUG);
+        //ignore
+    }
+    return false;
+}
+
+static void explodeSubLink(std::string &strLink, bool sslibev, bool ssrlibev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
+{
+    nodeInfo node;
+    if(strLink.rfind("\r") != strLink.npos)
+        strLink.erase(strLink.size() - 1);
+    explode(strLink, sslibev, ssrlibev, custom_port, node);
+    if(strLink.size() == 0 || node.linkType == -1)
+        return;
+    nodes.emplace_back(std::move(node));
+}
+
+static void explodeBase64Sub(std::string sub, bool sslibev, bool ssrlibev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
+{
+    std::stringstream strstream;
+    std::string strLink;
+
+    sub = urlsafe_base64_decode(sub);
+    if(regFind(sub, "(vmess|shadowsocks|http|trojan)\\s*?="))
+    {
+        if(explodeSurge(sub, custom_port, nodes, sslibev))
+            return;
+    }
+    char delimiter = count(sub.begin(), sub.end(), '\n') < 1 ? count(sub.begin(), sub.end(), '\r') < 1 ? ' ' : '\r' : '\n';
+    if(count(sub.begin(), sub.end(), delimiter) >= SUB_PARALLEL_THRESHOLD)
+    {
+        //explode chunks of links on all cores, then join them in their original order
+        string_array links = split(sub, std::string(1, delimiter));
+        size_t chunks = (links.size() + SUB_PARALLEL_CHUNK - 1) / SUB_PARALLEL_CHUNK;
+        std::vector<std::vector<nodeInfo>> results(chunks);
+        eraseElements(sub);
+        parallelRun(chunks, [&](size_t index)
+        {
+            size_t end = std::min(links.size(), (index + 1) * SUB_PARALLEL_CHUNK);
+            for(size_t i = index * SUB_PARALLEL_CHUNK; i < end; i++)
+                explodeSubLink(links[i], sslibev, ssrlibev, custom_port, results[index]);
+        });
+        for(std::vector<nodeInfo> &x : results)
+            std::move(x.begin(), x.end(), std::back_inserter(nodes));
+        return;
+    }
+    strstream << sub;
+    while(getline(strstream, strLink, delimiter))
+        explodeSubLink(strLink, sslibev, ssrlibev, custom_port, nodes);
+}
+
+static void explodeSubFormat(const std::string &sub, int format, bool sslibev, bool ssrlibev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
+{
+    //go straight to the parser of the detected format
+    switch(format)
+    {
+    case SUB_FORMAT_SSD:
+        explodeSSD(sub, sslibev, custom_port, nodes);
+        return;
+    case SUB_FORMAT_CLASH:
+        if(explodeClashContent(sub, custom_port, nodes, sslibev, ssrlibev))
+            return;
+        break;
+    case SUB_FORMAT_SURGE:
+        if(explodeSurge(sub, custom_port, nodes, sslibev))
+            return;
+        break;
+    case SUB_FORMAT_BASE64:
+        explodeBase64Sub(sub, sslibev, ssrlibev, custom_port, nodes);
+        return;
+    }
+
+    //unknown or misdetected content, try every parser in turn
+    if(startsWith(sub, "ssd://"))
+    {
+        explodeSSD(sub, sslibev, custom_port, nodes);
+        return;
+    }
+    if(regFind(sub, "\"?(Proxy|proxies)\"?:") && explodeClashContent(sub, custom_port, nodes, sslibev, ssrlibev))
+        return;
+    if(explodeSurge(sub, custom_port, nodes, sslibev))
+        return;
+    explodeBase64Sub(sub, sslibev, ssrlibev, custom_port, nodes);
+}
+
+void explodeSub(std::string sub, bool sslibev, bool ssrlibev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
+{
+    explodeSubFormat(sub, detectSubFormat(sub), sslibev, ssrlibev, custom_port, nodes);
+}
+
+int explodeConf(std::string filepath, const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes)
+{
+    std::ifstream infile;
+    std::stringstream contentstrm;
+    infile.open(filepath);
+
+    contentstrm << infile.rdbuf();
+    infile.close();
+
+    return explodeConfContent(contentstrm.str(), custom_port, sslibev, ssrlibev, nodes);
+}
+
+int explodeConfContent(const std::string &content, const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes, int *format)
+{
+    int filetype = detectSubFormat(content);
+    if(format)
+        *format = filetype;
+
+    switch(filetype)
+    {
+    case SUB_FORMAT_SS_CONF:
+        explodeSSConf(content, custom_port, sslibev, nodes);
+        break;
+    case SUB_FORMAT_SSR_CONF:
+        explodeSSRConf(content, custom_port, sslibev, ssrlibev, nodes);
+        break;
+    case SUB_FORMAT_VMESS_CONF:
+        explodeVmessConf(content, custom_port, sslibev, nodes);
+        break;
+    case SUB_FORMAT_SS_ANDROID:
+        explodeSSAndroid(content, sslibev, custom_port, nodes);
+        break;
+    case SUB_FORMAT_SSTAP:
+        explodeSSTap(content, custom_port, nodes, sslibev, ssrlibev);
+        break;
+    case SUB_FORMAT_NETCH:
+        explodeNetchConf(content, sslibev, ssrlibev, custom_port, nodes);
+        break;
+    default:
+        //try to parse as a local subscription
+        explodeSubFormat(content, filetype, sslibev, ssrlibev, custom_port, nodes);
+    }
+
+    if(nodes.size() == 0)
+        return SPEEDTEST_ERROR_UNRECOGFILE;
+    else
+        return SPEEDTEST_ERROR_NONE;
+}
+
+void explode(const std::string &link, bool sslibev, bool ssrlibev, const std::string &custom_port, nodeInfo &node)
+{
+    // TODO: replace strFind with startsWith if appropriate
     if(strFind(link, "ssr://"))
         explodeSSR(link, sslibev, ssrlibev, custom_port, node);
     else if(strFind(link, "vmess://") || strFind(link, "vmess1://"))
@@ -2037,171 +2646,240 @@ void explode(const std::string &link, bool sslibev, bool ssrlibev, const std::st
         explodeHTTPSub(link, custom_port, node);
 }
 
-void explodeSub(std::string sub, bool sslibev, bool ssrlibev, const std::string &custom_port, std::vector<nodeInfo> &nodes)
+enum
 {
-    std::stringstream strstream;
-    std::string strLink;
-    bool processed = false;
-    nodeInfo node;
+    SUB_STREAM_DETECT,
+    SUB_STREAM_FALLBACK,
+    SUB_STREAM_SURGE,
+    SUB_STREAM_BASE64
+};
 
-    //try to parse as SSD configuration
-    if(startsWith(sub, "ssd://"))
-    {
-        explodeSSD(sub, sslibev, custom_port, nodes);
-        processed = true;
-    }
+enum
+{
+    SUB_STREAM_LINE_UNKNOWN,
+    SUB_STREAM_LINE_LINKS,
+    SUB_STREAM_LINE_SURGE
+};
 
-    //try to parse as clash configuration
-    try
+#define SUB_STREAM_DETECT_SIZE 4096 /// give up looking for the first line after this many bytes
+#define SUB_STREAM_WINDOW 64 /// Surge proxy lines handed to explodeSurge at once
+
+SubStreamParser::SubStreamParser(const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes, std::string &fallback, size_t fallback_limit)
+    : custom_port(custom_port), sslibev(sslibev), ssrlibev(ssrlibev), nodes(nodes), fallback(fallback), fallback_limit(fallback_limit)
+{
+}
+
+bool SubStreamParser::detect(bool force)
+{
+    string_size pos = 0, next;
+    std::string strLine;
+    while(true)
     {
-        if(!processed && regFind(sub, "\"?(Proxy|proxies)\"?:"))
+        next = head.find('\n', pos);
+        if(next == head.npos)
         {
-            regGetMatch(sub, R"(^(?:Proxy|proxies):$\s(?:(?:^ +?.*$| *?-.*$|)\s?)+)", 1, &sub);
-            Node yamlnode = Load(sub);
-            if(yamlnode.size() && (yamlnode["Proxy"].IsDefined() || yamlnode["proxies"].IsDefined()))
-            {
-                explodeClash(yamlnode, custom_port, nodes, sslibev, ssrlibev);
-                processed = true;
-            }
+            if(!force && head.size() - pos < SUB_STREAM_DETECT_SIZE)
+                return false;
+            strLine = trim(trim_of(head.substr(pos), '\r'));
+            break;
         }
-    }
-    catch (std::exception &e)
-    {
-        writeLog(0, e.what(), LOG_LEVEL_DEBUG);
-        //ignore
+        strLine = trim(trim_of(head.substr(pos, next - pos), '\r'));
+        pos = next + 1;
+        /// skip blank lines and comments, such as the managed config line of Surge
+        if(strLine.find_first_not_of(' ') != strLine.npos && strLine[0] != '#' && strLine[0] != ';')
+            break;
     }
 
-    //try to parse as surge configuration
-    if(!processed && explodeSurge(sub, custom_port, nodes, sslibev))
-    {
-        processed = true;
-    }
+    if(startsWith(strLine, "["))
+        mode = SUB_STREAM_SURGE;
+    else if(isBase64Line(strLine, 0, strLine.size()))
+        mode = SUB_STREAM_BASE64;
+    else
+        mode = SUB_STREAM_FALLBACK; /// SSD, Clash and JSON configurations need the whole content
+    return true;
+}
 
-    //try to parse as normal subscription
-    if(!processed)
+bool SubStreamParser::feed(const char *data, size_t len)
+{
+    switch(mode)
+    {
+    case SUB_STREAM_DETECT:
     {
-        sub = urlsafe_base64_decode(sub);
-        if(regFind(sub, "(vmess|shadowsocks|http|trojan)\\s*?="))
+        head.append(data, len);
+        if(!detect(false))
+            return head.size() <= fallback_limit;
+        std::string buffered;
+        buffered.swap(head);
+        return feed(buffered.data(), buffered.size());
+    }
+    case SUB_STREAM_FALLBACK:
+        if(fallback.size() + len > fallback_limit)
         {
-            if(explodeSurge(sub, custom_port, nodes, sslibev))
-                return;
+            writeLog(0, "Subscription exceeds the maximum allowed download size.", LOG_LEVEL_ERROR);
+            return false;
         }
-        strstream << sub;
-        char delimiter = count(sub.begin(), sub.end(), '\n') < 1 ? count(sub.begin(), sub.end(), '\r') < 1 ? ' ' : '\r' : '\n';
-        while(getline(strstream, strLink, delimiter))
+        fallback.append(data, len);
+        return true;
+    case SUB_STREAM_SURGE:
+        return feedLines(data, len);
+    case SUB_STREAM_BASE64:
+    {
+        std::string decoded;
+        string_size aligned;
+        for(size_t i = 0; i < len && !base64_done; i++)
         {
-            if(strLink.rfind("\r") != strLink.npos)
-                strLink.erase(strLink.size() - 1);
-            node.linkType = -1;
-            explode(strLink, sslibev, ssrlibev, custom_port, node);
-            if(strLink.size() == 0 || node.linkType == -1)
+            if(data[i] == '=')
+                base64_done = true;
+            else if(isBase64Char(data[i]))
+                pending += data[i];
+            else
             {
-                continue;
+                /// same as base64_decode: copy the character and drop the unfinished quantum
+                pending.erase(pending.size() - pending.size() % 4);
+                decoded += urlsafe_base64_decode(pending);
+                decoded += data[i];
+                pending.clear();
             }
-            nodes.emplace_back(std::move(node));
-            node = nodeInfo();
         }
+        aligned = base64_done ? pending.size() : pending.size() - pending.size() % 4;
+        decoded += urlsafe_base64_decode(pending.substr(0, aligned));
+        pending.erase(0, aligned);
+        return feedLines(decoded.data(), decoded.size());
     }
+    }
+    return true;
 }
 
-void filterNodes(std::vector<nodeInfo> &nodes, string_array &exclude_remarks, string_array &include_remarks, int groupID)
+bool SubStreamParser::feedLines(const char *data, size_t len)
 {
-    int node_index = 0;
-    std::vector<nodeInfo>::iterator iter = nodes.begin();
-    while(iter != nodes.end())
+    const char *end = data + len, *next;
+    while((next = static_cast<const char*>(memchr(data, '\n', end - data))) != NULL)
     {
-        if(chkIgnore(*iter, exclude_remarks, include_remarks))
-        {
-            writeLog(LOG_TYPE_INFO, "Node  " + iter->group + " - " + iter->remarks + "  has been ignored and will not be added.");
-            nodes.erase(iter);
-        }
-        else
-        {
-            writeLog(LOG_TYPE_INFO, "Node  " + iter->group + " - " + iter->remarks + "  has been added.");
-            iter->id = node_index;
-            iter->groupID = groupID;
-            ++node_index;
-            ++iter;
-        }
+        line.append(data, next - data);
+        saw_newline = true;
+        processLine(line);
+        line.clear();
+        data = next + 1;
     }
-    /*
-    std::vector<std::unique_ptr<pcre2_code, decltype(&pcre2_code_free)>> exclude_patterns, include_patterns;
-    std::vector<std::unique_ptr<pcre2_match_data, decltype(&pcre2_match_data_free)>> exclude_match_data, include_match_data;
-    unsigned int i = 0;
-    PCRE2_SIZE erroroffset;
-    int errornumber, rc;
+    line.append(data, end - data);
+    if(line.size() > fallback_limit)
+    {
+        writeLog(0, "Subscription line exceeds the maximum allowed download size.", LOG_LEVEL_ERROR);
+        return false;
+    }
+    return true;
+}
+
+void SubStreamParser::processLine(std::string &strLink)
+{
+    nodeInfo node;
+
+    if(strLink.size() && strLink.back() == '\r')
+        strLink.erase(strLink.size() - 1);
+    if(mode == SUB_STREAM_SURGE)
+        return processSurgeLine(strLink);
 
-    for(i = 0; i < exclude_remarks.size(); i++)
+    if(line_mode == SUB_STREAM_LINE_UNKNOWN)
     {
-        std::unique_ptr<pcre2_code, decltype(&pcre2_code_free)> pattern(pcre2_compile(reinterpret_cast<const unsigned char*>(exclude_remarks[i].c_str()), exclude_remarks[i].size(), PCRE2_UTF | PCRE2_MULTILINE | PCRE2_ALT_BSUX, &errornumber, &erroroffset, NULL), &pcre2_code_free);
-        if(!pattern)
+        if(strLink.empty())
             return;
-        exclude_patterns.emplace_back(std::move(pattern));
-        pcre2_jit_compile(exclude_patterns[i].get(), 0);
-        std::unique_ptr<pcre2_match_data, decltype(&pcre2_match_data_free)> match_data(pcre2_match_data_create_from_pattern(exclude_patterns[i].get(), NULL), &pcre2_match_data_free);
-        exclude_match_data.emplace_back(std::move(match_data));
+        line_mode = regFind(strLink, "(vmess|shadowsocks|http|trojan)\\s*?=") ? SUB_STREAM_LINE_SURGE : SUB_STREAM_LINE_LINKS;
+        /// decoded Surge proxy lists come without a section title
+        in_proxy = line_mode == SUB_STREAM_LINE_SURGE;
     }
-    for(i = 0; i < include_remarks.size(); i++)
+    if(line_mode == SUB_STREAM_LINE_SURGE)
+        return processSurgeLine(strLink);
+
+    explode(strLink, sslibev, ssrlibev, custom_port, node);
+    if(strLink.size() == 0 || node.linkType == -1)
+        return;
+    nodes.emplace_back(std::move(node));
+}
+
+void SubStreamParser::processSurgeLine(const std::string &strLine)
+{
+    std::string strTrim = trim(strLine);
+    if(startsWith(strTrim, "[") && endsWith(strTrim, "]"))
     {
-        std::unique_ptr<pcre2_code, decltype(&pcre2_code_free)> pattern(pcre2_compile(reinterpret_cast<const unsigned char*>(include_remarks[i].c_str()), include_remarks[i].size(), PCRE2_UTF | PCRE2_MULTILINE | PCRE2_ALT_BSUX, &errornumber, &erroroffset, NULL), &pcre2_code_free);
-        if(!pattern)
-            return;
-        include_patterns.emplace_back(std::move(pattern));
-        pcre2_jit_compile(include_patterns[i].get(), 0);
-        std::unique_ptr<pcre2_match_data, decltype(&pcre2_match_data_free)> match_data(pcre2_match_data_create_from_pattern(include_patterns[i].get(), NULL), &pcre2_match_data_free);
-        include_match_data.emplace_back(std::move(match_data));
+        in_proxy = strTrim == "[Proxy]";
+        return;
+    }
+    if(!in_proxy || strTrim.find_first_not_of(' ') == strTrim.npos)
+        return;
+    window += strLine;
+    window += '\n';
+    if(++window_lines >= SUB_STREAM_WINDOW)
+        flushSurge();
+}
+
+void SubStreamParser::flushSurge()
+{
+    if(window.empty())
+        return;
+    explodeSurge("[Proxy]\n" + window, custom_port, nodes, sslibev);
+    window.clear();
+    window_lines = 0;
+}
+
+int SubStreamParser::getFormat() const
+{
+    switch(mode)
+    {
+    case SUB_STREAM_SURGE:
+        return SUB_FORMAT_SURGE;
+    case SUB_STREAM_BASE64:
+        return SUB_FORMAT_BASE64;
+    default:
+        return SUB_FORMAT_UNKNOWN;
     }
-    writeLog(LOG_TYPE_INFO, "Filter started.");
-    while(iter != nodes.end())
+}
+
+bool SubStreamParser::finish()
+{
+    if(mode == SUB_STREAM_DETECT)
     {
-        bool excluded = false, included = false;
-        for(i = 0; i < exclude_patterns.size(); i++)
+        if(head.empty())
+            return false;
+        detect(true);
+        std::string buffered;
+        buffered.swap(head);
+        if(!feed(buffered.data(), buffered.size()))
         {
-            rc = pcre2_match(exclude_patterns[i].get(), reinterpret_cast<const unsigned char*>(iter->remarks.c_str()), iter->remarks.size(), 0, 0, exclude_match_data[i].get(), NULL);
-            if (rc < 0)
-            {
-                switch(rc)
-                {
-                case PCRE2_ERROR_NOMATCH: break;
-                default: return;
-                }
-            }
-            else
-                excluded = true;
+            fallback.clear();
+            return false;
         }
-        if(include_patterns.size() > 0)
-            for(i = 0; i < include_patterns.size(); i++)
-            {
-                rc = pcre2_match(include_patterns[i].get(), reinterpret_cast<const unsigned char*>(iter->remarks.c_str()), iter->remarks.size(), 0, 0, include_match_data[i].get(), NULL);
-                if (rc < 0)
-                {
-                    switch(rc)
-                    {
-                    case PCRE2_ERROR_NOMATCH: break;
-                    default: return;
-                    }
-                }
-                else
-                    included = true;
-            }
-        else
-            included = true;
-        if(excluded || !included)
+    }
+
+    switch(mode)
+    {
+    case SUB_STREAM_FALLBACK:
+        return false;
+    case SUB_STREAM_BASE64:
+        if(pending.size())
         {
-            writeLog(LOG_TYPE_INFO, "Node  " + iter->group + " - " + iter->remarks + "  has been ignored and will not be added.");
-            nodes.erase(iter);
+            std::string decoded = urlsafe_base64_decode(pending);
+            pending.clear();
+            feedLines(decoded.data(), decoded.size());
         }
-        else
+        if(!saw_newline)
         {
-            writeLog(LOG_TYPE_INFO, "Node  " + iter->group + " - " + iter->remarks + "  has been added.");
-            iter->id = node_index;
-            iter->groupID = groupID;
-            ++node_index;
-            ++iter;
+            /// single line content, split it the same way as explodeSub does
+            for(std::string &x : split(line, line.find('\r') != line.npos ? "\r" : " "))
+                processLine(x);
+            line.clear();
         }
+        break;
     }
-    */
-    writeLog(LOG_TYPE_INFO, "Filter done.");
+    if(line.size())
+        processLine(line);
+    line.clear();
+    flushSurge();
+    return true;
+}
+
+void filterNodes(std::vector<nodeInfo> &nodes, string_array &exclude_remarks, string_array &include_remarks, int groupID)
+{
+    NodeFilter(exclude_remarks, include_remarks).apply(nodes, groupID);
 }
 
 unsigned long long streamToInt(const std::string &stream)
@@ -2276,61 +2954,52 @@ bool getSubInfoFromHeader(const std::string &header, std::string &result)
     return false;
 }
 
-bool getSubInfoFromNodes(const std::vector<nodeInfo> &nodes, const string_array &stream_rules, const string_array &time_rules, std::string &result)
+replace_rules compileReplaceRules(const string_array &rules)
 {
-    std::string remarks, pattern, target, stream_info, time_info, retStr;
+    replace_rules result;
     string_size spos;
+    for(const std::string &x : rules)
+    {
+        spos = x.rfind("|");
+        if(spos == x.npos)
+            continue;
+        result.push_back({regCompile(x.substr(0, spos), true), regCompile(x.substr(0, spos)), x.substr(spos + 1)});
+    }
+    return result;
+}
 
-    for(const nodeInfo &x : nodes)
+static bool applyReplaceRules(const std::string &remarks, const replace_rules &rules, std::string &result)
+{
+    std::string retStr;
+    for(const replace_rule &x : rules)
     {
-        remarks = x.remarks;
-        if(!stream_info.size())
+        if(!regExec(remarks, x.match))
+            continue;
+        retStr = regReplace(remarks, x.pattern, x.target);
+        if(retStr != remarks)
         {
-            for(const std::string &y : stream_rules)
-            {
-                spos = y.rfind("|");
-                if(spos == y.npos)
-                    continue;
-                pattern = y.substr(0, spos);
-                target = y.substr(spos + 1);
-                if(regMatch(remarks, pattern))
-                {
-                    retStr = regReplace(remarks, pattern, target);
-                    if(retStr != remarks)
-                    {
-                        stream_info = retStr;
-                        break;
-                    }
-                }
-                else
-                    continue;
-            }
+            result = retStr;
+            return true;
         }
+    }
+    return false;
+}
 
-        remarks = x.remarks;
-        if(!time_info.size())
-        {
-            for(const std::string &y : time_rules)
-            {
-                spos = y.rfind("|");
-                if(spos == y.npos)
-                    continue;
-                pattern = y.substr(0, spos);
-                target = y.substr(spos + 1);
-                if(regMatch(remarks, pattern))
-                {
-                    retStr = regReplace(remarks, pattern, target);
-                    if(retStr != remarks)
-                    {
-                        time_info = retStr;
-                        break;
-                    }
-                }
-                else
-                    continue;
-            }
-        }
+bool getSubInfoFromNodes(const std::vector<nodeInfo> &nodes, const string_array &stream_rules, const string_array &time_rules, std::string &result)
+{
+    return getSubInfoFromNodes(nodes, compileReplaceRules(stream_rules), compileReplaceRules(time_rules), result);
+}
 
+bool getSubInfoFromNodes(const std::vector<nodeInfo> &nodes, const replace_rules &stream_rules, const replace_rules &time_rules, std::string &result)
+{
+    std::string stream_info, time_info;
+
+    for(const nodeInfo &x : nodes)
+    {
+        if(!stream_info.size())
+            applyReplaceRules(x.remarks, stream_rules, stream_info);
+        if(!time_info.size())
+            applyReplaceRules(x.remarks, time_rules, time_info);
         if(stream_info.size() && time_info.size())
             break;
     }
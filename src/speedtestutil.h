@@ -2,21 +2,40 @@
 #define SPEEDTESTUTIL_H_INCLUDED
 
 #include <string>
+#include <string_view>
 
 #include "misc.h"
 #include "nodeinfo.h"
 
-std::string vmessConstruct(const std::string &group, const std::string &remarks, const std::string &add, const std::string &port, const std::string &type, const std::string &id, const std::string &aid, const std::string &net, const std::string &cipher, const std::string &path, const std::string &host, const std::string &edge, const std::string &tls, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
-std::string ssrConstruct(const std::string &group, const std::string &remarks, const std::string &remarks_base64, const std::string &server, const std::string &port, const std::string &protocol, const std::string &method, const std::string &obfs, const std::string &password, const std::string &obfsparam, const std::string &protoparam, bool libev, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool());
-std::string ssConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &password, const std::string &method, const std::string &plugin, const std::string &pluginopts, bool libev, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
-std::string socksConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &username, const std::string &password, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool());
-std::string httpConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &username, const std::string &password, bool tls, tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
-std::string trojanConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &password, const std::string &host, bool tlssecure, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
-std::string snellConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &password, const std::string &obfs, const std::string &host, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool());
-void explodeVmess(std::string vmess, const std::string &custom_port, nodeInfo &node);
-void explodeSSR(std::string ssr, bool ss_libev, bool libev, const std::string &custom_port, nodeInfo &node);
-void explodeSS(std::string ss, bool libev, const std::string &custom_port, nodeInfo &node);
-void explodeTrojan(std::string trojan, const std::string &custom_port, nodeInfo &node);
+enum sub_format
+{
+    SUB_FORMAT_UNKNOWN,
+    SUB_FORMAT_SSD,
+    SUB_FORMAT_CLASH,
+    SUB_FORMAT_SURGE,
+    SUB_FORMAT_BASE64,
+    SUB_FORMAT_SS_CONF,
+    SUB_FORMAT_SSR_CONF,
+    SUB_FORMAT_VMESS_CONF,
+    SUB_FORMAT_SS_ANDROID,
+    SUB_FORMAT_SSTAP,
+    SUB_FORMAT_NETCH
+};
+
+proxyInfo vmessConstruct(const std::string &add, const std::string &port, const std::string &type, const std::string &id, const std::string &aid, const std::string &net, const std::string &cipher, const std::string &path, const std::string &host, const std::string &edge, const std::string &tls, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
+proxyInfo ssrConstruct(const std::string &server, const std::string &port, const std::string &protocol, const std::string &method, const std::string &obfs, const std::string &password, const std::string &obfsparam, const std::string &protoparam, bool libev, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool());
+proxyInfo ssConstruct(const std::string &server, const std::string &port, const std::string &password, const std::string &method, const std::string &plugin, const std::string &pluginopts, bool libev, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
+proxyInfo socksConstruct(const std::string &server, const std::string &port, const std::string &username, const std::string &password, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool());
+proxyInfo httpConstruct(const std::string &server, const std::string &port, const std::string &username, const std::string &password, bool tls, tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
+proxyInfo trojanConstruct(const std::string &server, const std::string &port, const std::string &password, const std::string &host, bool tlssecure, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool(), tribool tls13 = tribool());
+proxyInfo snellConstruct(const std::string &server, const std::string &port, const std::string &password, const std::string &obfs, const std::string &host, tribool udp = tribool(), tribool tfo = tribool(), tribool scv = tribool());
+std::string getProxyTypeName(const nodeInfo &node);
+/// Serialize the typed proxy info to the JSON form exposed to scripts as ProxyInfo
+std::string proxyInfoToJson(const nodeInfo &node);
+void explodeVmess(std::string_view vmess, const std::string &custom_port, nodeInfo &node);
+void explodeSSR(std::string_view ssr, bool ss_libev, bool libev, const std::string &custom_port, nodeInfo &node);
+void explodeSS(std::string_view ss, bool libev, const std::string &custom_port, nodeInfo &node);
+void explodeTrojan(std::string_view trojan, const std::string &custom_port, nodeInfo &node);
 void explodeQuan(const std::string &quan, const std::string &custom_port, nodeInfo &node);
 void explodeStdVMess(std::string vmess, const std::string &custom_port, nodeInfo &node);
 void explodeShadowrocket(std::string kit, const std::string &custom_port, nodeInfo &node);
@@ -26,10 +45,84 @@ void explode(const std::string &link, bool sslibev, bool ssrlibev, const std::st
 void explodeSSD(std::string link, bool libev, const std::string &custom_port, std::vector<nodeInfo> &nodes);
 void explodeSub(std::string sub, bool sslibev, bool ssrlibev, const std::string &custom_port, std::vector<nodeInfo> &nodes);
 int explodeConf(std::string filepath, const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes);
-int explodeConfContent(const std::string &content, const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes);
+/// Classify a subscription in a single pass over the content, returns one of sub_format.
+/// JSON bodies and line-oriented bodies without a recognizable first line are walked to the end, since their keys may appear anywhere.
+int detectSubFormat(const std::string &content);
+std::string getSubFormatName(int format);
+/// count a parsed subscription under its detected format
+void countSubFormat(int format);
+/// per-format subscription counters, one "sub_format_<name>: <count>" line each
+std::string getSubFormatStatus();
+int explodeConfContent(const std::string &content, const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes, int *format = NULL);
+
+/// Incremental parser for line-oriented subscriptions (base64 link lists and Surge [Proxy] sections).
+/// Chunks are exploded as soon as lines complete, any other format is collected into fallback untouched.
+class SubStreamParser
+{
+public:
+    SubStreamParser(const std::string &custom_port, bool sslibev, bool ssrlibev, std::vector<nodeInfo> &nodes, std::string &fallback, size_t fallback_limit);
+    /// returns false when the transfer should be aborted
+    bool feed(const char *data, size_t len);
+    /// returns true if the content has been parsed into nodes, false if it was left in fallback
+    bool finish();
+    /// one of sub_format, SUB_FORMAT_UNKNOWN if the content was not streamed
+    int getFormat() const;
+
+private:
+    std::string custom_port;
+    bool sslibev, ssrlibev;
+    std::vector<nodeInfo> &nodes;
+    std::string &fallback;
+    size_t fallback_limit;
+    int mode = 0, line_mode = 0;
+    std::string head, line, pending, window;
+    unsigned int window_lines = 0;
+    bool in_proxy = false, saw_newline = false, base64_done = false;
+
+    bool detect(bool force);
+    bool feedLines(const char *data, size_t len);
+    void processLine(std::string &strLink);
+    void processSurgeLine(const std::string &strLine);
+    void flushSurge();
+};
+
+/// Include/exclude remarks rules with their !!GROUP= and !!GROUPID= prefixes parsed and patterns compiled once,
+/// build it once per request and apply it to every subscription
+class NodeFilter
+{
+public:
+    NodeFilter() = default;
+    NodeFilter(const string_array &exclude_remarks, const string_array &include_remarks);
+    bool ignored(const nodeInfo &node) const;
+    /// drop ignored nodes in a single pass, the rest are numbered and moved to groupID
+    void apply(std::vector<nodeInfo> &nodes, int groupID) const;
+
+private:
+    struct rule
+    {
+        int matcher = 0;
+        std::string range;
+        compiled_regex_ptr group, remarks;
+    };
+    std::vector<rule> exclude, include;
+
+    static void compile(const string_array &source, std::vector<rule> &rules);
+    static bool matches(const rule &x, const nodeInfo &node);
+};
+
+/// "pattern|replacement" rules used to read the subscription info from node remarks
+struct replace_rule
+{
+    compiled_regex_ptr match, pattern;
+    std::string target;
+};
+typedef std::vector<replace_rule> replace_rules;
+replace_rules compileReplaceRules(const string_array &rules);
+
 bool chkIgnore(const nodeInfo &node, string_array &exclude_remarks, string_array &include_remarks);
 void filterNodes(std::vector<nodeInfo> &nodes, string_array &exclude_remarks, string_array &include_remarks, int groupID);
 bool getSubInfoFromHeader(const std::string &header, std::string &result);
+bool getSubInfoFromNodes(const std::vector<nodeInfo> &nodes, const replace_rules &stream_rules, const replace_rules &time_rules, std::string &result);
 bool getSubInfoFromNodes(const std::vector<nodeInfo> &nodes, const string_array &stream_rules, const string_array &time_rules, std::string &result);
 bool getSubInfoFromSSD(const std::string &sub, std::string &result);
 unsigned long long streamToInt(const std::string &stream);
@@ -3,6 +3,8 @@
 #include <numeric>
 #include <cmath>
 #include <climits>
+#include <list>
+#include <unordered_map>
 #include <rapidjson/writer.h>
 #include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
@@ -24,6 +26,7 @@
 #include "script_duktape.h"
 #include "yamlcpp_extra.h"
 #include "interfaces.h"
+#include "regex_prefilter.h"
 
 extern bool gAPIMode, gSurgeResolveHostname;
 extern string_array ss_ciphers, ssr_ciphers;
@@ -76,326 +79,270 @@ std::string hostnameToIPAddr(const std::string &host)
     return retAddr;
 }
 
-std::string vmessConstruct(const std::string &group, const std::string &remarks, const std::string &add, const std::string &port, const std::string &type, const std::string &id, const std::string &aid, const std::string &net, const std::string &cipher, const std::string &path, const std::string &host, const std::string &edge, const std::string &tls, tribool udp, tribool tfo, tribool scv, tribool tls13)
+proxyInfo vmessConstruct(const std::string &add, const std::string &port, const std::string &type, const std::string &id, const std::string &aid, const std::string &net, const std::string &cipher, const std::string &path, const std::string &host, const std::string &edge, const std::string &tls, tribool udp, tribool tfo, tribool scv, tribool tls13)
 {
-    rapidjson::StringBuffer sb;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-    writer.StartObject();
-    writer.Key("Type");
-    writer.String("VMess");
-    writer.Key("Group");
-    writer.String(group.data());
-    writer.Key("Remark");
-    writer.String(remarks.data());
-    writer.Key("Hostname");
-    writer.String(add.data());
-    writer.Key("Port");
-    writer.Int(to_int(port));
-    writer.Key("UserID");
-    writer.String(id.empty() ? "00000000-0000-0000-0000-000000000000" : id.data());
-    writer.Key("AlterID");
-    writer.Int(to_int(aid));
-    writer.Key("EncryptMethod");
-    writer.String(cipher.data());
-    writer.Key("TransferProtocol");
-    writer.String(net.empty() ? "tcp" : net.data());
-    writer.Key("Host");
-    writer.String(host.empty() ? add.data() : trim(host).data());
-    writer.Key("Edge");
-    writer.String(edge.data());
+    proxyInfo proxy;
+    proxy.hostname = add;
+    proxy.port = to_int(port);
+    proxy.user_id = id.empty() ? "00000000-0000-0000-0000-000000000000" : id;
+    proxy.alter_id = to_int(aid);
+    proxy.encrypt_method = cipher;
+    proxy.transfer_protocol = net.empty() ? "tcp" : net;
+    proxy.host = host.empty() ? add : trim(host);
+    proxy.edge = edge;
     if(net == "ws" || net == "http")
-    {
-        writer.Key("Path");
-        writer.String(path.empty() ? "/" : trim(path).data());
-    }
+        proxy.path = path.empty() ? "/" : trim(path);
     else
     {
         if(net == "quic")
         {
-            writer.Key("QUICSecure");
-            writer.String(host.data());
-            writer.Key("QUICSecret");
-            writer.String(path.data());
+            proxy.quic_secure = host;
+            proxy.quic_secret = path;
         }
-        writer.Key("FakeType");
-        writer.String(type.data());
-    }
-    writer.Key("TLSSecure");
-    writer.Bool(tls == "tls");
-    if(!udp.is_undef())
-    {
-        writer.Key("EnableUDP");
-        writer.Bool(udp);
-    }
-    if(!tfo.is_undef())
-    {
-        writer.Key("EnableTFO");
-        writer.Bool(tfo);
-    }
-    if(!scv.is_undef())
-    {
-        writer.Key("AllowInsecure");
-        writer.Bool(scv);
-    }
-    if(!tls13.is_undef())
-    {
-        writer.Key("TLS13");
-        writer.Bool(tls13);
-    }
-    writer.EndObject();
-    return sb.GetString();
+        proxy.fake_type = type;
+    }
+    proxy.tls_secure = tls == "tls";
+    proxy.udp = udp;
+    proxy.tfo = tfo;
+    proxy.allow_insecure = scv;
+    proxy.tls13 = tls13;
+    return proxy;
 }
 
-std::string ssrConstruct(const std::string &group, const std::string &remarks, const std::string &remarks_base64, const std::string &server, const std::string &port, const std::string &protocol, const std::string &method, const std::string &obfs, const std::string &password, const std::string &obfsparam, const std::string &protoparam, bool libev, tribool udp, tribool tfo, tribool scv)
+proxyInfo ssrConstruct(const std::string &server, const std::string &port, const std::string &protocol, const std::string &method, const std::string &obfs, const std::string &password, const std::string &obfsparam, const std::string &protoparam, bool libev, tribool udp, tribool tfo, tribool scv)
 {
-    rapidjson::StringBuffer sb;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-    writer.StartObject();
-    writer.Key("Type");
-    writer.String("SSR");
-    writer.Key("Remark");
-    writer.String(remarks.data());
-    writer.Key("Hostname");
-    writer.String(server.data());
-    writer.Key("Port");
-    writer.Int(to_int(port));
-    writer.Key("Password");
-    writer.String(password.data());
-    writer.Key("EncryptMethod");
-    writer.String(method.data());
-    writer.Key("Protocol");
-    writer.String(protocol.data());
-    writer.Key("ProtocolParam");
-    writer.String(protoparam.data());
-    writer.Key("OBFS");
-    writer.String(obfs.data());
-    writer.Key("OBFSParam");
-    writer.String(obfsparam.data());
-    if(!udp.is_undef())
-    {
-        writer.Key("EnableUDP");
-        writer.Bool(udp);
-    }
-    if(!tfo.is_undef())
-    {
-        writer.Key("EnableTFO");
-        writer.Bool(tfo);
-    }
-    if(!scv.is_undef())
-    {
-        writer.Key("AllowInsecure");
-        writer.Bool(scv);
-    }
-    writer.EndObject();
-    return sb.GetString();
+    proxyInfo proxy;
+    proxy.hostname = server;
+    proxy.port = to_int(port);
+    proxy.password = password;
+    proxy.encrypt_method = method;
+    proxy.protocol = protocol;
+    proxy.protocol_param = protoparam;
+    proxy.obfs = obfs;
+    proxy.obfs_param = obfsparam;
+    proxy.udp = udp;
+    proxy.tfo = tfo;
+    proxy.allow_insecure = scv;
+    return proxy;
 }
 
-std::string ssConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &password, const std::string &method, const std::string &plugin, const std::string &pluginopts, bool libev, tribool udp, tribool tfo, tribool scv, tribool tls13)
+proxyInfo ssConstruct(const std::string &server, const std::string &port, const std::string &password, const std::string &method, const std::string &plugin, const std::string &pluginopts, bool libev, tribool udp, tribool tfo, tribool scv, tribool tls13)
 {
-    rapidjson::StringBuffer sb;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-    writer.StartObject();
-    writer.Key("Type");
-    writer.String("SS");
-    writer.Key("Group");
-    writer.String(group.data());
-    writer.Key("Remark");
-    writer.String(remarks.data());
-    writer.Key("Hostname");
-    writer.String(server.data());
-    writer.Key("Port");
-    writer.Int(to_int(port));
-    writer.Key("Password");
-    writer.String(password.data());
-    writer.Key("EncryptMethod");
-    writer.String(method.data());
-    writer.Key("Plugin");
-    writer.String(plugin.data());
-    writer.Key("PluginOption");
-    writer.String(pluginopts.data());
-    if(!udp.is_undef())
-    {
-        writer.Key("EnableUDP");
-        writer.Bool(udp);
-    }
-    if(!tfo.is_undef())
-    {
-        writer.Key("EnableTFO");
-        writer.Bool(tfo);
-    }
-    if(!scv.is_undef())
-    {
-        writer.Key("AllowInsecure");
-        writer.Bool(scv);
-    }
-    if(!tls13.is_undef())
-    {
-        writer.Key("TLS13");
-        writer.Bool(tls13);
-    }
-    writer.EndObject();
-    return sb.GetString();
+    proxyInfo proxy;
+    proxy.hostname = server;
+    proxy.port = to_int(port);
+    proxy.password = password;
+    proxy.encrypt_method = method;
+    proxy.plugin = plugin;
+    proxy.plugin_option = pluginopts;
+    proxy.udp = udp;
+    proxy.tfo = tfo;
+    proxy.allow_insecure = scv;
+    proxy.tls13 = tls13;
+    return proxy;
 }
 
-std::string socksConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &username, const std::string &password, tribool udp, tribool tfo, tribool scv)
+proxyInfo socksConstruct(const std::string &server, const std::string &port, const std::string &username, const std::string &password, tribool udp, tribool tfo, tribool scv)
 {
-    rapidjson::StringBuffer sb;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-    writer.StartObject();
-    writer.Key("Type");
-    writer.String("Socks5");
-    writer.Key("Group");
-    writer.String(group.data());
-    writer.Key("Remark");
-    writer.String(remarks.data());
-    writer.Key("Hostname");
-    writer.String(server.data());
-    writer.Key("Port");
-    writer.Int(to_int(port));
-    writer.Key("Username");
-    writer.String(username.data());
-    writer.Key("Password");
-    writer.String(password.data());
-    if(!udp.is_undef())
-    {
-        writer.Key("EnableUDP");
-        writer.Bool(udp);
-    }
-    if(!tfo.is_undef())
-    {
-        writer.Key("EnableTFO");
-        writer.Bool(tfo);
-    }
-    if(!scv.is_undef())
-    {
-        writer.Key("AllowInsecure");
-        writer.Bool(scv);
-    }
-    writer.EndObject();
-    return sb.GetString();
+    proxyInfo proxy;
+    proxy.hostname = server;
+    proxy.port = to_int(port);
+    proxy.username = username;
+    proxy.password = password;
+    proxy.udp = udp;
+    proxy.tfo = tfo;
+    proxy.allow_insecure = scv;
+    return proxy;
 }
 
-std::string httpConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &username, const std::string &password, bool tls, tribool tfo, tribool scv, tribool tls13)
+proxyInfo httpConstruct(const std::string &server, const std::string &port, const std::string &username, const std::string &password, bool tls, tribool tfo, tribool scv, tribool tls13)
 {
-    rapidjson::StringBuffer sb;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-    writer.StartObject();
-    writer.Key("Type");
-    writer.String(tls ? "HTTPS" : "HTTP");
-    writer.Key("Group");
-    writer.String(group.data());
-    writer.Key("Remark");
-    writer.String(remarks.data());
-    writer.Key("Hostname");
-    writer.String(server.data());
-    writer.Key("Port");
-    writer.Int(to_int(port));
-    writer.Key("Username");
-    writer.String(username.data());
-    writer.Key("Password");
-    writer.String(password.data());
-    writer.Key("TLSSecure");
-    writer.Bool(tls);
-    if(!tfo.is_undef())
-    {
-        writer.Key("EnableTFO");
-        writer.Bool(tfo);
-    }
-    if(!scv.is_undef())
-    {
-        writer.Key("AllowInsecure");
-        writer.Bool(scv);
-    }
-    if(!tls13.is_undef())
-    {
-        writer.Key("TLS13");
-        writer.Bool(tls13);
-    }
-    writer.EndObject();
-    return sb.GetString();
+    proxyInfo proxy;
+    proxy.hostname = server;
+    proxy.port = to_int(port);
+    proxy.username = username;
+    proxy.password = password;
+    proxy.tls_secure = tls;
+    proxy.tfo = tfo;
+    proxy.allow_insecure = scv;
+    proxy.tls13 = tls13;
+    return proxy;
 }
 
-std::string trojanConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &password, const std::string &host, bool tlssecure, tribool udp, tribool tfo, tribool scv, tribool tls13)
+proxyInfo trojanConstruct(const std::string &server, const std::string &port, const std::string &password, const std::string &host, bool tlssecure, tribool udp, tribool tfo, tribool scv, tribool tls13)
 {
-    rapidjson::StringBuffer sb;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-    writer.StartObject();
-    writer.Key("Type");
-    writer.String("Trojan");
-    writer.Key("Group");
-    writer.String(group.data());
-    writer.Key("Remark");
-    writer.String(remarks.data());
-    writer.Key("Hostname");
-    writer.String(server.data());
-    writer.Key("Port");
-    writer.Int(to_int(port));
-    writer.Key("Password");
-    writer.String(password.data());
-    writer.Key("Host");
-    writer.String(host.data());
-    writer.Key("TLSSecure");
-    writer.Bool(tlssecure);
-    if(!udp.is_undef())
-    {
-        writer.Key("EnableUDP");
-        writer.Bool(udp);
-    }
-    if(!tfo.is_undef())
-    {
-        writer.Key("EnableTFO");
-        writer.Bool(tfo);
-    }
-    if(!scv.is_undef())
-    {
-        writer.Key("AllowInsecure");
-        writer.Bool(scv);
-    }
-    if(!tls13.is_undef())
-    {
-        writer.Key("TLS13");
-        writer.Bool(tls13);
+    proxyInfo proxy;
+    proxy.hostname = server;
+    proxy.port = to_int(port);
+    proxy.password = password;
+    proxy.host = host;
+    proxy.tls_secure = tlssecure;
+    proxy.udp = udp;
+    proxy.tfo = tfo;
+    proxy.allow_insecure = scv;
+    proxy.tls13 = tls13;
+    return proxy;
+}
+
+proxyInfo snellConstruct(const std::string &server, const std::string &port, const std::string &password, const std::string &obfs, const std::string &host, tribool udp, tribool tfo, tribool scv)
+{
+    proxyInfo proxy;
+    proxy.hostname = server;
+    proxy.port = to_int(port);
+    proxy.password = password;
+    proxy.obfs = obfs;
+    proxy.host = host;
+    proxy.udp = udp;
+    proxy.tfo = tfo;
+    proxy.allow_insecure = scv;
+    return proxy;
+}
+
+std::string getProxyTypeName(const nodeInfo &node)
+{
+    switch(node.linkType)
+    {
+    case SPEEDTEST_MESSAGE_FOUNDSS:
+        return "SS";
+    case SPEEDTEST_MESSAGE_FOUNDSSR:
+        return "SSR";
+    case SPEEDTEST_MESSAGE_FOUNDVMESS:
+        return "VMess";
+    case SPEEDTEST_MESSAGE_FOUNDSOCKS:
+        return "Socks5";
+    case SPEEDTEST_MESSAGE_FOUNDHTTP:
+        return node.proxy.tls_secure ? "HTTPS" : "HTTP";
+    case SPEEDTEST_MESSAGE_FOUNDTROJAN:
+        return "Trojan";
+    case SPEEDTEST_MESSAGE_FOUNDSNELL:
+        return "Snell";
+    default:
+        return std::string();
     }
-    writer.EndObject();
-    return sb.GetString();
 }
 
-std::string snellConstruct(const std::string &group, const std::string &remarks, const std::string &server, const std::string &port, const std::string &password, const std::string &obfs, const std::string &host, tribool udp, tribool tfo, tribool scv)
+static inline void writeTribool(rapidjson::Writer<rapidjson::StringBuffer> &writer, const char *key, const tribool &value)
 {
+    if(value.is_undef())
+        return;
+    writer.Key(key);
+    writer.Bool(value);
+}
+
+std::string proxyInfoToJson(const nodeInfo &node)
+{
+    const proxyInfo &proxy = node.proxy;
+    std::string type = getProxyTypeName(node);
+    if(type.empty())
+        return std::string();
+
     rapidjson::StringBuffer sb;
     rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
     writer.StartObject();
     writer.Key("Type");
-    writer.String("Snell");
+    writer.String(type.data());
     writer.Key("Group");
-    writer.String(group.data());
+    writer.String(node.group.data());
     writer.Key("Remark");
-    writer.String(remarks.data());
+    writer.String(node.remarks.data());
     writer.Key("Hostname");
-    writer.String(server.data());
+    writer.String(proxy.hostname.data());
     writer.Key("Port");
-    writer.Int(to_int(port));
-    writer.Key("Password");
-    writer.String(password.data());
-    writer.Key("OBFS");
-    writer.String(obfs.data());
-    writer.Key("Host");
-    writer.String(host.data());
-    if(!udp.is_undef())
-    {
-        writer.Key("EnableUDP");
-        writer.Bool(udp);
-    }
-    if(!tfo.is_undef())
-    {
-        writer.Key("EnableTFO");
-        writer.Bool(tfo);
-    }
-    if(!scv.is_undef())
-    {
-        writer.Key("AllowInsecure");
-        writer.Bool(scv);
+    writer.Int(proxy.port);
+    switch(node.linkType)
+    {
+    case SPEEDTEST_MESSAGE_FOUNDVMESS:
+        writer.Key("UserID");
+        writer.String(proxy.user_id.data());
+        writer.Key("AlterID");
+        writer.Int(proxy.alter_id);
+        writer.Key("EncryptMethod");
+        writer.String(proxy.encrypt_method.data());
+        writer.Key("TransferProtocol");
+        writer.String(proxy.transfer_protocol.data());
+        writer.Key("Host");
+        writer.String(proxy.host.data());
+        writer.Key("Edge");
+        writer.String(proxy.edge.data());
+        if(proxy.transfer_protocol == "ws" || proxy.transfer_protocol == "http")
+        {
+            writer.Key("Path");
+            writer.String(proxy.path.data());
+        }
+        else
+        {
+            if(proxy.transfer_protocol == "quic")
+            {
+                writer.Key("QUICSecure");
+                writer.String(proxy.quic_secure.data());
+                writer.Key("QUICSecret");
+                writer.String(proxy.quic_secret.data());
+            }
+            writer.Key("FakeType");
+            writer.String(proxy.fake_type.data());
+        }
+        writer.Key("TLSSecure");
+        writer.Bool(proxy.tls_secure);
+        break;
+    case SPEEDTEST_MESSAGE_FOUNDSSR:
+        writer.Key("Password");
+        writer.String(proxy.password.data());
+        writer.Key("EncryptMethod");
+        writer.String(proxy.encrypt_method.data());
+        writer.Key("Protocol");
+        writer.String(proxy.protocol.data());
+        writer.Key("ProtocolParam");
+        writer.String(proxy.protocol_param.data());
+        writer.Key("OBFS");
+        writer.String(proxy.obfs.data());
+        writer.Key("OBFSParam");
+        writer.String(proxy.obfs_param.data());
+        break;
+    case SPEEDTEST_MESSAGE_FOUNDSS:
+        writer.Key("Password");
+        writer.String(proxy.password.data());
+        writer.Key("EncryptMethod");
+        writer.String(proxy.encrypt_method.data());
+        writer.Key("Plugin");
+        writer.String(proxy.plugin.data());
+        writer.Key("PluginOption");
+        writer.String(proxy.plugin_option.data());
+        break;
+    case SPEEDTEST_MESSAGE_FOUNDSOCKS:
+        writer.Key("Username");
+        writer.String(proxy.username.data());
+        writer.Key("Password");
+        writer.String(proxy.password.data());
+        break;
+    case SPEEDTEST_MESSAGE_FOUNDHTTP:
+        writer.Key("Username");
+        writer.String(proxy.username.data());
+        writer.Key("Password");
+        writer.String(proxy.password.data());
+        writer.Key("TLSSecure");
+        writer.Bool(proxy.tls_secure);
+        break;
+    case SPEEDTEST_MESSAGE_FOUNDTROJAN:
+        writer.Key("Password");
+        writer.String(proxy.password.data());
+        writer.Key("Host");
+        writer.String(proxy.host.data());
+        writer.Key("TLSSecure");
+        writer.Bool(proxy.tls_secure);
+        break;
+    case SPEEDTEST_MESSAGE_FOUNDSNELL:
+        writer.Key("Password");
+        writer.String(proxy.password.data());
+        writer.Key("OBFS");
+        writer.String(proxy.obfs.data());
+        writer.Key("Host");
+        writer.String(proxy.host.data());
+        break;
     }
+    writeTribool(writer, "EnableUDP", proxy.udp);
+    writeTribool(writer, "EnableTFO", proxy.tfo);
+    writeTribool(writer, "AllowInsecure", proxy.allow_insecure);
+    writeTribool(writer, "TLS13", proxy.tls13);
     writer.EndObject();
     return sb.GetString();
 }
@@ -510,52 +457,357 @@ bool applyMatcher(const std::string &rule, std::string &real_rule, const nodeInf
     return true;
 }
 
-void nodeRename(nodeInfo &node, const string_array &rename_array)
+enum
 {
-    string_size pos;
-    std::string match, rep;
-    std::string &remark = node.remarks, original_remark = node.remarks, returned_remark, real_rule;
-    duk_context *ctx = NULL;
-    defer(duk_destroy_heap(ctx);)
+    TRANSFORM_MATCHER_ANY,
+    TRANSFORM_MATCHER_GROUP,
+    TRANSFORM_MATCHER_GROUPID,
+    TRANSFORM_MATCHER_INSERT,
+    TRANSFORM_MATCHER_SCRIPT
+};
+
+/// one rename or emoji rule with its matcher prefix parsed and its remarks pattern compiled
+struct transform_rule
+{
+    int matcher = TRANSFORM_MATCHER_ANY;
+    std::string range;
+    compiled_regex_ptr group, remarks;
+    std::string value; /// replacement, emoji, or script source/path for TRANSFORM_MATCHER_SCRIPT
+    bool script_path = false;
+};
+
+struct node_transform
+{
+    std::vector<transform_rule> rename, emoji;
+    RegexPrefilter rename_prefilter, emoji_prefilter;
+};
 
-    for(const std::string &x : rename_array)
+/// parse "matcher<delimiter>value" rules, rules which can never change a node are left out
+static void compileTransformRules(const string_array &source, char delimiter, bool need_delimiter, std::vector<transform_rule> &rules, RegexPrefilter &prefilter)
+{
+    static const std::string groupid_regex = R"(^!!(?:GROUPID|INSERT)=([\d\-+!,]+)(?:!!(.*))?$)", group_regex = R"(^!!(?:GROUP)=(.*?)(?:!!(.*))?$)";
+    string_array patterns;
+    std::string match, group, real_rule;
+    string_size pos;
+    for(const std::string &x : source)
     {
+        transform_rule item;
         if(startsWith(x, "!!script:"))
         {
-            if(!ctx)
-                ctx = duktape_init();
-            std::string script = x.substr(9);
-            if(startsWith(script, "path:"))
-                script = fileGet(script.substr(5), true);
-            if(ctx)
+            item.matcher = TRANSFORM_MATCHER_SCRIPT;
+            item.value = x.substr(9);
+            if(startsWith(item.value, "path:"))
             {
-                if(duktape_peval(ctx, script) == 0)
-                {
-                    duk_get_global_string(ctx, "rename");
-                    duktape_push_nodeinfo(ctx, node);
-                    if(duk_pcall(ctx, 1) == 0 && !(returned_remark = duktape_get_res_str(ctx)).empty())
-                        remark = returned_remark;
-                }
-                else
-                {
-                    writeLog(0, "Error when trying to parse rename script:\n" + duktape_get_err_stack(ctx), LOG_LEVEL_ERROR);
-                    duk_pop(ctx); // pop err
-                }
+                item.value.erase(0, 5);
+                item.script_path = true;
             }
+            rules.emplace_back(std::move(item));
+            patterns.emplace_back(); //scripts are always candidates
             continue;
         }
-        pos = x.rfind("@");
+        pos = x.rfind(delimiter);
+        if(pos == x.npos && need_delimiter)
+            continue;
         match = x.substr(0, pos);
-        if(pos != x.npos && pos < x.size())
-            rep = x.substr(pos + 1);
+        if(pos != x.npos)
+            item.value = x.substr(pos + 1);
+        group.clear();
+        real_rule.clear();
+        if(startsWith(match, "!!GROUP="))
+        {
+            regGetMatch(match, group_regex, 3, 0, &group, &real_rule);
+            item.matcher = TRANSFORM_MATCHER_GROUP;
+            item.group = regCompile(group);
+        }
+        else if(startsWith(match, "!!GROUPID=") || startsWith(match, "!!INSERT="))
+        {
+            regGetMatch(match, groupid_regex, 3, 0, &group, &real_rule);
+            item.matcher = startsWith(match, "!!INSERT=") ? TRANSFORM_MATCHER_INSERT : TRANSFORM_MATCHER_GROUPID;
+            item.range = group;
+        }
         else
-            rep.clear();
-        if(applyMatcher(match, real_rule, node) && real_rule.size())
-            remark = regReplace(remark, real_rule, rep);
+            real_rule = match;
+        if(real_rule.empty())
+            continue;
+        item.remarks = regCompile(real_rule);
+        rules.emplace_back(std::move(item));
+        patterns.emplace_back(std::move(real_rule));
     }
-    if(remark.empty())
-        remark = original_remark;
-    return;
+    prefilter = RegexPrefilter(patterns);
+}
+
+static bool matchTransformRule(const transform_rule &x, const nodeInfo &node)
+{
+    switch(x.matcher)
+    {
+    case TRANSFORM_MATCHER_GROUP:
+        return regExec(node.group, x.group);
+    case TRANSFORM_MATCHER_GROUPID:
+    case TRANSFORM_MATCHER_INSERT:
+        return matchRange(x.range, (x.matcher == TRANSFORM_MATCHER_INSERT ? -1 : 1) * node.groupID);
+    }
+    return true;
+}
+
+#define NODE_TRANSFORM_CACHE_SIZE 64
+
+typedef std::list<std::string> transform_lru_list;
+
+static std::mutex transform_cache_lock;
+static transform_lru_list transform_cache_order;
+static std::unordered_map<std::string, std::pair<node_transform_ptr, transform_lru_list::iterator>> transform_cache;
+
+static void appendTransformKey(std::string &key, const string_array &rules)
+{
+    key += std::to_string(rules.size()) + "\n";
+    for(const std::string &x : rules)
+        key += std::to_string(x.size()) + ":" + x;
+}
+
+node_transform_ptr compileNodeTransform(const string_array &rename_array, const string_array &emoji_array)
+{
+    std::string key;
+    appendTransformKey(key, rename_array);
+    appendTransformKey(key, emoji_array);
+    {
+        guarded_mutex guard(transform_cache_lock);
+        auto iter = transform_cache.find(key);
+        if(iter != transform_cache.end())
+        {
+            transform_cache_order.splice(transform_cache_order.begin(), transform_cache_order, iter->second.second);
+            return iter->second.first;
+        }
+    }
+
+    std::shared_ptr<node_transform> program = std::make_shared<node_transform>();
+    compileTransformRules(rename_array, '@', false, program->rename, program->rename_prefilter);
+    compileTransformRules(emoji_array, ',', true, program->emoji, program->emoji_prefilter);
+
+    guarded_mutex guard(transform_cache_lock);
+    auto iter = transform_cache.find(key);
+    if(iter != transform_cache.end()) //compiled by another thread in the meantime
+        return iter->second.first;
+    if(transform_cache.size() >= NODE_TRANSFORM_CACHE_SIZE)
+    {
+        transform_cache.erase(transform_cache_order.back());
+        transform_cache_order.pop_back();
+    }
+    transform_cache_order.push_front(key);
+    transform_cache.emplace(std::move(key), std::make_pair(program, transform_cache_order.begin()));
+    return program;
+}
+
+#define TRANSFORM_PARALLEL_THRESHOLD 1024 /// nodes needed before transforming on multiple cores
+#define TRANSFORM_PARALLEL_CHUNK 256
+
+/// run func(begin, end) over the node list, split into chunks on multiple cores for long lists
+static void transformChunks(size_t count, const std::function<void(size_t, size_t)> &func)
+{
+    if(count >= TRANSFORM_PARALLEL_THRESHOLD)
+    {
+        parallelRun((count + TRANSFORM_PARALLEL_CHUNK - 1) / TRANSFORM_PARALLEL_CHUNK, [&](size_t index)
+        {
+            func(index * TRANSFORM_PARALLEL_CHUNK, std::min(count, (index + 1) * TRANSFORM_PARALLEL_CHUNK));
+        });
+    }
+    else
+        func(0, count);
+}
+
+/// contexts of the per-node script rules of one chunk, every script is evaluated once and then called for all nodes of the chunk
+struct transform_scripts
+{
+    std::vector<duk_context*> contexts;
+    std::vector<char> failed;
+
+    transform_scripts(size_t count) : contexts(count, NULL), failed(count, 0) {}
+    ~transform_scripts()
+    {
+        for(duk_context *x : contexts)
+            duktape_release(x);
+    }
+
+    duk_context *get(size_t index, const transform_rule &rule)
+    {
+        if(contexts[index] || failed[index])
+            return contexts[index];
+        failed[index] = 1;
+        duk_context *ctx = duktape_acquire();
+        if(!ctx)
+            return NULL;
+        if(duktape_peval(ctx, rule.script_path ? fileGet(rule.value, true) : rule.value) != 0)
+        {
+            duktape_release(ctx);
+            return NULL;
+        }
+        duk_pop(ctx); // pop eval result
+        failed[index] = 0;
+        return contexts[index] = ctx;
+    }
+};
+
+/// Every script rule is evaluated once on the calling thread first. The ones defining the batch function are kept
+/// and called once with all matching nodes of the whole list, the others are evaluated again for each chunk.
+struct transform_batch_scripts
+{
+    std::vector<duk_context*> contexts; /// NULL for rules which are not batch scripts
+    std::vector<char> failed;
+
+    transform_batch_scripts(const std::vector<transform_rule> &rules, const std::string &kind, const std::string &batch_function) : contexts(rules.size(), NULL), failed(rules.size(), 0)
+    {
+        for(size_t i = 0; i < rules.size(); i++)
+        {
+            const transform_rule &x = rules[i];
+            if(x.matcher != TRANSFORM_MATCHER_SCRIPT)
+                continue;
+            failed[i] = 1;
+            duk_context *ctx = duktape_acquire();
+            if(!ctx)
+                continue;
+            if(duktape_peval(ctx, x.script_path ? fileGet(x.value, true) : x.value) != 0)
+            {
+                writeLog(0, "Error when trying to parse " + kind + " script:\n" + duktape_get_err_stack(ctx), LOG_LEVEL_ERROR);
+                duktape_release(ctx);
+                continue;
+            }
+            duk_pop(ctx); // pop eval result
+            failed[i] = 0;
+            if(duktape_has_function(ctx, batch_function))
+                contexts[i] = ctx;
+            else
+                duktape_release(ctx);
+        }
+    }
+    ~transform_batch_scripts()
+    {
+        for(duk_context *x : contexts)
+            duktape_release(x);
+    }
+};
+
+/// the result is always popped so that the heap stays clean for the next node
+static std::string callTransformScript(duk_context *ctx, const char *function, const nodeInfo &node)
+{
+    std::string result;
+    duk_get_global_string(ctx, function);
+    duktape_push_nodeinfo(ctx, node);
+    int ret = duk_pcall(ctx, 1);
+    duktape_unbind_nodes();
+    if(ret == 0 && !duk_is_null_or_undefined(ctx, -1))
+        result = duk_safe_to_string(ctx, -1);
+    duk_pop(ctx);
+    return result;
+}
+
+/// one call with nodes[index[0]], nodes[index[1]]..., results[k] is left empty if the function has nothing for nodes[index[k]]
+static void callTransformBatch(duk_context *ctx, const char *function, const std::vector<nodeInfo> &nodes, const std::vector<size_t> &index, DuktapeNodeList &objects, string_array &results)
+{
+    results.assign(index.size(), "");
+    duk_get_global_string(ctx, function);
+    objects.push(ctx, nodes, index);
+    int ret = duk_pcall(ctx, 1);
+    duktape_unbind_nodes();
+    if(ret == 0)
+        duktape_get_res_str_list(ctx, results);
+    else
+    {
+        writeLog(0, "Error when trying to evaluate script:\n" + duktape_get_err_stack(ctx), LOG_LEVEL_ERROR);
+        duk_pop(ctx); // pop err
+    }
+}
+
+/// per node state of one preprocessNodes run, each chunk only touches its own nodes
+struct transform_state
+{
+    std::vector<std::vector<char>> candidates;
+    std::vector<char> done;
+    DuktapeNodeList local_objects, *objects;
+
+    transform_state(size_t count, DuktapeNodeList *node_objects) : candidates(count), done(count, 0), objects(node_objects ? node_objects : &local_objects) {}
+};
+
+/// rename rules [first, last) on nodes [begin, end), none of them is a batch script
+static void renameChunk(const node_transform &program, const transform_batch_scripts &batch, std::vector<nodeInfo> &nodes, size_t begin, size_t end, size_t first, size_t last, transform_state &state)
+{
+    transform_scripts scripts(program.rename.size());
+    std::string result;
+    duk_context *ctx = NULL;
+    for(size_t i = first; i < last; i++)
+    {
+        const transform_rule &x = program.rename[i];
+        bool script = x.matcher == TRANSFORM_MATCHER_SCRIPT;
+        if(script && (batch.failed[i] || !(ctx = scripts.get(i, x))))
+            continue;
+        for(size_t j = begin; j < end; j++)
+        {
+            nodeInfo &node = nodes[j];
+            if(!state.candidates[j][i] || !matchTransformRule(x, node))
+                continue;
+            result = script ? callTransformScript(ctx, "rename", node) : regReplace(node.remarks, x.remarks, x.value);
+            if((script && result.empty()) || result == node.remarks)
+                continue;
+            node.remarks.swap(result);
+            //every change of a remark has to be scanned again for the rules after it
+            program.rename_prefilter.scan(node.remarks, state.candidates[j]);
+        }
+    }
+}
+
+static void renameBatch(const node_transform &program, size_t i, duk_context *ctx, std::vector<nodeInfo> &nodes, transform_state &state)
+{
+    const transform_rule &x = program.rename[i];
+    std::vector<size_t> index;
+    string_array results;
+    for(size_t j = 0; j < nodes.size(); j++)
+        if(state.candidates[j][i] && matchTransformRule(x, nodes[j]))
+            index.push_back(j);
+    if(index.empty())
+        return;
+    callTransformBatch(ctx, "renameAll", nodes, index, *state.objects, results);
+    for(size_t k = 0; k < index.size(); k++)
+    {
+        nodeInfo &node = nodes[index[k]];
+        if(results[k].empty() || results[k] == node.remarks)
+            continue;
+        node.remarks.swap(results[k]);
+        program.rename_prefilter.scan(node.remarks, state.candidates[index[k]]);
+    }
+}
+
+/// batch rules run alone over the whole list, so that their scripts see every node at once; the rules between them run on chunks
+static void nodeRename(const node_transform &program, std::vector<nodeInfo> &nodes, transform_state &state)
+{
+    if(program.rename.empty())
+        return;
+    transform_batch_scripts batch(program.rename, "rename", "renameAll");
+    string_array original_remarks(nodes.size());
+    transformChunks(nodes.size(), [&](size_t begin, size_t end)
+    {
+        for(size_t j = begin; j < end; j++)
+        {
+            original_remarks[j] = nodes[j].remarks;
+            program.rename_prefilter.scan(nodes[j].remarks, state.candidates[j]);
+        }
+    });
+    size_t first = 0, last;
+    while(first < program.rename.size())
+    {
+        if(batch.contexts[first])
+        {
+            renameBatch(program, first, batch.contexts[first], nodes, state);
+            first++;
+            continue;
+        }
+        for(last = first; last < program.rename.size() && !batch.contexts[last]; last++);
+        transformChunks(nodes.size(), [&](size_t begin, size_t end)
+        {
+            renameChunk(program, batch, nodes, begin, end, first, last, state);
+        });
+        first = last;
+    }
+    for(size_t j = 0; j < nodes.size(); j++)
+        if(nodes[j].remarks.empty())
+            nodes[j].remarks.swap(original_remarks[j]);
 }
 
 std::string removeEmoji(const std::string &orig_remark)
@@ -574,46 +826,86 @@ std::string removeEmoji(const std::string &orig_remark)
     return remark;
 }
 
-std::string addEmoji(const nodeInfo &node, const string_array &emoji_array)
+/// emoji rules [first, last) on nodes [begin, end), the first rule that gives a node an emoji wins
+static void emojiChunk(const node_transform &program, const transform_batch_scripts &batch, std::vector<nodeInfo> &nodes, size_t begin, size_t end, size_t first, size_t last, transform_state &state)
 {
-    std::string real_rule, ret;
-    string_size pos;
+    transform_scripts scripts(program.emoji.size());
+    std::string emoji;
+    size_t remaining = std::count(state.done.begin() + begin, state.done.begin() + end, 0);
     duk_context *ctx = NULL;
-    defer(duk_destroy_heap(ctx);)
-
-    for(const std::string &x : emoji_array)
+    for(size_t i = first; i < last && remaining; i++)
     {
-        if(startsWith(x, "!!script:"))
+        const transform_rule &x = program.emoji[i];
+        bool script = x.matcher == TRANSFORM_MATCHER_SCRIPT;
+        if(script && (batch.failed[i] || !(ctx = scripts.get(i, x))))
+            continue;
+        for(size_t j = begin; j < end; j++)
         {
-            if(!ctx)
-                ctx = duktape_init();
-            std::string script = x.substr(9);
-            if(startsWith(script, "path:"))
-                script = fileGet(script.substr(5), true);
-            if(ctx)
+            nodeInfo &node = nodes[j];
+            if(state.done[j] || !state.candidates[j][i] || !matchTransformRule(x, node))
+                continue;
+            if(script)
             {
-                if(duktape_peval(ctx, script) == 0)
-                {
-                    duk_get_global_string(ctx, "getEmoji");
-                    duktape_push_nodeinfo(ctx, node);
-                    if(duk_pcall(ctx, 1) == 0 && !(ret = duktape_get_res_str(ctx)).empty())
-                        return ret + " " + node.remarks;
-                }
-                else
-                {
-                    writeLog(0, "Error when trying to parse emoji script:\n" + duktape_get_err_stack(ctx), LOG_LEVEL_ERROR);
-                    duk_pop(ctx); // pop err
-                }
+                if((emoji = callTransformScript(ctx, "getEmoji", node)).empty())
+                    continue;
             }
-            continue;
+            else if(regExec(node.remarks, x.remarks))
+                emoji = x.value;
+            else
+                continue;
+            node.remarks = emoji + " " + node.remarks;
+            state.done[j] = 1;
+            remaining--;
         }
-        pos = x.rfind(",");
-        if(pos == x.npos)
+    }
+}
+
+static void emojiBatch(const node_transform &program, size_t i, duk_context *ctx, std::vector<nodeInfo> &nodes, transform_state &state)
+{
+    const transform_rule &x = program.emoji[i];
+    std::vector<size_t> index;
+    string_array results;
+    for(size_t j = 0; j < nodes.size(); j++)
+        if(!state.done[j] && state.candidates[j][i] && matchTransformRule(x, nodes[j]))
+            index.push_back(j);
+    if(index.empty())
+        return;
+    callTransformBatch(ctx, "getEmojiAll", nodes, index, *state.objects, results);
+    for(size_t k = 0; k < index.size(); k++)
+    {
+        if(results[k].empty())
             continue;
-        if(applyMatcher(x.substr(0, pos), real_rule, node) && real_rule.size() && regFind(node.remarks, real_rule))
-            return x.substr(pos + 1) + " " + node.remarks;
+        nodes[index[k]].remarks = results[k] + " " + nodes[index[k]].remarks;
+        state.done[index[k]] = 1;
+    }
+}
+
+static void addEmoji(const node_transform &program, std::vector<nodeInfo> &nodes, transform_state &state)
+{
+    if(program.emoji.empty())
+        return;
+    transform_batch_scripts batch(program.emoji, "emoji", "getEmojiAll");
+    transformChunks(nodes.size(), [&](size_t begin, size_t end)
+    {
+        for(size_t j = begin; j < end; j++)
+            program.emoji_prefilter.scan(nodes[j].remarks, state.candidates[j]);
+    });
+    size_t first = 0, last;
+    while(first < program.emoji.size())
+    {
+        if(batch.contexts[first])
+        {
+            emojiBatch(program, first, batch.contexts[first], nodes, state);
+            first++;
+            continue;
+        }
+        for(last = first; last < program.emoji.size() && !batch.contexts[last]; last++);
+        transformChunks(nodes.size(), [&](size_t begin, size_t end)
+        {
+            emojiChunk(program, batch, nodes, begin, end, first, last, state);
+        });
+        first = last;
     }
-    return node.remarks;
 }
 
 void processRemark(std::string &oldremark, std::string &newremark, string_array &remarks_list, bool proc_comma = true)
@@ -636,11 +928,130 @@ void processRemark(std::string &oldremark, std::string &newremark, string_array
     oldremark = newremark;
 }
 
-void rulesetToClash(YAML::Node &base_rule, std::vector<ruleset_content> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name)
+const int rule_target_clash = 100;
+
+parsed_ruleset_ptr parseRuleset(const std::string &content, int type, const std::string &group)
+{
+    parsed_ruleset_ptr result = std::make_shared<parsed_ruleset>();
+    result->group = group;
+    if(content.empty())
+        return result;
+
+    std::string converted = convertRuleset(content, type), strLine;
+    char delimiter = getLineBreak(converted);
+    auto has_type = [&strLine](const string_array &types){ return std::any_of(types.begin(), types.end(), [&strLine](const std::string &type){return startsWith(strLine, type);}); };
+    string_size line_begin = 0, line_end, lineSize, pos;
+    while(line_begin < converted.size())
+    {
+        line_end = converted.find(delimiter, line_begin);
+        if(line_end == converted.npos)
+            line_end = converted.size();
+        strLine.assign(converted, line_begin, line_end - line_begin);
+        line_begin = line_end + 1;
+
+        lineSize = strLine.size();
+        if(lineSize && strLine[lineSize - 1] == '\r') //remove line break
+            strLine.erase(--lineSize);
+        if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
+            continue;
+
+        parsed_rule rule;
+        if(has_type(ClashRuleTypes))
+            rule.support |= RULE_SUPPORT_CLASH;
+        if(has_type(SurgeRuleTypes))
+            rule.support |= RULE_SUPPORT_SURGE;
+        if(has_type(Surge2RuleTypes))
+            rule.support |= RULE_SUPPORT_SURGE2;
+        if(has_type(QuanXRuleTypes))
+            rule.support |= RULE_SUPPORT_QUANX;
+        if(has_type(SurfRuleTypes))
+            rule.support |= RULE_SUPPORT_SURFBOARD;
+        if(!rule.support)
+            continue;
+
+        rule.logical = startsWith(strLine, "AND") || startsWith(strLine, "OR") || startsWith(strLine, "NOT");
+        pos = strLine.find(',');
+        rule.type = strLine.substr(0, pos);
+        if(pos != strLine.npos)
+        {
+            string_size pos2 = rule.logical ? strLine.npos : strLine.find(',', pos + 1);
+            rule.payload = strLine.substr(pos + 1, pos2 - pos - 1);
+            if(pos2 != strLine.npos)
+                rule.options = strLine.substr(pos2);
+        }
+        rule.no_resolve = rule.options == ",no-resolve";
+        result->rules.emplace_back(std::move(rule));
+    }
+    result->rules.shrink_to_fit();
+    return result;
+}
+
+static bool ruleSupported(const parsed_rule &rule, int target)
+{
+    switch(target)
+    {
+    case rule_target_clash:
+        return rule.support & RULE_SUPPORT_CLASH;
+    case -2:
+        if(startsWith(rule.type, "IP-CIDR6"))
+            return false;
+        [[fallthrough]];
+    case -1:
+        return rule.support & RULE_SUPPORT_QUANX;
+    case -3:
+        return rule.support & RULE_SUPPORT_SURFBOARD;
+    default:
+        if(target > 2)
+            return rule.support & RULE_SUPPORT_SURGE;
+        return rule.support & RULE_SUPPORT_SURGE2;
+    }
+}
+
+/// type,payload,group[,options], Quantumult (X) only keeps no-resolve
+static std::string renderRule(const parsed_rule &rule, const std::string &group, int target)
+{
+    std::string strLine = rule.type;
+    bool quan = target == -1 || target == -2;
+    if(quan && startsWith(strLine, "IP-CIDR6"))
+        strLine.replace(0, 8, "IP6-CIDR");
+    if(rule.payload.size() || rule.options.size())
+        strLine += "," + rule.payload;
+    strLine += "," + group;
+    if(quan)
+    {
+        if(rule.no_resolve)
+            strLine += ",no-resolve";
+    }
+    else
+        strLine += rule.options;
+    return strLine;
+}
+
+static parsed_ruleset_ptr getParsedRuleset(const ruleset_content &x)
+{
+    if(x.rule_parsed.valid())
+        return x.rule_parsed.get();
+    return parseRuleset(x.rule_content.get(), x.rule_type, x.rule_group);
+}
+
+static const string_array &getRenderedRules(parsed_ruleset &ruleset, int target)
+{
+    guarded_mutex guard(ruleset.render_lock);
+    auto iter = ruleset.rendered.find(target);
+    if(iter != ruleset.rendered.end())
+        return iter->second;
+    string_array &rendered = ruleset.rendered[target];
+    for(const parsed_rule &x : ruleset.rules)
+        if(ruleSupported(x, target))
+            rendered.emplace_back(renderRule(x, ruleset.group, target));
+    rendered.shrink_to_fit();
+    return rendered;
+}
+
+void rulesetToClash(YAML::Node &base_rule, const std::vector<ruleset_content> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name)
 {
     string_array allRules;
-    std::string rule_group, retrieved_rules, strLine;
-    std::stringstream strStrm;
+    std::string rule_group, strLine;
     const std::string field_name = new_field_name ? "rules" : "Rule";
     YAML::Node Rules;
     size_t total_rules = 0;
@@ -648,12 +1059,12 @@ void rulesetToClash(YAML::Node &base_rule, std::vector<ruleset_content> &ruleset
     if(!overwrite_original_rules && base_rule[field_name].IsDefined())
         Rules = base_rule[field_name];
 
-    for(ruleset_content &x : ruleset_content_array)
+    for(const ruleset_content &x : ruleset_content_array)
     {
         if(gMaxAllowedRules && total_rules > gMaxAllowedRules)
             break;
         rule_group = x.rule_group;
-        retrieved_rules = x.rule_content.get();
+        const std::string &retrieved_rules = x.rule_content.get();
         if(retrieved_rules.empty())
         {
             writeLog(0, "Failed to fetch ruleset or ruleset is empty: '" + x.rule_path + "'!", LOG_LEVEL_WARNING);
@@ -671,27 +1082,12 @@ void rulesetToClash(YAML::Node &base_rule, std::vector<ruleset_content> &ruleset
             total_rules++;
             continue;
         }
-        retrieved_rules = convertRuleset(retrieved_rules, x.rule_type);
-        char delimiter = getLineBreak(retrieved_rules);
-
-        strStrm.clear();
-        strStrm<<retrieved_rules;
-        std::string::size_type lineSize;
-        while(getline(strStrm, strLine, delimiter))
+        parsed_ruleset_ptr parsed = getParsedRuleset(x);
+        for(const std::string &y : getRenderedRules(*parsed, rule_target_clash))
         {
             if(gMaxAllowedRules && total_rules > gMaxAllowedRules)
                 break;
-            lineSize = strLine.size();
-            if(lineSize && strLine[lineSize - 1] == '\r') //remove line break
-                strLine.erase(--lineSize);
-            if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
-                continue;
-            if(!std::any_of(ClashRuleTypes.begin(), ClashRuleTypes.end(), [strLine](std::string type){return startsWith(strLine, type);}))
-                continue;
-            strLine += "," + rule_group;
-            if(count_least(strLine, ',', 3))
-                strLine = regReplace(strLine, "^(.*?,.*?)(,.*)(,.*)$", "$1$3$2");
-            allRules.emplace_back(std::move(strLine));
+            allRules.emplace_back(y);
             //Rules.push_back(strLine);
         }
     }
@@ -704,10 +1100,9 @@ void rulesetToClash(YAML::Node &base_rule, std::vector<ruleset_content> &ruleset
     base_rule[field_name] = Rules;
 }
 
-std::string rulesetToClashStr(YAML::Node &base_rule, std::vector<ruleset_content> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name)
+std::string rulesetToClashStr(YAML::Node &base_rule, const std::vector<ruleset_content> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name)
 {
-    std::string rule_group, retrieved_rules, strLine;
-    std::stringstream strStrm;
+    std::string rule_group, strLine;
     const std::string field_name = new_field_name ? "rules" : "Rule";
     std::string output_content = "\n" + field_name + ":\n";
     size_t total_rules = 0;
@@ -719,12 +1114,12 @@ std::string rulesetToClashStr(YAML::Node &base_rule, std::vector<ruleset_content
     }
     base_rule.remove(field_name);
 
-    for(ruleset_content &x : ruleset_content_array)
+    for(const ruleset_content &x : ruleset_content_array)
     {
         if(gMaxAllowedRules && total_rules > gMaxAllowedRules)
             break;
         rule_group = x.rule_group;
-        retrieved_rules = x.rule_content.get();
+        const std::string &retrieved_rules = x.rule_content.get();
         if(retrieved_rules.empty())
         {
             writeLog(0, "Failed to fetch ruleset or ruleset is empty: '" + x.rule_path + "'!", LOG_LEVEL_WARNING);
@@ -742,41 +1137,24 @@ std::string rulesetToClashStr(YAML::Node &base_rule, std::vector<ruleset_content
             total_rules++;
             continue;
         }
-        retrieved_rules = convertRuleset(retrieved_rules, x.rule_type);
-        char delimiter = getLineBreak(retrieved_rules);
-
-        strStrm.clear();
-        strStrm<<retrieved_rules;
-        std::string::size_type lineSize;
-        while(getline(strStrm, strLine, delimiter))
+        parsed_ruleset_ptr parsed = getParsedRuleset(x);
+        for(const std::string &y : getRenderedRules(*parsed, rule_target_clash))
         {
             if(gMaxAllowedRules && total_rules > gMaxAllowedRules)
                 break;
-            lineSize = strLine.size();
-            if(lineSize && strLine[lineSize - 1] == '\r')
-            {
-                strLine.erase(lineSize - 1);
-                lineSize = strLine.size();
-            }
-            if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
-                continue;
-            if(std::none_of(ClashRuleTypes.begin(), ClashRuleTypes.end(), [strLine](std::string type){return startsWith(strLine, type);}))
-                continue;
-            strLine += "," + rule_group;
-            if(count_least(strLine, ',', 3))
-                strLine = regReplace(strLine, "^(.*?,.*?)(,.*)(,.*)$", "$1$3$2");
-            output_content += " - " + strLine + "\n";
+            output_content += " - ";
+            output_content += y;
+            output_content += '\n';
             total_rules++;
         }
     }
     return output_content;
 }
 
-void rulesetToSurge(INIReader &base_rule, std::vector<ruleset_content> &ruleset_content_array, int surge_ver, bool overwrite_original_rules, std::string remote_path_prefix)
+void rulesetToSurge(INIReader &base_rule, const std::vector<ruleset_content> &ruleset_content_array, int surge_ver, bool overwrite_original_rules, std::string remote_path_prefix)
 {
     string_array allRules;
-    std::string rule_group, rule_path, rule_path_typed, retrieved_rules, strLine;
-    std::stringstream strStrm;
+    std::string rule_group, rule_path, rule_path_typed, strLine;
     size_t total_rules = 0;
 
     switch(surge_ver) //other version: -3 for Surfboard, -4 for Loon
@@ -810,7 +1188,7 @@ void rulesetToSurge(INIReader &base_rule, std::vector<ruleset_content> &ruleset_
 
     const std::string rule_match_regex = "^(.*?,.*?)(,.*)(,.*)$";
 
-    for(ruleset_content &x : ruleset_content_array)
+    for(const ruleset_content &x : ruleset_content_array)
     {
         if(gMaxAllowedRules && total_rules > gMaxAllowedRules)
             break;
@@ -908,73 +1286,19 @@ void rulesetToSurge(INIReader &base_rule, std::vector<ruleset_content> &ruleset_
             }
             else
                 continue;
-            retrieved_rules = x.rule_content.get();
+            const std::string &retrieved_rules = x.rule_content.get();
             if(retrieved_rules.empty())
             {
                 writeLog(0, "Failed to fetch ruleset or ruleset is empty: '" + x.rule_path + "'!", LOG_LEVEL_WARNING);
                 continue;
             }
 
-            retrieved_rules = convertRuleset(retrieved_rules, x.rule_type);
-            char delimiter = getLineBreak(retrieved_rules);
-
-            strStrm.clear();
-            strStrm<<retrieved_rules;
-            std::string::size_type lineSize;
-            while(getline(strStrm, strLine, delimiter))
+            parsed_ruleset_ptr parsed = getParsedRuleset(x);
+            for(const std::string &y : getRenderedRules(*parsed, surge_ver))
             {
                 if(gMaxAllowedRules && total_rules > gMaxAllowedRules)
                     break;
-                lineSize = strLine.size();
-                if(lineSize && strLine[lineSize - 1] == '\r') //remove line break
-                    strLine.erase(--lineSize);
-                if(!lineSize || strLine[0] == ';' || strLine[0] == '#' || (lineSize >= 2 && strLine[0] == '/' && strLine[1] == '/')) //empty lines and comments are ignored
-                    continue;
-
-                /// remove unsupported types
-                switch(surge_ver)
-                {
-                case -2:
-                    if(startsWith(strLine, "IP-CIDR6"))
-                        continue;
-                    [[fallthrough]];
-                case -1:
-                    if(!std::any_of(QuanXRuleTypes.begin(), QuanXRuleTypes.end(), [strLine](std::string type){return startsWith(strLine, type);}))
-                        continue;
-                    break;
-                case -3:
-                    if(!std::any_of(SurfRuleTypes.begin(), SurfRuleTypes.end(), [strLine](std::string type){return startsWith(strLine, type);}))
-                        continue;
-                    break;
-                default:
-                    if(surge_ver > 2)
-                    {
-                        if(!std::any_of(SurgeRuleTypes.begin(), SurgeRuleTypes.end(), [strLine](std::string type){return startsWith(strLine, type);}))
-                            continue;
-                    }
-                    else
-                    {
-                        if(!std::any_of(Surge2RuleTypes.begin(), Surge2RuleTypes.end(), [strLine](std::string type){return startsWith(strLine, type);}))
-                            continue;
-                    }
-                }
-
-                strLine += "," + rule_group;
-                if(surge_ver == -1 || surge_ver == -2)
-                {
-                    if(startsWith(strLine, "IP-CIDR6"))
-                        strLine.replace(0, 8, "IP6-CIDR");
-                    if(count_least(strLine, ',', 3) && regReplace(strLine, rule_match_regex, "$2") == ",no-resolve")
-                        strLine = regReplace(strLine, rule_match_regex, "$1$3$2");
-                    else
-                        strLine = regReplace(strLine, rule_match_regex, "$1$3");
-                }
-                else
-                {
-                    if(!startsWith(strLine, "AND") && !startsWith(strLine, "OR") && !startsWith(strLine, "NOT") && count_least(strLine, ',', 3))
-                        strLine = regReplace(strLine, rule_match_regex, "$1$3$2");
-                }
-                allRules.emplace_back(std::move(strLine));
+                allRules.emplace_back(y);
                 total_rules++;
             }
         }
@@ -1008,7 +1332,50 @@ void parseGroupTimes(const std::string &src, int *interval, int *tolerance, int
     return;
 }
 
-void groupGenerate(std::string &rule, std::vector<nodeInfo> &nodelist, string_array &filtered_nodelist, bool add_direct)
+/// remarks patterns of the whole group list in one prefilter, so that each node is scanned once per export
+struct group_prefilter
+{
+    std::unordered_map<std::string, size_t> index;
+    std::vector<char> candidates; /// index.size() entries per node
+
+    group_prefilter(const string_array &extra_proxy_group, const std::vector<nodeInfo> &nodelist)
+    {
+        string_array patterns, vArray;
+        std::string real_rule;
+        for(const std::string &x : extra_proxy_group)
+        {
+            vArray = split(x, "`");
+            /// url and interval fields are collected too, they are never looked up
+            for(size_t i = 2; i < vArray.size(); i++)
+            {
+                if(startsWith(vArray[i], "[]") || startsWith(vArray[i], "script:") || startsWith(vArray[i], "!!PROVIDER="))
+                    continue;
+                applyMatcher(vArray[i], real_rule, nodeInfo());
+                if(real_rule.size() && index.emplace(real_rule, patterns.size()).second)
+                    patterns.emplace_back(real_rule);
+            }
+        }
+        if(patterns.empty())
+            return;
+        RegexPrefilter prefilter(patterns);
+        std::vector<char> result;
+        candidates.resize(patterns.size() * nodelist.size());
+        for(size_t i = 0; i < nodelist.size(); i++)
+        {
+            prefilter.scan(nodelist[i].remarks, result);
+            std::copy(result.begin(), result.end(), candidates.begin() + i * patterns.size());
+        }
+    }
+
+    /// false only if real_rule cannot match the remarks of nodelist[node]
+    bool mayMatch(const std::string &real_rule, size_t node) const
+    {
+        auto iter = index.find(real_rule);
+        return iter == index.end() || candidates[node * index.size() + iter->second];
+    }
+};
+
+void groupGenerate(std::string &rule, std::vector<nodeInfo> &nodelist, string_array &filtered_nodelist, bool add_direct, const group_prefilter &prefilter)
 {
     std::string real_rule;
     if(startsWith(rule, "[]") && add_direct)
@@ -1017,10 +1384,10 @@ void groupGenerate(std::string &rule, std::vector<nodeInfo> &nodelist, string_ar
     }
     else if(startsWith(rule, "script:"))
     {
-        duk_context *ctx = duktape_init();
+        duk_context *ctx = duktape_acquire();
         if(ctx)
         {
-            defer(duk_destroy_heap(ctx);)
+            defer(duktape_release(ctx);)
             std::string script = fileGet(rule.substr(7), true);
             if(duktape_peval(ctx, script) == 0)
             {
@@ -1031,7 +1398,9 @@ void groupGenerate(std::string &rule, std::vector<nodeInfo> &nodelist, string_ar
                     duktape_push_nodeinfo_arr(ctx, x, -1);
                     duk_put_prop_index(ctx, arr_idx, node_idx++);
                 }
-                if(duk_pcall(ctx, 1) == 0)
+                int ret = duk_pcall(ctx, 1);
+                duktape_unbind_nodes();
+                if(ret == 0)
                 {
                     std::string result_list = duktape_get_res_str(ctx);
                     filtered_nodelist = split(regTrim(result_list), "\n");
@@ -1051,26 +1420,100 @@ void groupGenerate(std::string &rule, std::vector<nodeInfo> &nodelist, string_ar
     }
     else
     {
-        for(nodeInfo &x : nodelist)
+        for(size_t i = 0; i < nodelist.size(); i++)
         {
-            if(applyMatcher(rule, real_rule, x) && (real_rule.empty() || regFind(x.remarks, real_rule)) && std::find(filtered_nodelist.begin(), filtered_nodelist.end(), x.remarks) == filtered_nodelist.end())
+            nodeInfo &x = nodelist[i];
+            if(applyMatcher(rule, real_rule, x) && (real_rule.empty() || (prefilter.mayMatch(real_rule, i) && regFind(x.remarks, real_rule))) && std::find(filtered_nodelist.begin(), filtered_nodelist.end(), x.remarks) == filtered_nodelist.end())
                 filtered_nodelist.emplace_back(x.remarks);
         }
     }
 }
 
-void preprocessNodes(std::vector<nodeInfo> &nodes, const extra_settings &ext)
+struct sort_key
+{
+    int rank = 0; /// 0 for unsupported nodes, 1 for numbers, 2 for strings
+    double number = 0.0;
+    std::string text;
+};
+
+/// call sortKey once per node instead of compare once per comparison, numbers sort before strings and
+/// nodes of unsupported types stay in front in their original order
+static void sortNodesByKey(std::vector<nodeInfo> &nodes, duk_context *ctx, const std::string &script)
 {
-    std::for_each(nodes.begin(), nodes.end(), [ext](nodeInfo &x)
+    std::vector<sort_key> keys(nodes.size());
+    for(size_t i = 0; i < nodes.size(); i++)
+        if(nodes[i].linkType >= 1 && nodes[i].linkType <= 5)
+            keys[i].rank = 2;
+    auto extract = [&](duk_context *ctx, size_t begin, size_t end)
     {
-        if(ext.remove_emoji)
-            x.remarks = trim(removeEmoji(x.remarks));
-
-        nodeRename(x, ext.rename_array);
+        for(size_t i = begin; i < end; i++)
+        {
+            sort_key &key = keys[i];
+            if(!key.rank)
+                continue;
+            duk_get_global_string(ctx, "sortKey");
+            duktape_push_nodeinfo(ctx, nodes[i]);
+            int ret = duk_pcall(ctx, 1);
+            duktape_unbind_nodes();
+            if(ret == 0)
+            {
+                if(duk_is_number(ctx, -1) && !std::isnan(duk_get_number(ctx, -1)))
+                {
+                    key.rank = 1;
+                    key.number = duk_get_number(ctx, -1);
+                }
+                else if(!duk_is_null_or_undefined(ctx, -1))
+                    key.text = duk_safe_to_string(ctx, -1);
+            }
+            duk_pop(ctx);
+        }
+    };
+    if(nodes.size() >= TRANSFORM_PARALLEL_THRESHOLD)
+    {
+        parallelRun((nodes.size() + TRANSFORM_PARALLEL_CHUNK - 1) / TRANSFORM_PARALLEL_CHUNK, [&](size_t index)
+        {
+            duk_context *chunk_ctx = duktape_acquire();
+            defer(duktape_release(chunk_ctx);)
+            if(chunk_ctx && duktape_peval(chunk_ctx, script) == 0)
+                extract(chunk_ctx, index * TRANSFORM_PARALLEL_CHUNK, std::min(nodes.size(), (index + 1) * TRANSFORM_PARALLEL_CHUNK));
+        });
+    }
+    else
+        extract(ctx, 0, nodes.size());
 
-        if(ext.add_emoji)
-            x.remarks = addEmoji(x, ext.emoji_array);
+    std::vector<size_t> order(nodes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b)
+    {
+        const sort_key &x = keys[a], &y = keys[b];
+        if(x.rank != y.rank)
+            return x.rank < y.rank;
+        return x.rank == 1 ? x.number < y.number : x.text < y.text;
     });
+    std::vector<nodeInfo> sorted;
+    sorted.reserve(nodes.size());
+    for(size_t i : order)
+        sorted.emplace_back(std::move(nodes[i]));
+    nodes.swap(sorted);
+}
+
+void preprocessNodes(std::vector<nodeInfo> &nodes, const extra_settings &ext, DuktapeNodeList *node_objects)
+{
+    node_transform_ptr program = ext.transform ? ext.transform : compileNodeTransform(ext.rename_array, ext.emoji_array);
+    transform_state state(nodes.size(), node_objects);
+    if(ext.remove_emoji)
+    {
+        transformChunks(nodes.size(), [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; i++)
+                nodes[i].remarks = trim(removeEmoji(nodes[i].remarks));
+        });
+    }
+
+    nodeRename(*program, nodes, state);
+
+    if(ext.add_emoji)
+        addEmoji(*program, nodes, state);
 
     if(ext.sort_flag)
     {
@@ -1079,27 +1522,34 @@ void preprocessNodes(std::vector<nodeInfo> &nodes, const extra_settings &ext)
         {
             try
             {
-                duk_context *ctx = duktape_init();
+                duk_context *ctx = duktape_acquire();
                 if(ctx)
                 {
-                    defer(duk_destroy_heap(ctx);)
+                    defer(duktape_release(ctx);)
                     if(duktape_peval(ctx, ext.sort_script) == 0)
                     {
-                        auto comparer = [&](const nodeInfo &a, const nodeInfo &b)
+                        duk_pop(ctx); /// pop eval result
+                        if(duktape_has_function(ctx, "sortKey"))
+                            sortNodesByKey(nodes, ctx, ext.sort_script);
+                        else
                         {
-                            if(a.linkType < 1 || a.linkType > 5)
-                                return 1;
-                            if(b.linkType < 1 || b.linkType > 5)
-                                return 0;
-                            duk_get_global_string(ctx, "compare");
-                            /// push 2 nodeinfo
-                            duktape_push_nodeinfo(ctx, a);
-                            duktape_push_nodeinfo(ctx, b);
-                            /// call function
-                            duk_pcall(ctx, 2);
-                            return duktape_get_res_int(ctx);
-                        };
-                        std::sort(nodes.begin(), nodes.end(), comparer);
+                            auto comparer = [&](const nodeInfo &a, const nodeInfo &b)
+                            {
+                                if(a.linkType < 1 || a.linkType > 5)
+                                    return 1;
+                                if(b.linkType < 1 || b.linkType > 5)
+                                    return 0;
+                                duk_get_global_string(ctx, "compare");
+                                /// push 2 nodeinfo
+                                duktape_push_nodeinfo(ctx, a);
+                                duktape_push_nodeinfo(ctx, b);
+                                /// call function
+                                duk_pcall(ctx, 2);
+                                duktape_unbind_nodes();
+                                return duktape_get_res_int(ctx);
+                            };
+                            std::sort(nodes.begin(), nodes.end(), comparer);
+                        }
                         failed = false;
                     }
                     else
@@ -1124,11 +1574,10 @@ void preprocessNodes(std::vector<nodeInfo> &nodes, const extra_settings &ext)
 void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const string_array &extra_proxy_group, bool clashR, const extra_settings &ext)
 {
     YAML::Node proxies, singleproxy, singlegroup, original_groups;
-    rapidjson::Document json;
-    std::string type, remark, hostname, port, username, password, method;
+    std::string type, remark, hostname, username, password, method;
     std::string plugin, pluginopts;
     std::string protocol, protoparam, obfs, obfsparam;
-    std::string id, aid, transproto, faketype, host, edge, path, quicsecure, quicsecret;
+    std::string id, transproto, faketype, host, edge, path, quicsecure, quicsecret;
     tribool udp, scv;
     std::vector<nodeInfo> nodelist;
     bool tlssecure;
@@ -1151,28 +1600,26 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
     for(nodeInfo &x : nodes)
     {
         singleproxy.reset();
-        json.Parse(x.proxyStr.data());
 
-        type = GetMember(json, "Type");
+        type = getProxyTypeName(x);
         if(ext.append_proxy_type)
             x.remarks = "[" + type + "] " + x.remarks;
 
         processRemark(x.remarks, remark, remarks_list, false);
 
-        hostname = GetMember(json, "Hostname");
-        port = GetMember(json, "Port");
-        username = GetMember(json, "Username");
-        password = GetMember(json, "Password");
-        method = GetMember(json, "EncryptMethod");
+        hostname = x.proxy.hostname;
+        username = x.proxy.username;
+        password = x.proxy.password;
+        method = x.proxy.encrypt_method;
 
         udp = ext.udp;
         scv = ext.skip_cert_verify;
-        udp.define(GetMember(json, "EnableUDP"));
-        scv.define(GetMember(json, "AllowInsecure"));
+        udp.define(x.proxy.udp);
+        scv.define(x.proxy.allow_insecure);
 
         singleproxy["name"] = remark;
         singleproxy["server"] = hostname;
-        singleproxy["port"] = (unsigned short)to_int(port);
+        singleproxy["port"] = (unsigned short)x.proxy.port;
 
         switch(x.linkType)
         {
@@ -1180,8 +1627,8 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
             //latest clash core removed support for chacha20 encryption
             if(ext.filter_deprecated && method == "chacha20")
                 continue;
-            plugin = GetMember(json, "Plugin");
-            pluginopts = replace_all_distinct(GetMember(json, "PluginOption"), ";", "&");
+            plugin = x.proxy.plugin;
+            pluginopts = replace_all_distinct(x.proxy.plugin_option, ";", "&");
             singleproxy["type"] = "ss";
             singleproxy["cipher"] = method;
             singleproxy["password"] = password;
@@ -1208,16 +1655,15 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
             }
             break;
         case SPEEDTEST_MESSAGE_FOUNDVMESS:
-            id = GetMember(json, "UserID");
-            aid = GetMember(json, "AlterID");
-            transproto = GetMember(json, "TransferProtocol");
-            host = GetMember(json, "Host");
-            edge = GetMember(json, "Edge");
-            path = GetMember(json, "Path");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            id = x.proxy.user_id;
+            transproto = x.proxy.transfer_protocol;
+            host = x.proxy.host;
+            edge = x.proxy.edge;
+            path = x.proxy.path;
+            tlssecure = x.proxy.tls_secure;
             singleproxy["type"] = "vmess";
             singleproxy["uuid"] = id;
-            singleproxy["alterId"] = stoi(aid);
+            singleproxy["alterId"] = x.proxy.alter_id;
             singleproxy["cipher"] = method;
             singleproxy["tls"] = tlssecure;
             if(!scv.is_undef())
@@ -1249,8 +1695,8 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
             break;
         case SPEEDTEST_MESSAGE_FOUNDSSR:
             //ignoring all nodes with unsupported obfs, protocols and encryption
-            protocol = GetMember(json, "Protocol");
-            obfs = GetMember(json, "OBFS");
+            protocol = x.proxy.protocol;
+            obfs = x.proxy.obfs;
             if(ext.filter_deprecated)
             {
                 if(!clashR && std::find(clash_ssr_ciphers.cbegin(), clash_ssr_ciphers.cend(), method) == clash_ssr_ciphers.cend())
@@ -1261,8 +1707,8 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
                     continue;
             }
 
-            protoparam = GetMember(json, "ProtocolParam");
-            obfsparam = GetMember(json, "OBFSParam");
+            protoparam = x.proxy.protocol_param;
+            obfsparam = x.proxy.obfs_param;
             singleproxy["type"] = "ssr";
             singleproxy["cipher"] = method;
             singleproxy["password"] = password;
@@ -1309,7 +1755,7 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
                 singleproxy["skip-cert-verify"] = scv.get();
             break;
         case SPEEDTEST_MESSAGE_FOUNDTROJAN:
-            host = GetMember(json, "Host");
+            host = x.proxy.host;
             singleproxy["type"] = "trojan";
             singleproxy["password"] = password;
             if(host.size())
@@ -1320,8 +1766,8 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
                 singleproxy["skip-cert-verify"] = scv.get();
             break;
         case SPEEDTEST_MESSAGE_FOUNDSNELL:
-            obfs = GetMember(json, "OBFS");
-            host = GetMember(json, "Host");
+            obfs = x.proxy.obfs;
+            host = x.proxy.host;
             singleproxy["type"] = "snell";
             singleproxy["psk"] = password;
             if(obfs.size())
@@ -1366,6 +1812,7 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
 
     string_array providers;
 
+    group_prefilter prefilter(extra_proxy_group, nodelist);
     for(const std::string &x : extra_proxy_group)
     {
         singlegroup.reset();
@@ -1413,7 +1860,7 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
                 std::move(list.begin(), list.end(), std::back_inserter(providers));
             }
             else
-                groupGenerate(vArray[i], nodelist, filtered_nodelist, true);
+                groupGenerate(vArray[i], nodelist, filtered_nodelist, true, prefilter);
         }
 
         if(providers.size())
@@ -1447,7 +1894,7 @@ void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const stri
         yamlnode["Proxy Group"] = original_groups;
 }
 
-std::string netchToClash(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, bool clashR, const extra_settings &ext)
+std::string netchToClash(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, bool clashR, const extra_settings &ext)
 {
     YAML::Node yamlnode;
 
@@ -1495,9 +1942,8 @@ std::string netchToClash(std::vector<nodeInfo> &nodes, const std::string &base_c
     return output_content;
 }
 
-std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, int surge_ver, const extra_settings &ext)
+std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, int surge_ver, const extra_settings &ext)
 {
-    rapidjson::Document json;
     INIReader ini;
     std::string proxy;
     std::string type, remark, hostname, port, username, password, method;
@@ -1534,36 +1980,35 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
 
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-        type = GetMember(json, "Type");
+        type = getProxyTypeName(x);
 
         if(ext.append_proxy_type)
             x.remarks = "[" + type + "] " + x.remarks;
 
         processRemark(x.remarks, remark, remarks_list);
 
-        hostname = GetMember(json, "Hostname");
-        port = std::to_string((unsigned short)to_int(GetMember(json, "Port")));
-        username = GetMember(json, "Username");
-        password = GetMember(json, "Password");
-        method = GetMember(json, "EncryptMethod");
+        hostname = x.proxy.hostname;
+        port = std::to_string((unsigned short)x.proxy.port);
+        username = x.proxy.username;
+        password = x.proxy.password;
+        method = x.proxy.encrypt_method;
 
         udp = ext.udp;
         tfo = ext.tfo;
         scv = ext.skip_cert_verify;
         tls13 = ext.tls13;
-        udp.define(GetMember(json, "EnableUDP"));
-        tfo.define(GetMember(json, "EnableTFO"));
-        scv.define(GetMember(json, "AllowInsecure"));
-        tls13.define(GetMember(json, "TLS13"));
+        udp.define(x.proxy.udp);
+        tfo.define(x.proxy.tfo);
+        scv.define(x.proxy.allow_insecure);
+        tls13.define(x.proxy.tls13);
 
         proxy.clear();
 
         switch(x.linkType)
         {
         case SPEEDTEST_MESSAGE_FOUNDSS:
-            plugin = GetMember(json, "Plugin");
-            pluginopts = GetMember(json, "PluginOption");
+            plugin = x.proxy.plugin;
+            pluginopts = x.proxy.plugin_option;
             if(surge_ver >= 3)
             {
                 proxy = "ss, " + hostname + ", " + port + ", encrypt-method=" + method + ", password=" + password;
@@ -1589,13 +2034,13 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
         case SPEEDTEST_MESSAGE_FOUNDVMESS:
             if(surge_ver < 4 && surge_ver != -3)
                 continue;
-            id = GetMember(json, "UserID");
-            aid = GetMember(json, "AlterID");
-            transproto = GetMember(json, "TransferProtocol");
-            host = GetMember(json, "Host");
-            edge = GetMember(json, "Edge");
-            path = GetMember(json, "Path");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            id = x.proxy.user_id;
+            aid = std::to_string(x.proxy.alter_id);
+            transproto = x.proxy.transfer_protocol;
+            host = x.proxy.host;
+            edge = x.proxy.edge;
+            path = x.proxy.path;
+            tlssecure = x.proxy.tls_secure;
             proxy = "vmess, " + hostname + ", " + port + ", username=" + id + ", tls=" + (tlssecure ? "true" : "false");
             if(tlssecure && !tls13.is_undef())
                 proxy += ", tls13=" + std::string(tls13 ? "true" : "false");
@@ -1617,10 +2062,10 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
         case SPEEDTEST_MESSAGE_FOUNDSSR:
             if(ext.surge_ssr_path.empty() || surge_ver < 2)
                 continue;
-            protocol = GetMember(json, "Protocol");
-            protoparam = GetMember(json, "ProtocolParam");
-            obfs = GetMember(json, "OBFS");
-            obfsparam = GetMember(json, "OBFSParam");
+            protocol = x.proxy.protocol;
+            protoparam = x.proxy.protocol_param;
+            obfs = x.proxy.obfs;
+            obfsparam = x.proxy.obfs_param;
             proxy = "external, exec=\"" + ext.surge_ssr_path + "\", args=\"";
             args = {"-l", std::to_string(local_port), "-s", hostname, "-p", port, "-m", method, "-k", password, "-o", obfs, "-O", protocol};
             if(obfsparam.size())
@@ -1666,7 +2111,7 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
         case SPEEDTEST_MESSAGE_FOUNDTROJAN:
             if(surge_ver < 4)
                 continue;
-            host = GetMember(json, "Host");
+            host = x.proxy.host;
             proxy = "trojan, " + hostname + ", " + port + ", password=" + password;
             if(host.size())
                 proxy += ", sni=" + host;
@@ -1674,8 +2119,8 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
                 proxy += ", skip-cert-verify=" + std::string(scv.get() ? "1" : "0");
             break;
         case SPEEDTEST_MESSAGE_FOUNDSNELL:
-            obfs = GetMember(json, "OBFS");
-            host = GetMember(json, "Host");
+            obfs = x.proxy.obfs;
+            host = x.proxy.host;
             proxy = "snell, " + hostname + ", " + port + ", psk=" + password;
             if(obfs.size())
                 proxy += ", obfs=" + obfs + ", obfs-host=" + host;
@@ -1704,6 +2149,7 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
 
     ini.SetCurrentSection("Proxy Group");
     ini.EraseSection();
+    group_prefilter prefilter(extra_proxy_group, nodelist);
     for(const std::string &x : extra_proxy_group)
     {
         //group pref
@@ -1750,7 +2196,7 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
         }
 
         for(unsigned int i = 2; i < rules_upper_bound; i++)
-            groupGenerate(vArray[i], nodelist, filtered_nodelist, true);
+            groupGenerate(vArray[i], nodelist, filtered_nodelist, true, prefilter);
 
         if(!filtered_nodelist.size())
             filtered_nodelist.emplace_back("DIRECT");
@@ -1796,7 +2242,6 @@ std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_c
 std::string netchToSingle(std::vector<nodeInfo> &nodes, int types, const extra_settings &ext)
 {
     /// types: SS=1 SSR=2 VMess=4 Trojan=8
-    rapidjson::Document json;
     std::string remark, hostname, port, password, method;
     std::string plugin, pluginopts;
     std::string protocol, protoparam, obfs, obfsparam;
@@ -1806,19 +2251,17 @@ std::string netchToSingle(std::vector<nodeInfo> &nodes, int types, const extra_s
 
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-
         remark = x.remarks;
-        hostname = GetMember(json, "Hostname");
-        port = std::to_string((unsigned short)to_int(GetMember(json, "Port")));
-        password = GetMember(json, "Password");
-        method = GetMember(json, "EncryptMethod");
-        plugin = GetMember(json, "Plugin");
-        pluginopts = GetMember(json, "PluginOption");
-        protocol = GetMember(json, "Protocol");
-        protoparam = GetMember(json, "ProtocolParam");
-        obfs = GetMember(json, "OBFS");
-        obfsparam = GetMember(json, "OBFSParam");
+        hostname = x.proxy.hostname;
+        port = std::to_string((unsigned short)x.proxy.port);
+        password = x.proxy.password;
+        method = x.proxy.encrypt_method;
+        plugin = x.proxy.plugin;
+        pluginopts = x.proxy.plugin_option;
+        protocol = x.proxy.protocol;
+        protoparam = x.proxy.protocol_param;
+        obfs = x.proxy.obfs;
+        obfsparam = x.proxy.obfs_param;
 
         switch(x.linkType)
         {
@@ -1834,7 +2277,7 @@ std::string netchToSingle(std::vector<nodeInfo> &nodes, int types, const extra_s
             }
             else if(ssr)
             {
-                if(std::count(ssr_ciphers.begin(), ssr_ciphers.end(), method) > 0 && !GetMember(json, "Plugin").size() && !GetMember(json, "Plugin").size())
+                if(std::count(ssr_ciphers.begin(), ssr_ciphers.end(), method) > 0 && !x.proxy.plugin.size() && !x.proxy.plugin.size())
                     proxyStr = "ssr://" + urlsafe_base64_encode(hostname + ":" + port + ":origin:" + method + ":plain:" + urlsafe_base64_encode(password) \
                                + "/?group=" + urlsafe_base64_encode(x.group) + "&remarks=" + urlsafe_base64_encode(remark));
             }
@@ -1859,13 +2302,13 @@ std::string netchToSingle(std::vector<nodeInfo> &nodes, int types, const extra_s
         case SPEEDTEST_MESSAGE_FOUNDVMESS:
             if(!vmess)
                 continue;
-            id = GetMember(json, "UserID");
-            aid = GetMember(json, "AlterID");
-            transproto = GetMember(json, "TransferProtocol");
-            host = GetMember(json, "Host");
-            path = GetMember(json, "Path");
-            faketype = GetMember(json, "FakeType");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            id = x.proxy.user_id;
+            aid = std::to_string(x.proxy.alter_id);
+            transproto = x.proxy.transfer_protocol;
+            host = x.proxy.host;
+            path = x.proxy.path;
+            faketype = x.proxy.fake_type;
+            tlssecure = x.proxy.tls_secure;
             proxyStr = "vmess://" + base64_encode(vmessLinkConstruct(remark, hostname, port, faketype, id, aid, transproto, path, host, tlssecure ? "tls" : ""));
             break;
         case SPEEDTEST_MESSAGE_FOUNDTROJAN:
@@ -1918,17 +2361,15 @@ std::string netchToSSSub(std::string &base_conf, std::vector<nodeInfo> &nodes, c
     output_content = "[";
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-
         remark = x.remarks;
         hostname = x.server;
-        int port = (unsigned short)to_int(GetMember(json, "Port"));
-        password = GetMember(json, "Password");
-        method = GetMember(json, "EncryptMethod");
-        plugin = GetMember(json, "Plugin");
-        pluginopts = GetMember(json, "PluginOption");
-        protocol = GetMember(json, "Protocol");
-        obfs = GetMember(json, "OBFS");
+        int port = (unsigned short)x.proxy.port;
+        password = x.proxy.password;
+        method = x.proxy.encrypt_method;
+        plugin = x.proxy.plugin;
+        pluginopts = x.proxy.plugin_option;
+        protocol = x.proxy.protocol;
+        obfs = x.proxy.obfs;
 
         switch(x.linkType)
         {
@@ -1958,7 +2399,7 @@ std::string netchToSSSub(std::string &base_conf, std::vector<nodeInfo> &nodes, c
     return output_content;
 }
 
-std::string netchToQuan(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
+std::string netchToQuan(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
 {
     INIReader ini;
     ini.store_any_line = true;
@@ -1985,9 +2426,8 @@ std::string netchToQuan(std::vector<nodeInfo> &nodes, const std::string &base_co
     return ini.ToString();
 }
 
-void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
+void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
 {
-    rapidjson::Document json;
     std::string type;
     std::string remark, hostname, port, method, username, password;
     std::string plugin, pluginopts;
@@ -2003,33 +2443,32 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
     ini.EraseSection();
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-        type = GetMember(json, "Type");
+        type = getProxyTypeName(x);
 
         if(ext.append_proxy_type)
             x.remarks = "[" + type + "] " + x.remarks;
 
         processRemark(x.remarks, remark, remarks_list);
 
-        hostname = GetMember(json, "Hostname");
-        port = std::to_string((unsigned short)to_int(GetMember(json, "Port")));
-        method = GetMember(json, "EncryptMethod");
-        password = GetMember(json, "Password");
+        hostname = x.proxy.hostname;
+        port = std::to_string((unsigned short)x.proxy.port);
+        method = x.proxy.encrypt_method;
+        password = x.proxy.password;
 
         switch(x.linkType)
         {
         case SPEEDTEST_MESSAGE_FOUNDVMESS:
-            id = GetMember(json, "UserID");
-            aid = GetMember(json, "AlterID");
-            transproto = GetMember(json, "TransferProtocol");
-            host = GetMember(json, "Host");
-            path = GetMember(json, "Path");
-            edge = GetMember(json, "Edge");
-            faketype = GetMember(json, "FakeType");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            id = x.proxy.user_id;
+            aid = std::to_string(x.proxy.alter_id);
+            transproto = x.proxy.transfer_protocol;
+            host = x.proxy.host;
+            path = x.proxy.path;
+            edge = x.proxy.edge;
+            faketype = x.proxy.fake_type;
+            tlssecure = x.proxy.tls_secure;
 
             scv = ext.skip_cert_verify;
-            scv.define(GetMember(json, "AllowInsecure"));
+            scv.define(x.proxy.allow_insecure);
 
             if(method == "auto")
                 method = "chacha20-ietf-poly1305";
@@ -2052,10 +2491,10 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
                 proxyStr = "vmess://" + urlsafe_base64_encode(proxyStr);
             break;
         case SPEEDTEST_MESSAGE_FOUNDSSR:
-            protocol = GetMember(json, "Protocol");
-            protoparam = GetMember(json, "ProtocolParam");
-            obfs = GetMember(json, "OBFS");
-            obfsparam = GetMember(json, "OBFSParam");
+            protocol = x.proxy.protocol;
+            protoparam = x.proxy.protocol_param;
+            obfs = x.proxy.obfs;
+            obfsparam = x.proxy.obfs_param;
 
             if(ext.nodelist)
             {
@@ -2073,8 +2512,8 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
             }
             break;
         case SPEEDTEST_MESSAGE_FOUNDSS:
-            plugin = GetMember(json, "Plugin");
-            pluginopts = GetMember(json, "PluginOption");
+            plugin = x.proxy.plugin;
+            pluginopts = x.proxy.plugin_option;
 
             if(ext.nodelist)
             {
@@ -2095,9 +2534,9 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
             }
             break;
         case SPEEDTEST_MESSAGE_FOUNDHTTP:
-            username = GetMember(json, "Username");
-            host = GetMember(json, "Host");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            username = x.proxy.username;
+            host = x.proxy.host;
+            tlssecure = x.proxy.tls_secure;
 
             proxyStr = remark + " = http, upstream-proxy-address=" + hostname + ", upstream-proxy-port=" + port + ", group=" + x.group;
             if(username.size() && password.size())
@@ -2118,9 +2557,9 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
                 proxyStr = "http://" + urlsafe_base64_encode(proxyStr);
             break;
         case SPEEDTEST_MESSAGE_FOUNDSOCKS:
-            username = GetMember(json, "Username");
-            host = GetMember(json, "Host");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            username = x.proxy.username;
+            host = x.proxy.host;
+            tlssecure = x.proxy.tls_secure;
 
             proxyStr = remark + " = socks, upstream-proxy-address=" + hostname + ", upstream-proxy-port=" + port + ", group=" + x.group;
             if(username.size() && password.size())
@@ -2159,6 +2598,7 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
     std::string singlegroup;
     std::string name, proxies;
     string_array vArray;
+    group_prefilter prefilter(extra_proxy_group, nodelist);
     for(const std::string &x : extra_proxy_group)
     {
         eraseElements(filtered_nodelist);
@@ -2220,7 +2660,7 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
         name = vArray[0];
 
         for(unsigned int i = 2; i < rules_upper_bound; i++)
-            groupGenerate(vArray[i], nodelist, filtered_nodelist, true);
+            groupGenerate(vArray[i], nodelist, filtered_nodelist, true, prefilter);
 
         if(!filtered_nodelist.size())
             filtered_nodelist.emplace_back("direct");
@@ -2244,7 +2684,7 @@ void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rules
         rulesetToSurge(ini, ruleset_content_array, -2, ext.overwrite_original_rules, std::string());
 }
 
-std::string netchToQuanX(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
+std::string netchToQuanX(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
 {
     INIReader ini;
     ini.store_any_line = true;
@@ -2278,9 +2718,8 @@ std::string netchToQuanX(std::vector<nodeInfo> &nodes, const std::string &base_c
     return ini.ToString();
 }
 
-void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
+void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
 {
-    rapidjson::Document json;
     std::string type;
     std::string remark, hostname, port, method;
     std::string password, plugin, pluginopts;
@@ -2296,35 +2735,34 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
     ini.EraseSection();
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-        type = GetMember(json, "Type");
+        type = getProxyTypeName(x);
 
         if(ext.append_proxy_type)
             x.remarks = "[" + type + "] " + x.remarks;
 
         processRemark(x.remarks, remark, remarks_list);
 
-        hostname = GetMember(json, "Hostname");
-        port = std::to_string((unsigned short)to_int(GetMember(json, "Port")));
-        method = GetMember(json, "EncryptMethod");
+        hostname = x.proxy.hostname;
+        port = std::to_string((unsigned short)x.proxy.port);
+        method = x.proxy.encrypt_method;
 
         udp = ext.udp;
         tfo = ext.tfo;
         scv = ext.skip_cert_verify;
         tls13 = ext.tls13;
-        udp.define(GetMember(json, "EnableUDP"));
-        tfo.define(GetMember(json, "EnableTFO"));
-        scv.define(GetMember(json, "AllowInsecure"));
-        tls13.define(GetMember(json, "TLS13"));
+        udp.define(x.proxy.udp);
+        tfo.define(x.proxy.tfo);
+        scv.define(x.proxy.allow_insecure);
+        tls13.define(x.proxy.tls13);
 
         switch(x.linkType)
         {
         case SPEEDTEST_MESSAGE_FOUNDVMESS:
-            id = GetMember(json, "UserID");
-            transproto = GetMember(json, "TransferProtocol");
-            host = GetMember(json, "Host");
-            path = GetMember(json, "Path");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            id = x.proxy.user_id;
+            transproto = x.proxy.transfer_protocol;
+            host = x.proxy.host;
+            path = x.proxy.path;
+            tlssecure = x.proxy.tls_secure;
             if(method == "auto")
                 method = "chacha20-ietf-poly1305";
             proxyStr = "vmess = " + hostname + ":" + port + ", method=" + method + ", password=" + id;
@@ -2342,9 +2780,9 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
                 proxyStr += ", obfs=over-tls, obfs-host=" + host;
             break;
         case SPEEDTEST_MESSAGE_FOUNDSS:
-            password = GetMember(json, "Password");
-            plugin = GetMember(json, "Plugin");
-            pluginopts = GetMember(json, "PluginOption");
+            password = x.proxy.password;
+            plugin = x.proxy.plugin;
+            pluginopts = x.proxy.plugin_option;
             proxyStr = "shadowsocks = " + hostname + ":" + port + ", method=" + method + ", password=" + password;
             if(plugin.size())
             {
@@ -2379,11 +2817,11 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
 
             break;
         case SPEEDTEST_MESSAGE_FOUNDSSR:
-            password = GetMember(json, "Password");
-            protocol = GetMember(json, "Protocol");
-            protoparam = GetMember(json, "ProtocolParam");
-            obfs = GetMember(json, "OBFS");
-            obfsparam = GetMember(json, "OBFSParam");
+            password = x.proxy.password;
+            protocol = x.proxy.protocol;
+            protoparam = x.proxy.protocol_param;
+            obfs = x.proxy.obfs;
+            obfsparam = x.proxy.obfs_param;
             proxyStr = "shadowsocks = " + hostname + ":" + port + ", method=" + method + ", password=" + password + ", ssr-protocol=" + protocol;
             if(protoparam.size())
                 proxyStr += ", ssr-protocol-param=" + protoparam;
@@ -2392,9 +2830,9 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
                 proxyStr += ", obfs-host=" + obfsparam;
             break;
         case SPEEDTEST_MESSAGE_FOUNDHTTP:
-            id = GetMember(json, "Username");
-            password = GetMember(json, "Password");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            id = x.proxy.username;
+            password = x.proxy.password;
+            tlssecure = x.proxy.tls_secure;
 
             proxyStr = "http = " + hostname + ":" + port + ", username=" + (id.size() ? id : "none") + ", password=" + (password.size() ? password : "none");
             if(tlssecure)
@@ -2405,9 +2843,9 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
             }
             break;
         case SPEEDTEST_MESSAGE_FOUNDTROJAN:
-            password = GetMember(json, "Password");
-            host = GetMember(json, "Host");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            password = x.proxy.password;
+            host = x.proxy.host;
+            tlssecure = x.proxy.tls_secure;
 
             proxyStr = "trojan = " + hostname + ":" + port + ", password=" + password;
             if(tlssecure)
@@ -2445,6 +2883,7 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
     std::string singlegroup;
     std::string name, proxies;
     string_array vArray;
+    group_prefilter prefilter(extra_proxy_group, nodelist);
     for(const std::string &x : extra_proxy_group)
     {
         eraseElements(filtered_nodelist);
@@ -2489,7 +2928,7 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
         if(hash_(vArray[1]) != "ssid"_hash)
         {
             for(unsigned int i = 2; i < rules_upper_bound; i++)
-                groupGenerate(vArray[i], nodelist, filtered_nodelist, true);
+                groupGenerate(vArray[i], nodelist, filtered_nodelist, true, prefilter);
 
             if(!filtered_nodelist.size())
                 filtered_nodelist.emplace_back("direct");
@@ -2588,7 +3027,6 @@ void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rule
 
 std::string netchToSSD(std::vector<nodeInfo> &nodes, std::string &group, std::string &userinfo, const extra_settings &ext)
 {
-    rapidjson::Document json;
     rapidjson::StringBuffer sb;
     rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
     std::string hostname, password, method;
@@ -2632,18 +3070,16 @@ std::string netchToSSD(std::vector<nodeInfo> &nodes, std::string &group, std::st
 
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-
-        hostname = GetMember(json, "Hostname");
-        port = (unsigned short)to_int(GetMember(json, "Port"));
-        password = GetMember(json, "Password");
-        method = GetMember(json, "EncryptMethod");
-        plugin = GetMember(json, "Plugin");
-        pluginopts = GetMember(json, "PluginOption");
-        protocol = GetMember(json, "Protocol");
-        protoparam = GetMember(json, "ProtocolParam");
-        obfs = GetMember(json, "OBFS");
-        obfsparam = GetMember(json, "OBFSParam");
+        hostname = x.proxy.hostname;
+        port = (unsigned short)x.proxy.port;
+        password = x.proxy.password;
+        method = x.proxy.encrypt_method;
+        plugin = x.proxy.plugin;
+        pluginopts = x.proxy.plugin_option;
+        protocol = x.proxy.protocol;
+        protoparam = x.proxy.protocol_param;
+        obfs = x.proxy.obfs;
+        obfsparam = x.proxy.obfs_param;
 
         switch(x.linkType)
         {
@@ -2700,7 +3136,7 @@ std::string netchToSSD(std::vector<nodeInfo> &nodes, std::string &group, std::st
     return "ssd://" + base64_encode(sb.GetString());
 }
 
-std::string netchToMellow(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
+std::string netchToMellow(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
 {
     INIReader ini;
     ini.store_any_line = true;
@@ -2715,9 +3151,8 @@ std::string netchToMellow(std::vector<nodeInfo> &nodes, const std::string &base_
     return ini.ToString();
 }
 
-void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
+void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
 {
-    rapidjson::Document json;
     std::string proxy;
     std::string type, remark, hostname, port, username, password, method;
     std::string plugin, pluginopts;
@@ -2731,40 +3166,39 @@ void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rul
 
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-        type = GetMember(json, "Type");
+        type = getProxyTypeName(x);
 
         if(ext.append_proxy_type)
             x.remarks = "[" + type + "] " + x.remarks;
 
         processRemark(x.remarks, remark, remarks_list);
 
-        hostname = GetMember(json, "Hostname");
-        port = std::to_string((unsigned short)to_int(GetMember(json, "Port")));
-        username = GetMember(json, "Username");
-        password = GetMember(json, "Password");
-        method = GetMember(json, "EncryptMethod");
+        hostname = x.proxy.hostname;
+        port = std::to_string((unsigned short)x.proxy.port);
+        username = x.proxy.username;
+        password = x.proxy.password;
+        method = x.proxy.encrypt_method;
 
         tfo = ext.tfo;
         scv = ext.skip_cert_verify;
-        tfo.define(GetMember(json, "EnableTFO"));
-        scv.define(GetMember(json, "AllowInsecure"));
+        tfo.define(x.proxy.tfo);
+        scv.define(x.proxy.allow_insecure);
 
         switch(x.linkType)
         {
         case SPEEDTEST_MESSAGE_FOUNDSS:
-            if(GetMember(json, "Plugin").size())
+            if(x.proxy.plugin.size())
                 continue;
             proxy = remark + ", ss, ss://" + urlsafe_base64_encode(method + ":" + password) + "@" + hostname + ":" + port;
             break;
         case SPEEDTEST_MESSAGE_FOUNDVMESS:
-            id = GetMember(json, "UserID");
-            aid = GetMember(json, "AlterID");
-            transproto = GetMember(json, "TransferProtocol");
-            host = GetMember(json, "Host");
-            path = GetMember(json, "Path");
-            faketype = GetMember(json, "FakeType");
-            tlssecure = GetMember(json, "TLSSecure");
+            id = x.proxy.user_id;
+            aid = std::to_string(x.proxy.alter_id);
+            transproto = x.proxy.transfer_protocol;
+            host = x.proxy.host;
+            path = x.proxy.path;
+            faketype = x.proxy.fake_type;
+            tlssecure = x.proxy.tls_secure ? "true" : "false";
 
             proxy = remark + ", vmess1, vmess1://" + id + "@" + hostname + ":" + port;
             if(path.size())
@@ -2780,8 +3214,8 @@ void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rul
                     proxy += "&http.host=" + UrlEncode(host);
                 break;
             case "quic"_hash:
-                quicsecure = GetMember(json, "QUICSecure");
-                quicsecret = GetMember(json, "QUICSecret");
+                quicsecure = x.proxy.quic_secure;
+                quicsecret = x.proxy.quic_secret;
                 if(!quicsecure.empty())
                     proxy += "&quic.security=" + quicsecure + "&quic.key=" + quicsecret;
                 break;
@@ -2818,6 +3252,7 @@ void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rul
 
     ini.SetCurrentSection("EndpointGroup");
 
+    group_prefilter prefilter(extra_proxy_group, nodelist);
     for(const std::string &x : extra_proxy_group)
     {
         eraseElements(filtered_nodelist);
@@ -2847,7 +3282,7 @@ void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rul
         }
 
         for(unsigned int i = 2; i < rules_upper_bound; i++)
-            groupGenerate(vArray[i], nodelist, filtered_nodelist, false);
+            groupGenerate(vArray[i], nodelist, filtered_nodelist, false, prefilter);
 
         if(!filtered_nodelist.size())
         {
@@ -2885,9 +3320,8 @@ void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<rul
         rulesetToSurge(ini, ruleset_content_array, 0, ext.overwrite_original_rules, std::string());
 }
 
-std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
+std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext)
 {
-    rapidjson::Document json;
     INIReader ini;
     std::string proxy;
     std::string type, remark, hostname, port, username, password, method;
@@ -2916,21 +3350,20 @@ std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_co
 
     for(nodeInfo &x : nodes)
     {
-        json.Parse(x.proxyStr.data());
-        type = GetMember(json, "Type");
+        type = getProxyTypeName(x);
 
         if(ext.append_proxy_type)
             x.remarks = "[" + type + "] " + x.remarks;
 
         processRemark(x.remarks, remark, remarks_list);
 
-        hostname = GetMember(json, "Hostname");
-        port = std::to_string((unsigned short)to_int(GetMember(json, "Port")));
-        username = GetMember(json, "Username");
-        password = GetMember(json, "Password");
-        method = GetMember(json, "EncryptMethod");
+        hostname = x.proxy.hostname;
+        port = std::to_string((unsigned short)x.proxy.port);
+        username = x.proxy.username;
+        password = x.proxy.password;
+        method = x.proxy.encrypt_method;
 
-        scv = GetMember(json, "AllowInsecure");
+        scv = x.proxy.allow_insecure;
         scv.define(ext.skip_cert_verify);
 
         proxy.clear();
@@ -2938,8 +3371,8 @@ std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_co
         switch(x.linkType)
         {
         case SPEEDTEST_MESSAGE_FOUNDSS:
-            plugin = GetMember(json, "Plugin");
-            pluginopts = GetMember(json, "PluginOption");
+            plugin = x.proxy.plugin;
+            pluginopts = x.proxy.plugin_option;
 
             proxy = "Shadowsocks," + hostname + "," + port + "," + method + ",\"" + password + "\"";
             if(plugin == "simple-obfs" || plugin == "obfs-local")
@@ -2951,13 +3384,13 @@ std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_co
                 continue;
             break;
         case SPEEDTEST_MESSAGE_FOUNDVMESS:
-            id = GetMember(json, "UserID");
-            aid = GetMember(json, "AlterID");
-            transproto = GetMember(json, "TransferProtocol");
-            host = GetMember(json, "Host");
-            edge = GetMember(json, "Edge");
-            path = GetMember(json, "Path");
-            tlssecure = GetMember(json, "TLSSecure") == "true";
+            id = x.proxy.user_id;
+            aid = std::to_string(x.proxy.alter_id);
+            transproto = x.proxy.transfer_protocol;
+            host = x.proxy.host;
+            edge = x.proxy.edge;
+            path = x.proxy.path;
+            tlssecure = x.proxy.tls_secure;
             if(method == "auto")
                 method = "chacha20-ietf-poly1305";
 
@@ -2979,10 +3412,10 @@ std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_co
                 proxy += ",skip-cert-verify:" + std::string(scv.get() ? "1" : "0");
             break;
         case SPEEDTEST_MESSAGE_FOUNDSSR:
-            protocol = GetMember(json, "Protocol");
-            protoparam = GetMember(json, "ProtocolParam");
-            obfs = GetMember(json, "OBFS");
-            obfsparam = GetMember(json, "OBFSParam");
+            protocol = x.proxy.protocol;
+            protoparam = x.proxy.protocol_param;
+            obfs = x.proxy.obfs;
+            obfsparam = x.proxy.obfs_param;
             proxy = "ShadowsocksR," + hostname + "," + port + "," + method + ",\"" + password + "\"," + protocol + ",{" + protoparam + "}," + obfs + ",{" + obfsparam + "}";
             break;
         /*
@@ -2996,7 +3429,7 @@ std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_co
             proxy = "http," + hostname + "," + port + "," + username + "," + password;
             break;
         case SPEEDTEST_MESSAGE_FOUNDTROJAN:
-            host = GetMember(json, "Host");
+            host = x.proxy.host;
             proxy = "trojan," + hostname + "," + port + "," + password;
             if(host.size())
                 proxy += ",tls-name:" + host;
@@ -3029,6 +3462,7 @@ std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_co
 
     ini.SetCurrentSection("Proxy Group");
     ini.EraseSection();
+    group_prefilter prefilter(extra_proxy_group, nodelist);
     for(const std::string &x : extra_proxy_group)
     {
         eraseElements(filtered_nodelist);
@@ -3068,7 +3502,7 @@ std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_co
         }
 
         for(unsigned int i = 2; i < rules_upper_bound; i++)
-            groupGenerate(vArray[i], nodelist, filtered_nodelist, true);
+            groupGenerate(vArray[i], nodelist, filtered_nodelist, true, prefilter);
 
         if(!filtered_nodelist.size())
             filtered_nodelist.emplace_back("DIRECT");
@@ -3,6 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <future>
 
 #include "misc.h"
@@ -18,6 +21,37 @@ enum ruleset_type
     RULESET_CLASH_CLASSICAL
 };
 
+enum rule_support
+{
+    RULE_SUPPORT_CLASH = 1,
+    RULE_SUPPORT_SURGE = 2,
+    RULE_SUPPORT_SURGE2 = 4,
+    RULE_SUPPORT_QUANX = 8,
+    RULE_SUPPORT_SURFBOARD = 16
+};
+
+/// one ruleset line split as type,payload[,options...]
+struct parsed_rule
+{
+    std::string type;
+    std::string payload;
+    std::string options;
+    bool no_resolve = false;
+    bool logical = false;
+    int support = 0;
+};
+
+/// ruleset parsed once after fetching, rendered rules are cached per target until the ruleset is refreshed
+struct parsed_ruleset
+{
+    std::string group;
+    std::vector<parsed_rule> rules;
+    std::mutex render_lock;
+    std::map<int, string_array> rendered;
+};
+
+typedef std::shared_ptr<parsed_ruleset> parsed_ruleset_ptr;
+
 struct ruleset_content
 {
     std::string rule_group;
@@ -26,8 +60,14 @@ struct ruleset_content
     int rule_type = RULESET_SURGE;
     std::shared_future<std::string> rule_content;
     int update_interval = 0;
+    std::shared_future<parsed_ruleset_ptr> rule_parsed;
 };
 
+/// rename and emoji rules compiled into a program of node transforms, immutable once built and shared by all requests with the same rules
+struct node_transform;
+class DuktapeNodeList;
+typedef std::shared_ptr<const node_transform> node_transform_ptr;
+
 struct extra_settings
 {
     bool enable_rule_generator = true;
@@ -52,24 +92,28 @@ struct extra_settings
     bool clash_classical_ruleset = false;
     std::string sort_script = "";
     std::string clash_proxies_style = "flow";
+    node_transform_ptr transform = node_transform_ptr();
 };
 
-void rulesetToClash(YAML::Node &base_rule, std::vector<ruleset_content> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name);
-void rulesetToSurge(INIReader &base_rule, std::vector<ruleset_content> &ruleset_content_array, int surge_ver, bool overwrite_original_rules, std::string remote_path_prefix);
-void preprocessNodes(std::vector<nodeInfo> &nodes, const extra_settings &ext);
+parsed_ruleset_ptr parseRuleset(const std::string &content, int type, const std::string &group);
+void rulesetToClash(YAML::Node &base_rule, const std::vector<ruleset_content> &ruleset_content_array, bool overwrite_original_rules, bool new_field_name);
+void rulesetToSurge(INIReader &base_rule, const std::vector<ruleset_content> &ruleset_content_array, int surge_ver, bool overwrite_original_rules, std::string remote_path_prefix);
+node_transform_ptr compileNodeTransform(const string_array &rename_array, const string_array &emoji_array);
+/// node_objects keeps the node objects for batch script functions, pass the one the filter script used
+void preprocessNodes(std::vector<nodeInfo> &nodes, const extra_settings &ext, DuktapeNodeList *node_objects = NULL);
 
-std::string netchToClash(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, bool clashR, const extra_settings &ext);
+std::string netchToClash(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, bool clashR, const extra_settings &ext);
 void netchToClash(std::vector<nodeInfo> &nodes, YAML::Node &yamlnode, const string_array &extra_proxy_group, bool clashR, const extra_settings &ext);
-std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, int surge_ver, const extra_settings &ext);
-std::string netchToMellow(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
-void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
-std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
+std::string netchToSurge(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, int surge_ver, const extra_settings &ext);
+std::string netchToMellow(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
+void netchToMellow(std::vector<nodeInfo> &nodes, INIReader &ini, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
+std::string netchToLoon(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
 std::string netchToSSSub(std::string &base_conf, std::vector<nodeInfo> &nodes, const extra_settings &ext);
 std::string netchToSingle(std::vector<nodeInfo> &nodes, int types, const extra_settings &ext);
-std::string netchToQuanX(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
-void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
-std::string netchToQuan(std::vector<nodeInfo> &nodes, const std::string &base_conf, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
-void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
+std::string netchToQuanX(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
+void netchToQuanX(std::vector<nodeInfo> &nodes, INIReader &ini, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
+std::string netchToQuan(std::vector<nodeInfo> &nodes, const std::string &base_conf, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
+void netchToQuan(std::vector<nodeInfo> &nodes, INIReader &ini, const std::vector<ruleset_content> &ruleset_content_array, const string_array &extra_proxy_group, const extra_settings &ext);
 std::string netchToSSD(std::vector<nodeInfo> &nodes, std::string &group, std::string &userinfo, const extra_settings &ext);
 
 #endif // SUBEXPORT_H_INCLUDED
@@ -11,8 +11,6 @@
 #include "misc.h"
 #include "webget.h"
 
-extern std::string gManagedConfigPrefix;
-
 namespace inja
 {
     void convert_dot_to_json_pointer(nonstd::string_view dot, std::string& out)
@@ -138,7 +136,7 @@ int render_template(const std::string &content, const template_args &vars, std::
     });
     m_callbacks.add_callback("getLink", 1, [](inja::Arguments &args)
     {
-        return gManagedConfigPrefix + args.at(0)->get<std::string>();
+        return getPrefConfig()->managed_config_prefix + args.at(0)->get<std::string>();
     });
     m_callbacks.add_callback("startsWith", 2, [](inja::Arguments &args)
     {
@@ -252,7 +250,7 @@ std::string findFileName(const std::string &path)
     return path.substr(pos + 1, pos2 - pos - 1);
 }
 
-int renderClashScript(YAML::Node &base_rule, std::vector<ruleset_content> &ruleset_content_array, std::string remote_path_prefix, bool script, bool overwrite_original_rules, bool clash_classical_ruleset)
+int renderClashScript(YAML::Node &base_rule, const std::vector<ruleset_content> &ruleset_content_array, std::string remote_path_prefix, bool script, bool overwrite_original_rules, bool clash_classical_ruleset)
 {
     nlohmann::json data;
     std::string match_group, geoips, retrieved_rules;
@@ -268,7 +266,7 @@ int renderClashScript(YAML::Node &base_rule, std::vector<ruleset_content> &rules
     if(!overwrite_original_rules && base_rule["rules"].IsDefined())
         rules = safe_as<string_array>(base_rule["rules"]);
 
-    for(ruleset_content &x : ruleset_content_array)
+    for(const ruleset_content &x : ruleset_content_array)
     {
         rule_group = x.rule_group;
         rule_path = x.rule_path;
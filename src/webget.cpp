@@ -1,9 +1,20 @@
 #include <iostream>
 #include <unistd.h>
 #include <sys/stat.h>
-//#include <mutex>
+#include <utime.h>
+#include <mutex>
+#include <list>
 #include <thread>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <future>
 #include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <deque>
+#include <vector>
+#include <condition_variable>
 
 #include <curl/curl.h>
 
@@ -16,83 +27,18 @@
 #ifndef _stat
 #define _stat stat
 #endif // _stat
+#include <windows.h>
+#else
+#include <fcntl.h>
 #endif // _WIN32
 
 extern bool gPrintDbgInfo, gServeCacheOnFetchFail;
-extern int gLogLevel;
+extern int gLogLevel, gCacheStaleWhileRevalidate;
 
-/*
 typedef std::lock_guard<std::mutex> guarded_mutex;
-std::mutex cache_rw_lock;
-*/
-
-class RWLock
-{
-#define WRITE_LOCK_STATUS -1
-#define FREE_STATUS 0
-private:
-    const std::thread::id NULL_THREAD;
-    const bool WRITE_FIRST;
-    std::thread::id m_write_thread_id;
-    std::atomic_int m_lockCount;
-    std::atomic_uint m_writeWaitCount;
-public:
-    RWLock(const RWLock&) = delete;
-    RWLock& operator=(const RWLock&) = delete;
-    RWLock(bool writeFirst = true): WRITE_FIRST(writeFirst), m_write_thread_id(), m_lockCount(0), m_writeWaitCount(0) {}
-    virtual ~RWLock() = default;
-    int readLock()
-    {
-        if (std::this_thread::get_id() != m_write_thread_id)
-        {
-            int count;
-            if (WRITE_FIRST)
-                do {
-                    while ((count = m_lockCount) == WRITE_LOCK_STATUS || m_writeWaitCount > 0);
-                } while (!m_lockCount.compare_exchange_weak(count, count + 1));
-            else
-                do {
-                    while ((count = m_lockCount) == WRITE_LOCK_STATUS);
-                } while (!m_lockCount.compare_exchange_weak(count, count + 1));
-        }
-        return m_lockCount;
-    }
-    int readUnlock()
-    {
-        if (std::this_thread::get_id() != m_write_thread_id)
-            --m_lockCount;
-        return m_lockCount;
-    }
-    int writeLock()
-    {
-        if (std::this_thread::get_id() != m_write_thread_id)
-        {
-            ++m_writeWaitCount;
-            for (int zero = FREE_STATUS; !m_lockCount.compare_exchange_weak(zero, WRITE_LOCK_STATUS); zero = FREE_STATUS);
-            --m_writeWaitCount;
-            m_write_thread_id = std::this_thread::get_id();
-        }
-        return m_lockCount;
-    }
-    int writeUnlock()
-    {
-        if (std::this_thread::get_id() != m_write_thread_id)
-        {
-            throw std::runtime_error("writeLock/Unlock mismatch");
-        }
-        if (WRITE_LOCK_STATUS != m_lockCount)
-        {
-            throw std::runtime_error("RWLock internal error");
-        }
-        m_write_thread_id = NULL_THREAD;
-        m_lockCount.store(FREE_STATUS);
-        return m_lockCount;
-    }
-};
-
-RWLock cache_rw_lock;
 
 long gMaxAllowedDownloadSize = 1048576L;
+size_t gCacheMemorySize = 33554432;
 
 //std::string user_agent_str = "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/74.0.3729.169 Safari/537.36";
 std::string user_agent_str = "subconverter/" VERSION " cURL/" LIBCURL_VERSION;
@@ -100,6 +46,8 @@ std::string user_agent_str = "subconverter/" VERSION " cURL/" LIBCURL_VERSION;
 struct curl_progress_data
 {
     long size_limit = 0L;
+    CURL *handle = NULL;
+    const stream_sink *sink = NULL;
 };
 
 static inline void curl_init()
@@ -122,6 +70,18 @@ static int writer(char *data, size_t size, size_t nmemb, std::string *writerData
     return size * nmemb;
 }
 
+static int stream_writer(char *data, size_t size, size_t nmemb, curl_progress_data *transfer)
+{
+    long http_code = 0;
+    curl_easy_getinfo(transfer->handle, CURLINFO_RESPONSE_CODE, &http_code);
+    /// bodies of redirects and errors are discarded, just like curlCheckResult does
+    if(http_code != 200)
+        return size * nmemb;
+    if(!(*transfer->sink)(data, size * nmemb))
+        return 0;
+    return size * nmemb;
+}
+
 static int dummy_writer(char *data, size_t size, size_t nmemb, void *writerData)
 {
     /// dummy writer, do not save anything
@@ -165,43 +125,43 @@ static inline void curl_set_common_options(CURL *curl_handle, const char *url, c
     }
 }
 
-//static std::string curlGet(const std::string &url, const std::string &proxy, std::string &response_headers, CURLcode &return_code, const string_map &request_headers)
-static int curlGet(const FetchArgument &argument, FetchResult &result)
+static CURL *curlGetHandle(const FetchArgument &argument, FetchResult &result, struct curl_slist **list, curl_progress_data *limit)
 {
     CURL *curl_handle;
-    std::string *data = result.content, new_url = argument.url;
-    struct curl_slist *list = NULL;
-    defer(curl_slist_free_all(list);)
-    long retVal = 0;
-
-    curl_init();
+    std::string new_url = argument.url;
 
     curl_handle = curl_easy_init();
     if(argument.proxy.size())
     {
         if(startsWith(argument.proxy, "cors:"))
         {
-            list = curl_slist_append(list, "X-Requested-With: subconverter " VERSION);
+            *list = curl_slist_append(*list, "X-Requested-With: subconverter " VERSION);
             new_url = argument.proxy.substr(5) + argument.url;
         }
         else
             curl_easy_setopt(curl_handle, CURLOPT_PROXY, argument.proxy.data());
     }
-    curl_progress_data limit;
-    limit.size_limit = gMaxAllowedDownloadSize;
-    curl_set_common_options(curl_handle, new_url.data(), &limit);
+    limit->size_limit = result.stream ? 0L : gMaxAllowedDownloadSize;
+    curl_set_common_options(curl_handle, new_url.data(), limit);
 
     if(argument.request_headers)
     {
         for(auto &x : *argument.request_headers)
-            list = curl_slist_append(list, (x.first + ": " + x.second).data());
+            *list = curl_slist_append(*list, (x.first + ": " + x.second).data());
     }
-    list = curl_slist_append(list, "SubConverter-Request: 1");
-    list = curl_slist_append(list, "SubConverter-Version: " VERSION);
-    if(list)
-        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, list);
+    *list = curl_slist_append(*list, "SubConverter-Request: 1");
+    *list = curl_slist_append(*list, "SubConverter-Version: " VERSION);
+    if(*list)
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, *list);
 
-    if(result.content)
+    if(result.stream)
+    {
+        limit->handle = curl_handle;
+        limit->sink = result.stream;
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, stream_writer);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, limit);
+    }
+    else if(result.content)
     {
         curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, writer);
         curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, result.content);
@@ -215,6 +175,34 @@ static int curlGet(const FetchArgument &argument, FetchResult &result)
     }
     else
         curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, dummy_writer);
+    return curl_handle;
+}
+
+static void curlCheckResult(CURL *curl_handle, FetchResult &result)
+{
+    long retVal = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_HTTP_CODE, &retVal);
+    if(result.http_code)
+        *result.http_code = retVal;
+    if(result.content)
+    {
+        if(*result.status_code != CURLE_OK || retVal != 200)
+            result.content->clear();
+        result.content->shrink_to_fit();
+    }
+}
+
+//static std::string curlGet(const std::string &url, const std::string &proxy, std::string &response_headers, CURLcode &return_code, const string_map &request_headers)
+static int curlGet(const FetchArgument &argument, FetchResult &result)
+{
+    CURL *curl_handle;
+    struct curl_slist *list = NULL;
+    defer(curl_slist_free_all(list);)
+    curl_progress_data limit;
+
+    curl_init();
+
+    curl_handle = curlGetHandle(argument, result, &list, &limit);
 
     unsigned int fail_count = 0, max_fails = 1;
     while(true)
@@ -226,16 +214,9 @@ static int curlGet(const FetchArgument &argument, FetchResult &result)
             fail_count++;
     }
 
-    curl_easy_getinfo(curl_handle, CURLINFO_HTTP_CODE, &retVal);
+    curlCheckResult(curl_handle, result);
     curl_easy_cleanup(curl_handle);
 
-    if(data)
-    {
-        if(*result.status_code != CURLE_OK || retVal != 200)
-            data->clear();
-        data->shrink_to_fit();
-    }
-
     return *result.status_code;
 }
 
@@ -263,6 +244,563 @@ std::string buildSocks5ProxyString(const std::string &addr, int port, const std:
     return proxystr;
 }
 
+static inline std::string getCachePath(const std::string &url)
+{
+    return "cache/" + getMD5(url);
+}
+
+/// in-memory tier in front of the cache directory, bounded by gCacheMemorySize bytes
+struct memory_cache_entry
+{
+    std::string content;
+    std::string headers;
+    bool has_headers = false;
+    time_t mtime = 0;
+};
+
+typedef std::shared_ptr<const memory_cache_entry> memory_cache_entry_ptr;
+typedef std::list<std::string> memory_cache_list;
+
+static std::mutex memory_cache_lock;
+static memory_cache_list memory_cache_order;
+static std::unordered_map<std::string, std::pair<memory_cache_entry_ptr, memory_cache_list::iterator>> memory_cache;
+static size_t memory_cache_bytes = 0;
+static std::atomic<unsigned long long> memory_cache_hits(0), memory_cache_misses(0), memory_cache_evictions(0);
+
+static inline size_t memoryCacheEntrySize(const std::string &url, const memory_cache_entry &entry)
+{
+    return url.size() + entry.content.size() + entry.headers.size();
+}
+
+static memory_cache_entry_ptr memoryCacheGet(const std::string &url)
+{
+    guarded_mutex guard(memory_cache_lock);
+    auto iter = memory_cache.find(url);
+    if(iter == memory_cache.end())
+        return NULL;
+    memory_cache_order.splice(memory_cache_order.begin(), memory_cache_order, iter->second.second);
+    return iter->second.first;
+}
+
+static void memoryCacheErase(const std::string &url)
+{
+    auto iter = memory_cache.find(url);
+    if(iter == memory_cache.end())
+        return;
+    memory_cache_bytes -= memoryCacheEntrySize(url, *iter->second.first);
+    memory_cache_order.erase(iter->second.second);
+    memory_cache.erase(iter);
+}
+
+static void memoryCachePut(const std::string &url, const memory_cache_entry_ptr &entry)
+{
+    size_t entry_size = memoryCacheEntrySize(url, *entry);
+    guarded_mutex guard(memory_cache_lock);
+    memoryCacheErase(url);
+    if(entry_size > gCacheMemorySize)
+        return;
+    while(memory_cache_bytes + entry_size > gCacheMemorySize && !memory_cache_order.empty())
+    {
+        memoryCacheErase(memory_cache_order.back());
+        memory_cache_evictions++;
+    }
+    memory_cache_order.push_front(url);
+    memory_cache.emplace(url, std::make_pair(entry, memory_cache_order.begin()));
+    memory_cache_bytes += entry_size;
+}
+
+std::string getCacheStatus()
+{
+    size_t entries, bytes;
+    {
+        guarded_mutex guard(memory_cache_lock);
+        entries = memory_cache.size();
+        bytes = memory_cache_bytes;
+    }
+    std::string status = "memory_cache_entries: " + std::to_string(entries) + "\n";
+    status += "memory_cache_bytes: " + std::to_string(bytes) + "\n";
+    status += "memory_cache_limit: " + std::to_string(gCacheMemorySize) + "\n";
+    status += "memory_cache_hits: " + std::to_string(memory_cache_hits) + "\n";
+    status += "memory_cache_misses: " + std::to_string(memory_cache_misses) + "\n";
+    status += "memory_cache_evictions: " + std::to_string(memory_cache_evictions) + "\n";
+    return status;
+}
+
+#define CACHE_WRITE_LOCK_STRIPES 64
+
+/// writers of the same cache entry are serialized, readers never lock since files are replaced atomically
+static std::mutex cache_write_locks[CACHE_WRITE_LOCK_STRIPES];
+
+static inline std::mutex &cacheWriteLock(const std::string &path)
+{
+    return cache_write_locks[std::hash<std::string>()(path) % CACHE_WRITE_LOCK_STRIPES];
+}
+
+/// write to a temporary file first and rename it over the old one
+static bool cacheFileWrite(const std::string &path, const std::string &content)
+{
+    static std::atomic_uint tmp_index(0);
+    const std::string tmp_path = path + ".tmp" + std::to_string(tmp_index++);
+    std::FILE *fp = std::fopen(tmp_path.data(), "wb");
+    if(!fp)
+        return false;
+    bool success = std::fwrite(content.data(), 1, content.size(), fp) == content.size();
+    success = std::fclose(fp) == 0 && success;
+    if(success)
+    {
+#ifdef _WIN32
+        success = MoveFileExA(tmp_path.data(), path.data(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        success = rename(tmp_path.data(), path.data()) == 0;
+#endif // _WIN32
+    }
+    if(!success)
+        remove(tmp_path.data());
+    return success;
+}
+
+/// one buffer of the file size, filled by read() without going through stdio
+static std::string cacheFileRead(const std::string &path)
+{
+#ifdef _WIN32
+    return fileGet(path, true);
+#else
+    std::string content;
+    int fd = open(path.data(), O_RDONLY);
+    if(fd < 0)
+        return content;
+    defer(close(fd);)
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+        return content;
+    size_t size = st.st_size, total = 0;
+    content.resize(size);
+    while(total < size)
+    {
+        ssize_t len = read(fd, &content[total], size - total);
+        if(len <= 0)
+            break;
+        total += len;
+    }
+    content.resize(total);
+    return content;
+#endif // _WIN32
+}
+
+/// the header file is renamed after the content, one older than its content belongs to an unfinished write
+static bool cacheHeaderValid(const std::string &path, const std::string &path_header)
+{
+    struct stat content_st, header_st;
+    return stat(path.data(), &content_st) == 0 && stat(path_header.data(), &header_st) == 0 && header_st.st_mtime >= content_st.st_mtime;
+}
+
+static void cacheSave(const std::string &url, const std::string &content, const std::string *response_headers, time_t mtime)
+{
+    if(!gCacheMemorySize)
+        return;
+    std::shared_ptr<memory_cache_entry> entry = std::make_shared<memory_cache_entry>();
+    entry->content = content;
+    if(response_headers)
+    {
+        entry->headers = *response_headers;
+        entry->has_headers = true;
+    }
+    entry->mtime = mtime;
+    memoryCachePut(url, entry);
+}
+
+/// read the cache entry of url if it is still within TTL, memory first and then disk
+/// entries up to gCacheStaleWhileRevalidate seconds past TTL are also returned with stale set
+static bool cacheGet(const std::string &url, unsigned int cache_ttl, std::string &content, std::string *response_headers, bool &stale)
+{
+    time_t now = time(NULL);
+    double max_age = cache_ttl + (gCacheStaleWhileRevalidate > 0 ? gCacheStaleWhileRevalidate : 0);
+    stale = false;
+    if(gCacheMemorySize)
+    {
+        memory_cache_entry_ptr entry = memoryCacheGet(url);
+        if(entry && difftime(now, entry->mtime) <= max_age && (!response_headers || entry->has_headers))
+        {
+            memory_cache_hits++;
+            stale = difftime(now, entry->mtime) > cache_ttl;
+            writeLog(0, "CACHE " + std::string(stale ? "STALE" : "HIT") + ": '" + url + "', using memory cache.");
+            content = entry->content;
+            if(response_headers)
+                *response_headers = entry->headers;
+            return true;
+        }
+        memory_cache_misses++;
+    }
+
+    md("cache");
+    const std::string path = getCachePath(url), path_header = path + "_header";
+    struct stat result;
+    if(stat(path.data(), &result) == 0) // cache exist
+    {
+        time_t mtime = result.st_mtime; // get cache modified time
+        if(response_headers && !cacheHeaderValid(path, path_header))
+            writeLog(0, "CACHE MISS: '" + url + "', headers incomplete, creating new cache.");
+        else if(difftime(now, mtime) <= max_age) // within TTL or the stale window
+        {
+            stale = difftime(now, mtime) > cache_ttl;
+            writeLog(0, "CACHE " + std::string(stale ? "STALE" : "HIT") + ": '" + url + "', using local cache.");
+            if(response_headers)
+                *response_headers = cacheFileRead(path_header);
+            content = cacheFileRead(path);
+            cacheSave(url, content, response_headers, mtime);
+            return true;
+        }
+        else
+            writeLog(0, "CACHE MISS: '" + url + "', TTL timeout, creating new cache."); // out of TTL
+    }
+    else
+        writeLog(0, "CACHE NOT EXIST: '" + url + "', creating new cache.");
+    return false;
+}
+
+/// save a successful fetch to cache, or fall back to the old cache entry if allowed
+static void cacheUpdate(const std::string &url, int return_code, std::string &content, std::string *response_headers)
+{
+    const std::string path = getCachePath(url), path_header = path + "_header";
+    if(return_code == CURLE_OK) // success, save new cache
+    {
+        {
+            guarded_mutex guard(cacheWriteLock(path));
+            //content first, the headers complete the entry
+            if(cacheFileWrite(path, content) && response_headers)
+                cacheFileWrite(path_header, *response_headers);
+        }
+        cacheSave(url, content, response_headers, time(NULL));
+    }
+    else
+    {
+        memory_cache_entry_ptr entry = gServeCacheOnFetchFail && gCacheMemorySize ? memoryCacheGet(url) : NULL;
+        if(entry && (!response_headers || entry->has_headers))
+        {
+            writeLog(0, "Fetch failed. Serving cached content."); // serving the expired memory cache
+            content = entry->content;
+            if(response_headers)
+                *response_headers = entry->headers;
+        }
+        else if(fileExist(path) && gServeCacheOnFetchFail && (!response_headers || cacheHeaderValid(path, path_header))) // failed, check if cache exist
+        {
+            writeLog(0, "Fetch failed. Serving cached content."); // cache exist, serving cache
+            content = cacheFileRead(path);
+            if(response_headers)
+                *response_headers = cacheFileRead(path_header);
+        }
+        else
+            writeLog(0, "Fetch failed. No local cache available."); // cache not exist or not allow to serve cache, serving nothing
+    }
+}
+
+/// value of the last occurrence of header name, later blocks belong to redirected responses
+static std::string getHeaderValue(const std::string &headers, const std::string &name)
+{
+    std::string value;
+    string_size pos = 0, line_end, colon;
+    while(pos < headers.size())
+    {
+        line_end = headers.find('\n', pos);
+        if(line_end == headers.npos)
+            line_end = headers.size();
+        colon = headers.find(':', pos);
+        if(colon < line_end && colon - pos == name.size() && strncasecmp(headers.data() + pos, name.data(), name.size()) == 0)
+            value = trim(headers.substr(colon + 1, line_end - colon - 1));
+        pos = line_end + 1;
+    }
+    return value;
+}
+
+/// add If-None-Match and If-Modified-Since from the stored response headers of url
+static bool cacheConditionalHeaders(const std::string &url, const string_map *request_headers, string_map &conditional_headers)
+{
+    const std::string path = getCachePath(url), path_header = path + "_header";
+    std::string stored_headers;
+    memory_cache_entry_ptr entry = gCacheMemorySize ? memoryCacheGet(url) : NULL;
+    if(entry && entry->has_headers)
+        stored_headers = entry->headers;
+    else if(cacheHeaderValid(path, path_header))
+        stored_headers = cacheFileRead(path_header);
+    else
+        return false;
+
+    std::string etag = getHeaderValue(stored_headers, "ETag"), last_modified = getHeaderValue(stored_headers, "Last-Modified");
+    if(etag.empty() && last_modified.empty())
+        return false;
+    if(request_headers)
+        conditional_headers = *request_headers;
+    if(etag.size())
+        conditional_headers.emplace("If-None-Match", etag);
+    if(last_modified.size())
+        conditional_headers.emplace("If-Modified-Since", last_modified);
+    return true;
+}
+
+/// upstream answered 304, serve the stored entry and restart its TTL
+static bool cacheNotModified(const std::string &url, std::string &content, std::string *response_headers)
+{
+    const std::string path = getCachePath(url), path_header = path + "_header";
+    memory_cache_entry_ptr entry = gCacheMemorySize ? memoryCacheGet(url) : NULL;
+    if(entry && (!response_headers || entry->has_headers))
+    {
+        content = entry->content;
+        if(response_headers)
+            *response_headers = entry->headers;
+    }
+    else if(fileExist(path) && (!response_headers || cacheHeaderValid(path, path_header)))
+    {
+        content = cacheFileRead(path);
+        if(response_headers)
+            *response_headers = cacheFileRead(path_header);
+    }
+    else
+        return false;
+    writeLog(0, "CACHE REVALIDATED: '" + url + "', content not modified.");
+    {
+        guarded_mutex guard(cacheWriteLock(path));
+        utime(path.data(), NULL);
+        utime(path_header.data(), NULL);
+    }
+    cacheSave(url, content, response_headers, time(NULL));
+    return true;
+}
+
+/// finish a cache fetch, conditional ones may only need the stored entry refreshed
+static void cacheFinishFetch(const std::string &url, bool conditional, int return_code, long http_code, std::string &content, std::string *response_headers)
+{
+    if(conditional && return_code == CURLE_OK && http_code == 304 && cacheNotModified(url, content, response_headers))
+        return;
+    cacheUpdate(url, return_code, content, response_headers);
+}
+
+/// fetch url for the cache, revalidating with the stored validators when possible
+static void cacheFetch(const FetchArgument &argument, FetchResult &result)
+{
+    string_map conditional_headers;
+    long http_code = 0;
+    FetchResult fetch_res = result;
+    fetch_res.http_code = &http_code;
+    bool conditional = cacheConditionalHeaders(argument.url, argument.request_headers, conditional_headers);
+    if(conditional)
+        curlGet(FetchArgument{argument.url, argument.proxy, &conditional_headers, argument.cache_ttl}, fetch_res);
+    else
+        curlGet(argument, fetch_res);
+    cacheFinishFetch(argument.url, conditional, *result.status_code, http_code, *result.content, result.response_headers);
+}
+
+/// identical cached fetches running at the same time share one transfer
+struct inflight_result
+{
+    int return_code = 0;
+    std::string content;
+    std::string headers;
+};
+
+typedef std::shared_ptr<const inflight_result> inflight_result_ptr;
+typedef std::shared_future<inflight_result_ptr> inflight_fetch;
+
+static std::mutex inflight_lock;
+static std::map<std::string, inflight_fetch> inflight_fetches;
+
+/// return true if the caller should fetch url itself, otherwise inflight receives the running fetch
+static bool inflightBegin(const std::string &url, std::promise<inflight_result_ptr> &promise, inflight_fetch &inflight)
+{
+    guarded_mutex guard(inflight_lock);
+    auto iter = inflight_fetches.find(url);
+    if(iter != inflight_fetches.end())
+    {
+        inflight = iter->second;
+        return false;
+    }
+    inflight_fetches.emplace(url, promise.get_future().share());
+    return true;
+}
+
+static void inflightEnd(const std::string &url, std::promise<inflight_result_ptr> &promise, int return_code, const std::string &content, const std::string &headers)
+{
+    std::shared_ptr<inflight_result> result = std::make_shared<inflight_result>();
+    result->return_code = return_code;
+    result->content = content;
+    result->headers = headers;
+    {
+        guarded_mutex guard(inflight_lock);
+        inflight_fetches.erase(url);
+    }
+    promise.set_value(result);
+}
+
+static void inflightFail(const std::string &url, std::promise<inflight_result_ptr> &promise, std::exception_ptr error)
+{
+    {
+        guarded_mutex guard(inflight_lock);
+        inflight_fetches.erase(url);
+    }
+    promise.set_exception(error);
+}
+
+/// held by the caller which got true from inflightBegin, waiters are always released:
+/// with the result from end(), the exception passed to fail(), or an error if the leader leaves without either
+struct inflight_leader
+{
+    const std::string url;
+    std::promise<inflight_result_ptr> &promise;
+    bool finished = false;
+
+    inflight_leader(const std::string &url, std::promise<inflight_result_ptr> &promise) : url(url), promise(promise) {}
+    inflight_leader(const inflight_leader&) = delete;
+    ~inflight_leader()
+    {
+        if(!finished)
+            fail(std::make_exception_ptr(std::runtime_error("Fetch of '" + url + "' was abandoned.")));
+    }
+
+    void end(int return_code, const std::string &content, const std::string &headers)
+    {
+        inflightEnd(url, promise, return_code, content, headers);
+        finished = true;
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        finished = true;
+        inflightFail(url, promise, error);
+    }
+};
+
+static void inflightWait(const std::string &url, inflight_fetch &inflight, FetchResult &result)
+{
+    writeLog(0, "Waiting for in-flight fetch of '" + url + "'.", LOG_LEVEL_VERBOSE);
+    inflight_result_ptr shared = inflight.get();
+    *result.status_code = shared->return_code;
+    if(result.content)
+        *result.content = shared->content;
+    if(result.response_headers)
+        *result.response_headers = shared->headers;
+}
+
+#define CACHE_REFRESH_WORKERS 4
+#define CACHE_REFRESH_QUEUE_SIZE 256
+
+/// a background refresh whose in-flight entry is already registered, it has to end or fail exactly once
+struct cache_refresh
+{
+    std::string url, proxy;
+    string_map request_headers;
+    std::shared_ptr<std::promise<inflight_result_ptr>> promise;
+};
+
+/// never destroyed, stopCacheRefresh() joins the workers before the process exits
+struct cache_refresh_pool
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<cache_refresh> queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+};
+
+static cache_refresh_pool &getRefreshPool()
+{
+    static cache_refresh_pool *pool = new cache_refresh_pool;
+    return *pool;
+}
+
+static void cacheRefresh(cache_refresh &task)
+{
+    int return_code = 0;
+    std::string content, response_headers;
+    FetchArgument argument {task.url, task.proxy, &task.request_headers, 0};
+    FetchResult fetch_res {&return_code, &content, &response_headers};
+    inflight_leader leader(task.url, *task.promise);
+    try
+    {
+        cacheFetch(argument, fetch_res);
+    }
+    catch(std::exception &e)
+    {
+        /// nobody is left to rethrow to on this thread
+        writeLog(0, "Refreshing '" + task.url + "' failed: " + e.what(), LOG_LEVEL_ERROR);
+        leader.fail(std::current_exception());
+        return;
+    }
+    catch(...)
+    {
+        leader.fail(std::current_exception());
+        return;
+    }
+    leader.end(return_code, content, response_headers);
+}
+
+static void cacheRefreshWorker(cache_refresh_pool *pool)
+{
+    while(true)
+    {
+        cache_refresh task;
+        {
+            std::unique_lock<std::mutex> lock(pool->lock);
+            pool->cv.wait(lock, [pool](){ return pool->stopping || !pool->queue.empty(); });
+            if(pool->stopping)
+                return;
+            task = std::move(pool->queue.front());
+            pool->queue.pop_front();
+        }
+        cacheRefresh(task);
+    }
+}
+
+/// refresh a stale cache entry on the background workers, unless a fetch of it is already running
+/// when the queue is full the refresh is skipped, the stale copy is served until a later request queues it again
+static void cacheRevalidate(const FetchArgument &argument)
+{
+    cache_refresh_pool &pool = getRefreshPool();
+    {
+        guarded_mutex guard(pool.lock);
+        if(pool.stopping || pool.queue.size() >= CACHE_REFRESH_QUEUE_SIZE)
+            return;
+    }
+    cache_refresh task;
+    task.promise = std::make_shared<std::promise<inflight_result_ptr>>();
+    inflight_fetch inflight;
+    if(!inflightBegin(argument.url, *task.promise, inflight))
+        return;
+    task.url = argument.url;
+    task.proxy = argument.proxy;
+    if(argument.request_headers)
+        task.request_headers = *argument.request_headers;
+    writeLog(0, "Refreshing '" + task.url + "' in background.", LOG_LEVEL_VERBOSE);
+    {
+        guarded_mutex guard(pool.lock);
+        if(!pool.stopping)
+        {
+            if(pool.workers.size() < CACHE_REFRESH_WORKERS)
+                pool.workers.emplace_back(cacheRefreshWorker, &pool);
+            pool.queue.emplace_back(std::move(task));
+            pool.cv.notify_one();
+            return;
+        }
+    }
+    inflightFail(task.url, *task.promise, std::make_exception_ptr(std::runtime_error("Refresh of '" + task.url + "' was cancelled on exit.")));
+}
+
+void stopCacheRefresh()
+{
+    cache_refresh_pool &pool = getRefreshPool();
+    std::deque<cache_refresh> cancelled;
+    {
+        guarded_mutex guard(pool.lock);
+        pool.stopping = true;
+        cancelled.swap(pool.queue);
+    }
+    pool.cv.notify_all();
+    /// no workers are added once stopping is set, running refreshes finish within the transfer timeout
+    for(std::thread &x : pool.workers)
+        if(x.joinable())
+            x.join();
+    for(cache_refresh &x : cancelled)
+        inflightFail(x.url, *x.promise, std::make_exception_ptr(std::runtime_error("Refresh of '" + x.url + "' was cancelled on exit.")));
+}
+
 std::string webGet(const std::string &url, const std::string &proxy, unsigned int cache_ttl, std::string *response_headers, string_map *request_headers)
 {
     int return_code = 0;
@@ -276,53 +814,36 @@ std::string webGet(const std::string &url, const std::string &proxy, unsigned in
     // cache system
     if(cache_ttl > 0)
     {
-        md("cache");
-        const std::string url_md5 = getMD5(url);
-        const std::string path = "cache/" + url_md5, path_header = path + "_header";
-        struct stat result;
-        if(stat(path.data(), &result) == 0) // cache exist
+        bool stale;
+        if(cacheGet(url, cache_ttl, content, response_headers, stale))
         {
-            time_t mtime = result.st_mtime, now = time(NULL); // get cache modified time and current time
-            if(difftime(now, mtime) <= cache_ttl) // within TTL
-            {
-                writeLog(0, "CACHE HIT: '" + url + "', using local cache.");
-                //guarded_mutex guard(cache_rw_lock);
-                cache_rw_lock.readLock();
-                defer(cache_rw_lock.readUnlock();)
-                if(response_headers)
-                    *response_headers = fileGet(path_header, true);
-                return fileGet(path, true);
-            }
-            writeLog(0, "CACHE MISS: '" + url + "', TTL timeout, creating new cache."); // out of TTL
+            if(stale)
+                cacheRevalidate(argument);
+            return content;
         }
-        else
-            writeLog(0, "CACHE NOT EXIST: '" + url + "', creating new cache.");
+        std::promise<inflight_result_ptr> promise;
+        inflight_fetch inflight;
+        if(!inflightBegin(url, promise, inflight))
+        {
+            inflightWait(url, inflight, fetch_res);
+            return content;
+        }
+        inflight_leader leader(url, promise);
+        std::string headers;
+        fetch_res.response_headers = &headers;
         //content = curlGet(url, proxy, response_headers, return_code); // try to fetch data
-        curlGet(argument, fetch_res);
-        if(return_code == CURLE_OK) // success, save new cache
+        try
         {
-            //guarded_mutex guard(cache_rw_lock);
-            cache_rw_lock.writeLock();
-            defer(cache_rw_lock.writeUnlock();)
-            fileWrite(path, content, true);
-            if(response_headers)
-                fileWrite(path_header, *response_headers, true);
+            cacheFetch(argument, fetch_res);
         }
-        else
+        catch(...)
         {
-            if(fileExist(path) && gServeCacheOnFetchFail) // failed, check if cache exist
-            {
-                writeLog(0, "Fetch failed. Serving cached content."); // cache exist, serving cache
-                //guarded_mutex guard(cache_rw_lock);
-                cache_rw_lock.readLock();
-                defer(cache_rw_lock.readUnlock();)
-                content = fileGet(path, true);
-                if(response_headers)
-                    *response_headers = fileGet(path_header, true);
-            }
-            else
-                writeLog(0, "Fetch failed. No local cache available."); // cache not exist or not allow to serve cache, serving nothing
+            leader.fail(std::current_exception());
+            throw;
         }
+        leader.end(return_code, content, headers);
+        if(response_headers)
+            *response_headers = std::move(headers);
         return content;
     }
     //return curlGet(url, proxy, response_headers, return_code);
@@ -330,11 +851,140 @@ std::string webGet(const std::string &url, const std::string &proxy, unsigned in
     return content;
 }
 
+void webGetMulti(const std::vector<FetchArgument> &arguments, std::vector<FetchResult> &results)
+{
+    CURLM *multi_handle;
+    CURLSH *share_handle;
+    std::vector<CURL*> handles(arguments.size(), NULL);
+    std::vector<struct curl_slist*> lists(arguments.size(), NULL);
+    std::vector<curl_progress_data> limits(arguments.size());
+    std::vector<FetchResult> fetches = results;
+    std::vector<std::string> headers(arguments.size());
+    std::vector<std::promise<inflight_result_ptr>> promises(arguments.size());
+    std::vector<inflight_fetch> inflights(arguments.size());
+    std::vector<std::unique_ptr<inflight_leader>> leaders(arguments.size());
+    std::vector<char> conditionals(arguments.size(), 0);
+    std::exception_ptr error;
+    std::vector<string_map> conditional_headers(arguments.size());
+    std::vector<long> http_codes(arguments.size(), 0);
+    int running = 0;
+
+    curl_init();
+
+    multi_handle = curl_multi_init();
+    share_handle = curl_share_init();
+    /// let every transfer in this batch reuse resolved hosts, TLS sessions and open connections
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    for(size_t i = 0; i < arguments.size(); i++)
+    {
+        const FetchArgument &argument = arguments[i];
+        FetchResult &result = fetches[i];
+        *result.status_code = CURLE_OK;
+        if(argument.cache_ttl > 0)
+            result.stream = NULL; /// cache entries need the whole body
+        if(startsWith(argument.url, "data:"))
+        {
+            if(result.stream)
+            {
+                std::string data = dataGet(argument.url);
+                (*result.stream)(data.data(), data.size());
+            }
+            else if(result.content)
+                *result.content = dataGet(argument.url);
+            continue;
+        }
+        if(argument.cache_ttl > 0 && result.content)
+        {
+            bool stale;
+            if(cacheGet(argument.url, argument.cache_ttl, *result.content, result.response_headers, stale))
+            {
+                if(stale)
+                    cacheRevalidate(argument);
+                continue;
+            }
+            if(!inflightBegin(argument.url, promises[i], inflights[i]))
+                continue; /// wait for it after our own transfers are done
+            leaders[i].reset(new inflight_leader(argument.url, promises[i]));
+            if(!result.response_headers)
+                result.response_headers = &headers[i];
+            result.http_code = &http_codes[i];
+            conditionals[i] = cacheConditionalHeaders(argument.url, argument.request_headers, conditional_headers[i]);
+        }
+        if(conditionals[i])
+            handles[i] = curlGetHandle(FetchArgument{argument.url, argument.proxy, &conditional_headers[i], argument.cache_ttl}, result, &lists[i], &limits[i]);
+        else
+            handles[i] = curlGetHandle(argument, result, &lists[i], &limits[i]);
+        curl_easy_setopt(handles[i], CURLOPT_SHARE, share_handle);
+        curl_easy_setopt(handles[i], CURLOPT_PRIVATE, reinterpret_cast<void*>(i));
+        curl_multi_add_handle(multi_handle, handles[i]);
+    }
+
+    do
+    {
+        curl_multi_perform(multi_handle, &running);
+        if(running)
+            curl_multi_wait(multi_handle, NULL, 0, 1000, NULL);
+    } while(running);
+
+    CURLMsg *msg;
+    int msgs_left = 0;
+    while((msg = curl_multi_info_read(multi_handle, &msgs_left)))
+    {
+        if(msg->msg != CURLMSG_DONE)
+            continue;
+        void *index = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &index);
+        FetchResult &result = fetches[reinterpret_cast<size_t>(index)];
+        *result.status_code = msg->data.result;
+        curlCheckResult(msg->easy_handle, result);
+    }
+
+    for(size_t i = 0; i < arguments.size(); i++)
+    {
+        if(!handles[i])
+            continue;
+        curl_multi_remove_handle(multi_handle, handles[i]);
+        curl_easy_cleanup(handles[i]);
+        curl_slist_free_all(lists[i]);
+        if(leaders[i] && !error)
+        {
+            try
+            {
+                cacheFinishFetch(arguments[i].url, conditionals[i], *fetches[i].status_code, http_codes[i], *fetches[i].content, fetches[i].response_headers);
+            }
+            catch(...)
+            {
+                /// keep cleaning up the other handles, the exception is rethrown below
+                error = std::current_exception();
+                leaders[i]->fail(error);
+                continue;
+            }
+            leaders[i]->end(*fetches[i].status_code, *fetches[i].content, *fetches[i].response_headers);
+        }
+    }
+    curl_multi_cleanup(multi_handle);
+    curl_share_cleanup(share_handle);
+    eraseElements(leaders); /// leaders skipped after an error release their waiters here
+    if(error)
+        std::rethrow_exception(error);
+
+    /// only wait for other requests after finishing ours, so batches sharing urls can not block each other
+    for(size_t i = 0; i < arguments.size(); i++)
+        if(inflights[i].valid())
+            inflightWait(arguments[i].url, inflights[i], results[i]);
+}
+
 void flushCache()
 {
-    //guarded_mutex guard(cache_rw_lock);
-    cache_rw_lock.writeLock();
-    defer(cache_rw_lock.writeUnlock();)
+    {
+        guarded_mutex guard(memory_cache_lock);
+        eraseElements(memory_cache);
+        eraseElements(memory_cache_order);
+        memory_cache_bytes = 0;
+    }
     operateFiles("cache", [](const std::string &file){ remove(("cache/" + file).data()); return 0; });
 }
 
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <functional>
 
 #include "misc.h"
 
@@ -14,15 +15,27 @@ struct FetchArgument
     const unsigned int cache_ttl = 0;
 };
 
+/// receives the body chunk by chunk, return false to abort the transfer
+typedef std::function<bool(const char*, size_t)> stream_sink;
+
 struct FetchResult
 {
     int *status_code;
     std::string *content = NULL;
     std::string *response_headers = NULL;
+    long *http_code = NULL;
+    /// uncached fetches only: hand the body to the sink instead of content, without a size limit
+    const stream_sink *stream = NULL;
 };
 
 std::string webGet(const std::string &url, const std::string &proxy = "", unsigned int cache_ttl = 0, std::string *response_headers = NULL, string_map *request_headers = NULL);
+/// Fetch all urls concurrently over shared connections, results[i] receives arguments[i]
+void webGetMulti(const std::vector<FetchArgument> &arguments, std::vector<FetchResult> &results);
 void flushCache();
+/// hit, miss and eviction counters of the in-memory cache tier
+std::string getCacheStatus();
+/// cancel queued background refreshes and wait for the running ones, call once before exiting
+void stopCacheRefresh();
 int webPost(const std::string &url, const std::string &data, const std::string &proxy, const string_array &request_headers, std::string *retData);
 int webPatch(const std::string &url, const std::string &data, const std::string &proxy, const string_array &request_headers, std::string *retData);
 std::string buildSocks5ProxyString(const std::string &addr, int port, const std::string &username, const std::string &password);
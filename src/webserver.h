@@ -32,9 +32,11 @@ struct listener_args
     int max_workers;
 };
 
-void append_response(const std::string &method, const std::string &uri, const std::string &content_type, response_callback response);
-void append_redirect(const std::string &uri, const std::string &target);
-void reset_redirect();
+/// run_inline: answer on the event loop thread instead of a worker, only for cheap callbacks that never block
+void append_response(const std::string &method, const std::string &uri, const std::string &content_type, response_callback response, bool run_inline = false);
+/// both replace the previous settings as a whole and may be called while requests are served
+void set_redirect(const std::map<std::string, std::string> &redirects);
+void set_serve_file_root(const std::string &root);
 int start_web_server(void *argv);
 int start_web_server_multi(void *argv);
 void stop_web_server();
@@ -10,6 +10,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <string.h>
 #include <pthread.h>
 
@@ -17,13 +22,14 @@
 #include "webserver.h"
 #include "socket.h"
 #include "logger.h"
+#include "multithread.h"
 
 extern std::string user_agent_str;
 std::atomic_bool SERVER_EXIT_FLAG(false);
 
-// file server
-bool gServeFile = false;
-std::string gServeFileRoot;
+/// file server root and redirects, replaced as a whole when the preference is reloaded while requests are served
+static std::mutex server_settings_lock;
+static std::string serve_file_root;
 
 struct MIME_type
 {
@@ -75,7 +81,13 @@ std::string checkMIMEType(const std::string &filename)
 
 int serveFile(const std::string &filename, std::string &content_type, std::string &return_data)
 {
-    std::string realname = gServeFileRoot + filename;
+    std::string realname;
+    {
+        guarded_mutex guard(server_settings_lock);
+        if(serve_file_root.empty())
+            return 1;
+        realname = serve_file_root + filename;
+    }
     if(filename.compare("/") == 0)
         realname += "index.html";
     if(!fileExist(realname))
@@ -93,10 +105,11 @@ struct responseRoute
     std::string path;
     std::string content_type;
     response_callback rc;
+    bool run_inline = false;
 };
 
 std::vector<responseRoute> responses;
-string_map redirect_map;
+static string_map redirect_map;
 
 const char *request_header_blacklist[] = {"host", "accept", "accept-encoding"};
 
@@ -109,7 +122,43 @@ static inline void buffer_cleanup(struct evbuffer *eb)
 #endif // MALLOC_TRIM
 }
 
-static inline int process_request(Request &request, Response &response, std::string &return_data)
+struct dispatch_loop;
+
+struct pending_request
+{
+    evhttp_request *req = NULL;
+    dispatch_loop *loop = NULL;
+    responseRoute *route = NULL;
+    Request request;
+    Response response;
+    std::string return_data;
+    int retVal = -1;
+};
+
+/// one per event_base, workers hand finished requests back through notify_fd
+struct dispatch_loop
+{
+    event_base *base = NULL;
+    struct event *notify_event = NULL;
+    evutil_socket_t notify_fd[2] = {-1, -1};
+    std::mutex done_lock;
+    std::deque<pending_request*> done;
+};
+
+/// route callbacks run here so that the loop threads only accept, parse and send
+struct worker_pool
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<pending_request*> tasks;
+    std::vector<std::thread> workers;
+    size_t max_pending = 0;
+    bool stopping = false;
+};
+
+worker_pool request_pool;
+
+static inline int process_request(Request &request, Response &response, std::string &return_data, responseRoute **deferred = NULL)
 {
     writeLog(0, "handle_cmd:    " + request.method + " handle_uri:    " + request.url, LOG_LEVEL_VERBOSE);
 
@@ -128,6 +177,11 @@ static inline int process_request(Request &request, Response &response, std::str
         }
         else if(x.method == request.method && x.path == request.url)
         {
+            if(deferred != NULL && !x.run_inline) //leave the callback to a worker
+            {
+                *deferred = &x;
+                return 2;
+            }
             response_callback &rc = x.rc;
             return_data = rc(request, response);
             response.content_type = x.content_type;
@@ -135,10 +189,18 @@ static inline int process_request(Request &request, Response &response, std::str
         }
     }
 
-    auto iter = redirect_map.find(request.url);
-    if(iter != redirect_map.end())
+    bool redirect = false;
+    {
+        guarded_mutex guard(server_settings_lock);
+        auto iter = redirect_map.find(request.url);
+        if(iter != redirect_map.end())
+        {
+            return_data = iter->second;
+            redirect = true;
+        }
+    }
+    if(redirect)
     {
-        return_data = iter->second;
         if(request.argument.size())
         {
             if(return_data.find("?") != return_data.npos)
@@ -150,18 +212,177 @@ static inline int process_request(Request &request, Response &response, std::str
         return 0;
     }
 
-    if(gServeFile)
+    if(request.method.compare("GET") == 0 && serveFile(request.url, response.content_type, return_data) == 0)
+        return 0;
+
+    return -1;
+}
+
+static void send_response(evhttp_request *req, int retVal, Response &response, std::string &return_data)
+{
+    std::string content_type = response.content_type;
+
+    auto *OutBuf = evhttp_request_get_output_buffer(req);
+    //struct evbuffer *OutBuf = evbuffer_new();
+    if (!OutBuf)
+        return;
+
+    for(auto &x : response.headers)
+        evhttp_add_header(req->output_headers, x.first.data(), x.second.data());
+
+    switch(retVal)
     {
-        if(request.method.compare("GET") == 0 && serveFile(request.url, response.content_type, return_data) == 0)
-            return 0;
+    case 1: //found OPTIONS
+        evhttp_add_header(req->output_headers, "Access-Control-Allow-Origin", "*");
+        evhttp_add_header(req->output_headers, "Access-Control-Allow-Headers", "*");
+        evhttp_send_reply(req, response.status_code, "", NULL);
+        break;
+    case 0: //found normal
+        if(content_type.size())
+        {
+            if(content_type == "REDIRECT")
+            {
+                evhttp_add_header(req->output_headers, "Location", return_data.c_str());
+                evhttp_send_reply(req, HTTP_MOVETEMP, "", NULL);
+                buffer_cleanup(OutBuf);
+                return;
+            }
+            else
+                evhttp_add_header(req->output_headers, "Content-Type", content_type.c_str());
+        }
+        evhttp_add_header(req->output_headers, "Access-Control-Allow-Origin", "*");
+        evhttp_add_header(req->output_headers, "Connection", "close");
+        evbuffer_add(OutBuf, return_data.data(), return_data.size());
+        evhttp_send_reply(req, response.status_code, "", OutBuf);
+        break;
+    case -1: //not found
+        return_data = "File not found.";
+        evbuffer_add(OutBuf, return_data.data(), return_data.size());
+        evhttp_send_reply(req, HTTP_NOTFOUND, "", OutBuf);
+        //evhttp_send_error(req, HTTP_NOTFOUND, "Resource not found");
+        break;
+    default: //undefined behavior
+        evhttp_send_error(req, HTTP_INTERNAL, "");
     }
+    buffer_cleanup(OutBuf);
+}
 
-    return -1;
+static void worker_thread()
+{
+    while(true)
+    {
+        pending_request *task;
+        {
+            std::unique_lock<std::mutex> lock(request_pool.lock);
+            request_pool.cv.wait(lock, []{ return request_pool.stopping || !request_pool.tasks.empty(); });
+            if(request_pool.stopping)
+                return;
+            task = request_pool.tasks.front();
+            request_pool.tasks.pop_front();
+        }
+        task->response.content_type = task->route->content_type;
+        try
+        {
+            task->return_data = task->route->rc(task->request, task->response);
+        }
+        catch(std::exception &e)
+        {
+            writeLog(0, "Handler for '" + task->request.url + "' threw an exception: " + e.what(), LOG_LEVEL_ERROR);
+            task->response.status_code = 500;
+            task->response.content_type = "text/plain";
+            task->return_data = "Internal server error.";
+        }
+        catch(...)
+        {
+            writeLog(0, "Handler for '" + task->request.url + "' threw an unknown exception.", LOG_LEVEL_ERROR);
+            task->response.status_code = 500;
+            task->response.content_type = "text/plain";
+            task->return_data = "Internal server error.";
+        }
+        task->retVal = 0;
+
+        dispatch_loop *loop = task->loop;
+        {
+            guarded_mutex lock(loop->done_lock);
+            loop->done.push_back(task);
+        }
+        char c = 0;
+        send(loop->notify_fd[1], &c, 1, 0); //wake up the owning loop
+    }
+}
+
+static bool submit_request(pending_request *task)
+{
+    {
+        guarded_mutex lock(request_pool.lock);
+        if(request_pool.stopping || request_pool.tasks.size() >= request_pool.max_pending)
+            return false;
+        request_pool.tasks.push_back(task);
+    }
+    request_pool.cv.notify_one();
+    return true;
+}
+
+static void start_worker_pool(int nworkers, int max_pending)
+{
+    request_pool.max_pending = max_pending > 0 ? max_pending : 1;
+    for(int i = 0; i < nworkers; i++)
+        request_pool.workers.emplace_back(worker_thread);
+}
+
+static void stop_worker_pool()
+{
+    {
+        guarded_mutex lock(request_pool.lock);
+        request_pool.stopping = true;
+    }
+    request_pool.cv.notify_all();
+    for(std::thread &x : request_pool.workers)
+        x.join();
+    eraseElements(request_pool.workers);
+    for(pending_request *x : request_pool.tasks)
+        delete x;
+    eraseElements(request_pool.tasks);
+}
+
+static void on_request_done(evutil_socket_t fd, short what, void *arg)
+{
+    (void)what;
+    dispatch_loop *loop = reinterpret_cast<dispatch_loop*>(arg);
+    char buf[64];
+    while(recv(fd, buf, sizeof(buf), 0) > 0); //drain notifications
+
+    std::deque<pending_request*> done;
+    {
+        guarded_mutex lock(loop->done_lock);
+        done.swap(loop->done);
+    }
+    for(pending_request *x : done)
+    {
+        send_response(x->req, x->retVal, x->response, x->return_data);
+        delete x;
+    }
+}
+
+static int init_dispatch_loop(dispatch_loop &loop)
+{
+#ifdef _WIN32
+    int family = AF_INET;
+#else
+    int family = AF_UNIX;
+#endif // _WIN32
+    if(evutil_socketpair(family, SOCK_STREAM, 0, loop.notify_fd) != 0)
+        return -1;
+    evutil_make_socket_nonblocking(loop.notify_fd[0]);
+    evutil_make_socket_nonblocking(loop.notify_fd[1]);
+    loop.notify_event = event_new(loop.base, loop.notify_fd[0], EV_READ | EV_PERSIST, on_request_done, &loop);
+    if(loop.notify_event == NULL || event_add(loop.notify_event, NULL) != 0)
+        return -1;
+    return 0;
 }
 
 void OnReq(evhttp_request *req, void *args)
 {
-    (void)args;
     const char *req_content_type = evhttp_find_header(req->input_headers, "Content-Type"), *req_ac_method = evhttp_find_header(req->input_headers, "Access-Control-Request-Method");
     const char *uri = req->uri, *internal_flag = evhttp_find_header(req->input_headers, "SubConverter-Request");
 
@@ -212,52 +433,24 @@ void OnReq(evhttp_request *req, void *args)
     request.headers.emplace("X-Client-IP", client_ip);
 
     std::string return_data;
-    int retVal = process_request(request, response, return_data);
-    std::string content_type = response.content_type;
-
-    auto *OutBuf = evhttp_request_get_output_buffer(req);
-    //struct evbuffer *OutBuf = evbuffer_new();
-    if (!OutBuf)
-        return;
-
-    for(auto &x : response.headers)
-        evhttp_add_header(req->output_headers, x.first.data(), x.second.data());
-
-    switch(retVal)
+    dispatch_loop *loop = reinterpret_cast<dispatch_loop*>(args);
+    responseRoute *route = NULL;
+    int retVal = process_request(request, response, return_data, loop != NULL ? &route : NULL);
+    if(retVal == 2)
     {
-    case 1: //found OPTIONS
-        evhttp_add_header(req->output_headers, "Access-Control-Allow-Origin", "*");
-        evhttp_add_header(req->output_headers, "Access-Control-Allow-Headers", "*");
-        evhttp_send_reply(req, response.status_code, "", NULL);
-        break;
-    case 0: //found normal
-        if(content_type.size())
+        pending_request *task = new pending_request;
+        task->req = req;
+        task->loop = loop;
+        task->route = route;
+        task->request = std::move(request);
+        if(!submit_request(task))
         {
-            if(content_type == "REDIRECT")
-            {
-                evhttp_add_header(req->output_headers, "Location", return_data.c_str());
-                evhttp_send_reply(req, HTTP_MOVETEMP, "", NULL);
-                buffer_cleanup(OutBuf);
-                return;
-            }
-            else
-                evhttp_add_header(req->output_headers, "Content-Type", content_type.c_str());
+            delete task;
+            evhttp_send_error(req, HTTP_SERVUNAVAIL, "Server busy");
         }
-        evhttp_add_header(req->output_headers, "Access-Control-Allow-Origin", "*");
-        evhttp_add_header(req->output_headers, "Connection", "close");
-        evbuffer_add(OutBuf, return_data.data(), return_data.size());
-        evhttp_send_reply(req, response.status_code, "", OutBuf);
-        break;
-    case -1: //not found
-        return_data = "File not found.";
-        evbuffer_add(OutBuf, return_data.data(), return_data.size());
-        evhttp_send_reply(req, HTTP_NOTFOUND, "", OutBuf);
-        //evhttp_send_error(req, HTTP_NOTFOUND, "Resource not found");
-        break;
-    default: //undefined behavior
-        evhttp_send_error(req, HTTP_INTERNAL, "");
+        return;
     }
-    buffer_cleanup(OutBuf);
+    send_response(req, retVal, response, return_data);
 }
 
 int start_web_server(void *argv)
@@ -351,30 +544,35 @@ int start_web_server_multi(void *argv)
     if (nfd < 0)
         return -1;
 
+    start_worker_pool(nthreads, args->max_conn);
+
     pthread_t ths[nthreads];
-    struct event_base *base[nthreads];
+    std::vector<dispatch_loop> loops(nthreads);
     for (i = 0; i < nthreads; i++)
     {
-        base[i] = event_init();
-        if (base[i] == NULL)
+        loops[i].base = event_init();
+        if (loops[i].base == NULL)
+            return -1;
+        if (init_dispatch_loop(loops[i]) != 0)
             return -1;
-        struct evhttp *httpd = evhttp_new(base[i]);
+        struct evhttp *httpd = evhttp_new(loops[i].base);
         if (httpd == NULL)
             return -1;
         if (evhttp_accept_socket(httpd, nfd) != 0)
             return -1;
 
         evhttp_set_allowed_methods(httpd, EVHTTP_REQ_GET | EVHTTP_REQ_POST | EVHTTP_REQ_OPTIONS);
-        evhttp_set_gencb(httpd, OnReq, nullptr);
+        evhttp_set_gencb(httpd, OnReq, &loops[i]);
         evhttp_set_timeout(httpd, 30);
-        if (pthread_create(&ths[i], NULL, httpserver_dispatch, base[i]) != 0)
+        if (pthread_create(&ths[i], NULL, httpserver_dispatch, loops[i].base) != 0)
             return -1;
     }
     while (!SERVER_EXIT_FLAG)
         sleep(200); //block forever until receive stop signal
 
+    stop_worker_pool();
     for (i = 0; i < nthreads; i++)
-        event_base_loopbreak(base[i]); //stop the loop
+        event_base_loopbreak(loops[i].base); //stop the loop
 
     shutdown(nfd, SD_BOTH); //stop accept call
     closesocket(nfd); //close listener socket
@@ -387,22 +585,25 @@ void stop_web_server()
     SERVER_EXIT_FLAG = true;
 }
 
-void append_response(const std::string &method, const std::string &uri, const std::string &content_type, response_callback response)
+void append_response(const std::string &method, const std::string &uri, const std::string &content_type, response_callback response, bool run_inline)
 {
     responseRoute rr;
     rr.method = method;
     rr.path = uri;
     rr.content_type = content_type;
     rr.rc = response;
+    rr.run_inline = run_inline;
     responses.emplace_back(std::move(rr));
 }
 
-void append_redirect(const std::string &uri, const std::string &target)
+void set_redirect(const string_map &redirects)
 {
-    redirect_map[uri] = target;
+    guarded_mutex guard(server_settings_lock);
+    redirect_map = redirects;
 }
 
-void reset_redirect()
+void set_serve_file_root(const std::string &root)
 {
-    eraseElements(redirect_map);
+    guarded_mutex guard(server_settings_lock);
+    serve_file_root = root;
 }